@@ -0,0 +1,33 @@
+#version 440 core
+
+
+#section vertex
+
+
+layout(location = 0) out vec2 o_uv;
+
+
+void main() {
+    // One triangle covering the whole screen, without any vertex buffer
+    const vec2 uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(2.0 * uv - 1.0, 0.0, 1.0);
+
+    // The first row of the image is the top of the screen
+    o_uv = vec2(uv.x, 1.0 - uv.y);
+}
+
+
+#section fragment
+
+
+layout(location = 0) in vec2 i_uv;
+
+
+layout(location = 0) out vec4 o_color;
+
+uniform sampler2D u_image;
+
+
+void main() {
+    o_color = vec4(clamp(texture(u_image, i_uv).rgb, 0.0, 1.0), 1.0);
+}
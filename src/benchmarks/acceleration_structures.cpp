@@ -0,0 +1,167 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+// Compares the acceleration structures available to meshes: build time, memory and ray throughput.
+// Usage: acceleration_structures_benchmark [model.obj] [subdivision levels] [ray count]
+
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "thirdparty/kmath/vector.hpp"
+
+#include "geometry/acceleration_structures.hpp"
+#include "geometry/mesh.hpp"
+#include "geometry/ray.hpp"
+#include "utils/profiler.hpp"
+
+
+using namespace kmath;
+
+
+// Rays starting on a sphere around the mesh, aimed at random points of its bounding box.
+std::vector<Ray> generate_rays(Mesh &p_mesh, const size_t p_ray_count) {
+  Vec3 minimum = Vec3::INF;
+  Vec3 maximum = -Vec3::INF;
+  for (size_t i = 0; i < p_mesh.get_vertex_count(); i++) {
+    minimum = kmath::min(minimum, p_mesh.get_position(i));
+    maximum = kmath::max(maximum, p_mesh.get_position(i));
+  }
+  const Vec3 center = 0.5f * (minimum + maximum);
+  const float radius = length(maximum - minimum);
+
+  std::mt19937 rng(47);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::normal_distribution<float> normal;
+
+  std::vector<Ray> rays;
+  rays.reserve(p_ray_count);
+  for (size_t i = 0; i < p_ray_count; i++) {
+    const Vec3 origin = center + radius * normalized(Vec3(normal(rng), normal(rng), normal(rng)));
+    const Vec3 target = minimum + Vec3(unit(rng), unit(rng), unit(rng)) * (maximum - minimum);
+    rays.push_back(Ray(origin, target - origin));
+  }
+  return rays;
+}
+
+
+int main(int argc, char **argv) {
+  const char *model_path = (argc > 1)? argv[1] : "assets/models/suzanne.obj";
+  const int subdivision_levels = (argc > 2)? std::atoi(argv[2]) : 3;
+  const size_t ray_count = (argc > 3)? std::atoll(argv[3]) : 100000;
+
+  const std::pair<AccelerationStructureType, const char*> structures[] = {
+    {AccelerationStructureType::KD_TREE, "KDTree"},
+    {AccelerationStructureType::BVH, "BVH"},
+  };
+
+  std::cout << std::left
+    << std::setw(8) << "struct"
+    << std::setw(12) << "triangles"
+    << std::setw(24) << "build"
+    << std::setw(12) << "memory (KB)"
+    << std::setw(10) << "SAH cost"
+    << std::setw(12) << "Mrays/s"
+    << "hits" << std::endl;
+
+  Mesh mesh;
+  mesh.load_obj(model_path, false); // The builds are measured, the cached KDTree must not be used
+
+  for (int level = 0; level <= subdivision_levels; level++) {
+    if (level > 0) {
+      mesh.subdivide();
+    }
+
+    const std::vector<Ray> rays = generate_rays(mesh, ray_count);
+    std::vector<float> reference_distances;
+
+    for (const auto &[type, name] : structures) {
+      Profiler build_profiler;
+      build_profiler.start();
+      mesh.build_acceleration_structure(type);
+      build_profiler.end();
+
+      std::vector<float> distances(rays.size());
+      size_t hit_count = 0;
+
+      Profiler trace_profiler;
+      trace_profiler.start();
+      for (size_t i = 0; i < rays.size(); i++) {
+        const RayMeshIntersection intersection = mesh.intersect(rays[i]);
+        distances[i] = (intersection.exists)? intersection.distance : -1.0f;
+        hit_count += intersection.exists;
+      }
+      trace_profiler.end();
+
+      const double rays_per_second = rays.size() / (trace_profiler.get_exec_time_nanoseconds() * 1e-9);
+      const AccelerationStructureStatistics statistics = mesh.get_acceleration_structure_statistics().value();
+
+      std::stringstream build_time;
+      build_time << build_profiler.get_exec_time();
+
+      std::cout << std::left
+        << std::setw(8) << name
+        << std::setw(12) << mesh.get_triangle_count()
+        << std::setw(24) << build_time.str()
+        << std::setw(12) << statistics.memory_size / 1024
+        << std::setw(10) << std::setprecision(4) << statistics.sah_cost
+        << std::setw(12) << std::setprecision(4) << rays_per_second * 1e-6
+        << hit_count << std::endl;
+
+      // Every structure must find the same hits
+      if (reference_distances.empty()) {
+        reference_distances = std::move(distances);
+      } else {
+        size_t mismatch_count = 0;
+        for (size_t i = 0; i < rays.size(); i++) {
+          mismatch_count += std::abs(distances[i] - reference_distances[i]) > 1e-4f;
+        }
+        if (mismatch_count) {
+          std::cout << "\t" << mismatch_count << " rays disagree with " << structures[0].second << std::endl;
+        }
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
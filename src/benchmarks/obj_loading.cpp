@@ -0,0 +1,193 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+// Measures the throughput of the Wavefront OBJ loader, against a loader reading the file token by token through an
+// std::ifstream as the loader used to. Without a file, a grid of about 2 * size^2 triangles is generated.
+// Usage: obj_loading_benchmark [obj path | grid size] [repetitions]
+
+
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "thirdparty/kmath/vector.hpp"
+#include "tp_utils/src/model_loaders/wavefront_object.hpp"
+
+#include "utils/profiler.hpp"
+#include "utils/thread_pool.hpp"
+
+
+using namespace kmath;
+
+
+// Writes a wavy grid of p_size x p_size vertices
+void generate_grid(const std::filesystem::path &p_path, const size_t p_size) {
+  std::ofstream file(p_path);
+  file << std::fixed << std::setprecision(6);
+  file << "o Grid\n";
+  for (size_t j = 0; j < p_size; j++) {
+    for (size_t i = 0; i < p_size; i++) {
+      const float x = static_cast<float>(i) / p_size;
+      const float z = static_cast<float>(j) / p_size;
+      file << "v " << x << " " << 0.1f * std::sin(20.0f * x) * std::cos(20.0f * z) << " " << z << "\n";
+    }
+  }
+  for (size_t j = 0; j < p_size; j++) {
+    for (size_t i = 0; i < p_size; i++) {
+      file << "vt " << static_cast<float>(i) / (p_size - 1) << " " << static_cast<float>(j) / (p_size - 1) << "\n";
+    }
+  }
+  file << "vn 0.000000 1.000000 0.000000\n";
+  for (size_t j = 0; j + 1 < p_size; j++) {
+    for (size_t i = 0; i + 1 < p_size; i++) {
+      const size_t a = j * p_size + i + 1;
+      const size_t b = a + 1;
+      const size_t c = a + p_size;
+      const size_t d = c + 1;
+      file << "f " << a << "/" << a << "/1 " << c << "/" << c << "/1 " << b << "/" << b << "/1\n";
+      file << "f " << b << "/" << b << "/1 " << c << "/" << c << "/1 " << d << "/" << d << "/1\n";
+    }
+  }
+}
+
+
+// Reference loader, reading the elements one token at a time
+size_t load_with_streams(const std::filesystem::path &p_path) {
+  std::vector<Vec3> positions;
+  std::vector<Vec2> uvs;
+  std::vector<Vec3> normals;
+  std::vector<uint32_t> indices;
+
+  std::ifstream file(p_path);
+  std::string token;
+  while (file >> token) {
+    if (token == "v") {
+      Vec3 position;
+      file >> position.x >> position.y >> position.z;
+      positions.push_back(position);
+    } else if (token == "vt") {
+      Vec2 uv;
+      file >> uv.x >> uv.y;
+      uvs.push_back(uv);
+    } else if (token == "vn") {
+      Vec3 normal;
+      file >> normal.x >> normal.y >> normal.z;
+      normals.push_back(normal);
+    } else if (token == "f") {
+      for (int i = 0; i < 3; i++) {
+        uint32_t position, uv, normal;
+        char separator;
+        file >> position >> separator >> uv >> separator >> normal;
+        indices.push_back(position - 1);
+        indices.push_back(uv - 1);
+        indices.push_back(normal - 1);
+      }
+    } else {
+      std::getline(file, token);
+    }
+  }
+  return indices.size() / 9;
+}
+
+
+size_t load_with_wavefront_mesh(const std::filesystem::path &p_path) {
+  ThreadPool *pool = ThreadPool::get_singleton();
+  const tputils::WavefrontMesh mesh = tputils::WavefrontMesh::load(p_path, pool->get_thread_count(), [pool](const size_t p_count, const std::function<void(size_t)> &p_function) {
+    parallel_for(0, p_count, [&](const size_t, const size_t p_index) { p_function(p_index); }, 1, pool);
+  });
+  size_t triangle_count = 0;
+  for (const auto &[name, object] : mesh.objects) {
+    triangle_count += object.position_indices.size() / 3;
+  }
+  return triangle_count;
+}
+
+
+int main(int argc, char **argv) {
+  std::filesystem::path path;
+  const char *argument = (argc > 1)? argv[1] : "708";
+  if (std::filesystem::exists(argument)) {
+    path = argument;
+  } else {
+    path = std::filesystem::temp_directory_path() / "obj_loading_benchmark.obj";
+    std::cout << "Generating " << path.string() << std::endl;
+    generate_grid(path, std::atoll(argument));
+  }
+  const int repetitions = (argc > 2)? std::atoi(argv[2]) : 3;
+
+  const double file_size = static_cast<double>(std::filesystem::file_size(path)) / (1024.0 * 1024.0);
+  std::cout << path.string() << ": " << std::setprecision(4) << file_size << " MB" << std::endl;
+
+  const std::pair<size_t (*)(const std::filesystem::path&), const char*> loaders[] = {
+    {&load_with_streams, "istream"},
+    {&load_with_wavefront_mesh, "WavefrontMesh"},
+  };
+
+  std::cout << std::left
+    << std::setw(16) << "loader"
+    << std::setw(12) << "triangles"
+    << std::setw(12) << "time (ms)"
+    << "MB/s" << std::endl;
+
+  for (const auto &[loader, name] : loaders) {
+    size_t triangle_count = 0;
+    uint64_t best_time = UINT64_MAX;
+    for (int i = 0; i < repetitions; i++) {
+      Profiler profiler;
+      profiler.start();
+      triangle_count = loader(path);
+      profiler.end();
+      best_time = std::min(best_time, profiler.get_exec_time_microseconds());
+    }
+
+    const double milliseconds = best_time * 1e-3;
+    std::cout << std::left
+      << std::setw(16) << name
+      << std::setw(12) << triangle_count
+      << std::setw(12) << milliseconds
+      << file_size / (milliseconds * 1e-3) << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
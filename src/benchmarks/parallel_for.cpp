@@ -0,0 +1,127 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+// Measures the dispatch overhead of the parallel APIs on a cheap per-pixel pass, similar to tone mapping.
+// Usage: parallel_for_benchmark [pixel count] [repetitions]
+
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "thirdparty/kmath/vector.hpp"
+
+#include "utils/profiler.hpp"
+#include "utils/thread_group.hpp"
+#include "utils/thread_pool.hpp"
+
+
+using namespace kmath;
+
+
+static inline Vec3 tonemap_reinhard(const Vec3 &p_color) {
+  return p_color / (Vec3::ONE + p_color);
+}
+
+
+// Runs p_pass p_repetitions times over the pixels, returns the average time per pixel
+template<typename F>
+double run(const std::vector<Vec3> &p_source, std::vector<Vec3> &r_pixels, const size_t p_repetitions, F &&p_pass) {
+  Profiler profiler;
+  size_t total_time = 0;
+  for (size_t i = 0; i < p_repetitions; i++) {
+    r_pixels = p_source;
+    profiler.start();
+    p_pass();
+    profiler.end();
+    total_time += profiler.get_exec_time_nanoseconds();
+  }
+  return static_cast<double>(total_time) / (p_repetitions * p_source.size());
+}
+
+
+int main(int argc, char **argv) {
+  const size_t pixel_count = (argc > 1)? std::atoll(argv[1]) : 1920 * 1080;
+  const size_t repetitions = (argc > 2)? std::atoll(argv[2]) : 20;
+
+  std::vector<Vec3> source(pixel_count);
+  for (size_t i = 0; i < pixel_count; i++) {
+    source[i] = Vec3(static_cast<float>(i % 1024), static_cast<float>(i % 256), static_cast<float>(i % 64)) * 0.01f;
+  }
+  std::vector<Vec3> pixels;
+
+  ThreadPool *pool = ThreadPool::get_singleton();
+  std::cout << "Tone mapping " << pixel_count << " pixels on " << pool->get_thread_count() << " threads" << std::endl;
+
+  auto tonemap_pixel = [&]([[maybe_unused]] const size_t p_thread_id, const size_t p_index) {
+    pixels[p_index] = tonemap_reinhard(pixels[p_index]);
+  };
+
+  const double sequential_time = run(source, pixels, repetitions, [&]() {
+    for (size_t i = 0; i < pixel_count; i++) {
+      tonemap_pixel(0, i);
+    }
+  });
+
+  // One std::function call per pixel, as the work group used to do
+  const ParallelFunction per_pixel_function = tonemap_pixel;
+  const double std_function_time = run(source, pixels, repetitions, [&]() {
+    parallel_for(0, pixel_count, [&](const size_t p_thread_id, const size_t p_index) {
+      per_pixel_function(p_thread_id, p_index);
+    });
+  });
+
+  ThreadWorkGroup work_group;
+  const double work_group_time = run(source, pixels, repetitions, [&]() {
+    work_group.execute(tonemap_pixel, 0, pixel_count);
+    work_group.join();
+  });
+
+  const double parallel_for_time = run(source, pixels, repetitions, [&]() {
+    parallel_for(0, pixel_count, tonemap_pixel);
+  });
+
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "sequential loop:               " << sequential_time << " ns/pixel" << std::endl;
+  std::cout << "std::function per pixel:       " << std_function_time << " ns/pixel" << std::endl;
+  std::cout << "ThreadWorkGroup (16x16 tiles): " << work_group_time << " ns/pixel" << std::endl;
+  std::cout << "parallel_for:                  " << parallel_for_time << " ns/pixel" << std::endl;
+
+  return 0;
+}
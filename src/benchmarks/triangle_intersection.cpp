@@ -0,0 +1,233 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+// Measures the cost of a single ray/triangle test for each kernel, and checks that the packet kernels agree.
+// Usage: triangle_intersection_benchmark [triangle count] [ray count]
+
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "thirdparty/kmath/euclidian_flat_3d.hpp"
+#include "thirdparty/kmath/vector.hpp"
+
+#include "geometry/plane.hpp"
+#include "geometry/ray.hpp"
+#include "geometry/triangle.hpp"
+#include "geometry/triangle_packet.hpp"
+#include "utils/profiler.hpp"
+
+
+using namespace kmath;
+
+
+// Previous kernel: meet of the ray with the plane of the triangle, then barycentric coordinates of the hit point.
+// Kept as a reference point for the measurements.
+static std::optional<RayTriangleIntersection> get_intersection_through_plane(const Ray &p_ray, const Triangle &p_triangle) {
+  const Vec3 a = p_triangle.points[1] - p_triangle.points[0];
+  const Vec3 b = p_triangle.points[2] - p_triangle.points[0];
+  const Plane3 plane = Plane3::plane(cross(a, b), 0.0);
+  const Ray ray = Ray(p_ray.origin - p_triangle.points[0], p_ray.direction);
+
+  const std::optional<Vec3> plane_intersection = get_intersection(ray, plane);
+  if (!plane_intersection.has_value()) return std::optional<RayTriangleIntersection>();
+
+  const Vec3 local_intersection = plane_intersection.value();
+  const Vec2 tri_coord = get_coordinates(local_intersection, a, b);
+  const float coord_sum = tri_coord.x + tri_coord.y;
+  if (tri_coord.x < 0.0 || tri_coord.y < 0.0 || coord_sum > 1.0) return std::optional<RayTriangleIntersection>();
+
+  RayTriangleIntersection intersection;
+  intersection.barycentric = Vec3(1.0f - coord_sum, tri_coord.x, tri_coord.y);
+  intersection.distance = distance(local_intersection, ray.origin);
+  return intersection;
+}
+
+
+struct Result {
+  double nanoseconds_per_test;
+  size_t hit_count;
+  float distance_sum;
+};
+
+
+// Tests every ray against every triangle, p_test returns the hit of a ray with the triangle of the given index
+template<typename F>
+Result run(const std::vector<Ray> &p_rays, const size_t p_triangle_count, F &&p_test) {
+  Result result{0.0, 0, 0.0f};
+
+  Profiler profiler;
+  profiler.start();
+  for (const Ray &ray : p_rays) {
+    for (size_t i = 0; i < p_triangle_count; i++) {
+      const std::optional<RayTriangleIntersection> intersection = p_test(ray, i);
+      if (intersection.has_value()) {
+        result.hit_count += 1;
+        result.distance_sum += intersection.value().distance;
+      }
+    }
+  }
+  profiler.end();
+
+  result.nanoseconds_per_test = static_cast<double>(profiler.get_exec_time_nanoseconds()) / (p_rays.size() * p_triangle_count);
+  return result;
+}
+
+
+int main(int argc, char **argv) {
+  const size_t triangle_count = (argc > 1)? std::atoll(argv[1]) : 4096;
+  const size_t ray_count = (argc > 2)? std::atoll(argv[2]) : 2048;
+
+  std::mt19937 rng(47);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::uniform_int_distribution<uint32_t> vertex(0, 3 * triangle_count - 1);
+
+  // Indexed triangles sharing a vertex pool, as in meshes
+  std::vector<Vec3> positions(3 * triangle_count);
+  for (Vec3 &position : positions) {
+    position = Vec3(unit(rng), unit(rng), unit(rng));
+  }
+  std::vector<Vec3i> triangles(triangle_count);
+  for (Vec3i &triangle : triangles) {
+    triangle = Vec3i(vertex(rng), vertex(rng), vertex(rng));
+  }
+
+  std::vector<PrecomputedTriangle> precomputed_triangles;
+  precomputed_triangles.reserve(triangle_count);
+  for (const Vec3i &triangle : triangles) {
+    precomputed_triangles.push_back(PrecomputedTriangle(positions[triangle.x], positions[triangle.y], positions[triangle.z]));
+  }
+
+  std::vector<Ray> rays;
+  rays.reserve(ray_count);
+  for (size_t i = 0; i < ray_count; i++) {
+    const Vec3 origin = 4.0f * normalized(Vec3(unit(rng), unit(rng), unit(rng)));
+    const Vec3 target = 0.5f * Vec3(unit(rng), unit(rng), unit(rng));
+    rays.push_back(Ray(origin, target - origin));
+  }
+
+  auto gather = [&](const size_t p_index) -> Triangle {
+    const Vec3i triangle = triangles[p_index];
+    return Triangle{{positions[triangle.x], positions[triangle.y], positions[triangle.z]}};
+  };
+
+  const std::pair<const char*, Result> results[] = {
+    {"plane meet, indexed", run(rays, triangle_count, [&](const Ray &p_ray, const size_t p_index) {
+      return get_intersection_through_plane(p_ray, gather(p_index));
+    })},
+    {"moller-trumbore, indexed", run(rays, triangle_count, [&](const Ray &p_ray, const size_t p_index) {
+      return get_intersection(p_ray, gather(p_index));
+    })},
+    {"moller-trumbore, precomputed", run(rays, triangle_count, [&](const Ray &p_ray, const size_t p_index) {
+      return get_intersection(p_ray, precomputed_triangles[p_index]);
+    })},
+  };
+
+  std::cout << triangle_count << " triangles, " << ray_count << " rays" << std::endl;
+  std::cout << std::left
+    << std::setw(32) << "kernel"
+    << std::setw(12) << "ns/test"
+    << std::setw(12) << "hits"
+    << "distance sum" << std::endl;
+  for (const auto &[name, result] : results) {
+    std::cout << std::left
+      << std::setw(32) << name
+      << std::setw(12) << std::setprecision(3) << result.nanoseconds_per_test
+      << std::setw(12) << result.hit_count
+      << result.distance_sum << std::endl;
+  }
+
+  // Closest hit of every ray among all the triangles, for each packet kernel
+  std::vector<TrianglePacket> packets((triangle_count + TRIANGLE_PACKET_WIDTH - 1) / TRIANGLE_PACKET_WIDTH);
+  for (size_t i = 0; i < triangle_count; i++) {
+    packets[i / TRIANGLE_PACKET_WIDTH].set(i % TRIANGLE_PACKET_WIDTH, precomputed_triangles[i]);
+  }
+
+  const std::pair<TrianglePacketKernel, const char*> kernels[] = {
+    {TrianglePacketKernel::SCALAR, "packets, scalar"},
+    {TrianglePacketKernel::SSE, "packets, sse"},
+    {TrianglePacketKernel::AVX2, "packets, avx2"},
+  };
+  const TrianglePacketKernel default_kernel = get_triangle_packet_kernel();
+  std::vector<TriangleHit> reference_hits;
+
+  std::cout << std::endl << std::left
+    << std::setw(32) << "closest hit"
+    << std::setw(12) << "ns/test"
+    << "identical to scalar" << std::endl;
+  for (const auto &[kernel, name] : kernels) {
+    if (!is_triangle_packet_kernel_supported(kernel)) {
+      std::cout << std::setw(32) << name << "unsupported" << std::endl;
+      continue;
+    }
+    set_triangle_packet_kernel(kernel);
+
+    std::vector<TriangleHit> hits(rays.size());
+    Profiler profiler;
+    profiler.start();
+    for (size_t i = 0; i < rays.size(); i++) {
+      intersect_triangle_packets(rays[i], packets, hits[i]);
+    }
+    profiler.end();
+
+    bool identical = true;
+    if (reference_hits.empty()) {
+      reference_hits = hits;
+    } else {
+      for (size_t i = 0; i < rays.size(); i++) {
+        identical &= hits[i].triangle_index == reference_hits[i].triangle_index
+          && hits[i].distance == reference_hits[i].distance
+          && hits[i].barycentric.x == reference_hits[i].barycentric.x
+          && hits[i].barycentric.y == reference_hits[i].barycentric.y
+          && hits[i].barycentric.z == reference_hits[i].barycentric.z;
+      }
+    }
+
+    std::cout << std::left
+      << std::setw(32) << name
+      << std::setw(12) << std::setprecision(3) << static_cast<double>(profiler.get_exec_time_nanoseconds()) / (rays.size() * triangle_count)
+      << (identical? "yes" : "NO") << std::endl;
+  }
+  set_triangle_packet_kernel(default_kernel);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,319 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+// Preview drawing of the scene with the OpenGL Renderer. Only the windowed application links it, the headless renderer
+// does not depend on OpenGL.
+
+
+#include "scene.hpp"
+#include "geometry/acceleration_structures.hpp"
+#include "geometry/mesh.hpp"
+#include "thirdparty/kmath/color.hpp"
+#include "thirdparty/kmath/vector.hpp"
+#include "tp_utils/src/data_structures/aabb.hpp"
+#include "tp_utils/src/rendering/immediate_geometry.hpp"
+#include "utils/random.hpp"
+#include "utils/renderer.hpp"
+
+#include <stack>
+#include <tuple>
+
+
+using namespace kmath;
+using namespace tputils;
+
+
+static void draw_aabb(const AABB &p_aabb) {
+  Renderer *rd = Renderer::get_singleton();
+
+  tputils::ImmediateGeometry &imgeo = rd->immediate_geometry();
+
+  imgeo.begin(tputils::ImmediateGeometry::Mode::LINES, rd->get_default_buffer_layout());
+
+  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.begin.y, p_aabb.begin.z));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.begin.y, p_aabb.begin.z));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+
+  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.begin.y, p_aabb.begin.z));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.end.y  , p_aabb.begin.z));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+
+  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.begin.y, p_aabb.begin.z));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.begin.y, p_aabb.end.z  ));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  // =
+  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.end.y  , p_aabb.end.z  ));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.end.y  , p_aabb.end.z  ));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+
+  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.end.y  , p_aabb.end.z  ));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.begin.y, p_aabb.end.z  ));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+
+  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.end.y  , p_aabb.end.z  ));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.end.y  , p_aabb.begin.z));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  // =
+  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.begin.y, p_aabb.begin.z));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.end.y  , p_aabb.begin.z));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+
+  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.begin.y, p_aabb.begin.z));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.begin.y, p_aabb.end.z  ));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  // =
+  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.end.y  , p_aabb.begin.z));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.end.y  , p_aabb.begin.z));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+
+  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.end.y  , p_aabb.begin.z));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.end.y  , p_aabb.end.z  ));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  // =
+  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.begin.y, p_aabb.end.z  ));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.begin.y, p_aabb.end.z  ));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+
+  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.begin.y, p_aabb.end.z  ));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.end.y  , p_aabb.end.z  ));
+  imgeo.push_vec3(Vec3::ZERO);
+  imgeo.push_vec2(Vec2::ZERO);
+  
+  imgeo.end();
+}
+
+
+void KDTree::draw() const {
+  Renderer *rd = Renderer::get_singleton();
+  tputils::ImmediateGeometry &imgeo = rd->immediate_geometry();
+  
+  std::stack<std::tuple<uint32_t, AABB>> to_explore;
+  to_explore.push({0, aabb});
+
+  // DEBUG: values to see only part of the tree :)
+  const size_t path = 0b110;
+  const size_t path_size = 0;
+  size_t path_index = 0;
+
+  while (!to_explore.empty()) {
+    const auto [node_index, parent_aabb] = to_explore.top();
+    to_explore.pop();
+    const Node &node = nodes[node_index];
+
+    if (node.is_leaf()) {
+      const Lrgb color = Lrgb(
+        0.5f + 0.5f * spatial_random(parent_aabb.begin.x + parent_aabb.end.y),
+        0.5f + 0.5f * spatial_random(parent_aabb.begin.y + parent_aabb.end.z),
+        0.5f + 0.5f * spatial_random(parent_aabb.begin.z + parent_aabb.end.x)
+      );
+      rd->set_color(color);
+
+      imgeo.begin(ImmediateGeometry::Mode::POINTS, rd->get_default_buffer_layout());
+      for (uint32_t i = 0; i < node.get_triangle_count(); i++) {
+        const Vec3i tri = triangle_elements[triangle_indices[node.triangles_offset + i]];
+        const Vec3 pos = 0.3333f * (
+          vertex_positions[tri.x] + vertex_positions[tri.y] + vertex_positions[tri.z]
+        );
+        imgeo.push_vec3(pos);
+        imgeo.push_vec3(Vec3::ZERO);
+        imgeo.push_vec2(Vec2::ZERO);
+      }
+      imgeo.end();
+
+      draw_aabb(parent_aabb);
+    } else {
+      const auto [le_aabb, ge_aabb] = _cut_aabb(parent_aabb, node.split, node.get_axis());
+      const uint32_t le_index = node.get_children_index() + 0;
+      const uint32_t ge_index = node.get_children_index() + 1;
+
+      if (path_index < path_size) {
+        const size_t next = (path >> path_index) & 1;
+        path_index += 1;
+        if (next) {
+          to_explore.push({ge_index, ge_aabb});
+        } else {
+          to_explore.push({le_index, le_aabb});
+        }
+        continue;
+      }
+      to_explore.push({le_index, le_aabb});
+      to_explore.push({ge_index, ge_aabb});
+    }
+  }
+}
+
+
+void BVH::draw() const {
+  Renderer *rd = Renderer::get_singleton();
+  tputils::ImmediateGeometry &imgeo = rd->immediate_geometry();
+
+  for (const BVHNode &node : nodes) {
+    if (!node.is_leaf()) continue;
+
+    const Lrgb color = Lrgb(
+      0.5f + 0.5f * spatial_random(node.aabb.begin.x + node.aabb.end.y),
+      0.5f + 0.5f * spatial_random(node.aabb.begin.y + node.aabb.end.z),
+      0.5f + 0.5f * spatial_random(node.aabb.begin.z + node.aabb.end.x)
+    );
+    rd->set_color(color);
+
+    imgeo.begin(ImmediateGeometry::Mode::POINTS, rd->get_default_buffer_layout());
+    for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+      const Vec3i tri = triangle_elements[triangle_indices[i]];
+      const Vec3 pos = 0.3333f * (
+        vertex_positions[tri.x] + vertex_positions[tri.y] + vertex_positions[tri.z]
+      );
+      imgeo.push_vec3(pos);
+      imgeo.push_vec3(Vec3::ZERO);
+      imgeo.push_vec2(Vec2::ZERO);
+    }
+    imgeo.end();
+
+    draw_aabb(node.aabb);
+  }
+}
+
+
+void Mesh::draw() const {
+  if( triangle_elements.size() == 0 ) return;
+  // GLfloat material_color[4] = {material.diffuse_material.x,
+  //                              material.diffuse_material.y,
+  //                              material.diffuse_material.z,
+  //                              1.0};
+  // GLfloat material_specular[4] = {material.specular_material.x,
+  //                                 material.specular_material.y,
+  //                                 material.specular_material.z,
+  //                                 1.0};
+  // GLfloat material_ambient[4] = {material.diffuse_material.x,
+  //                                material.diffuse_material.y,
+  //                                material.diffuse_material.z,
+  //                                1.0};
+
+  // glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, material_specular);
+  // glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, material_color);
+  // glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, material_ambient);
+  // glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, material.shininess);
+  // glEnableClientState(GL_VERTEX_ARRAY) ;
+  // glEnableClientState (GL_NORMAL_ARRAY);
+  // glNormalPointer(GL_FLOAT, 3 * sizeof(float), (GLvoid*)(normals_array.data()));
+  // glVertexPointer(3, GL_FLOAT, 3 * sizeof(float) , (GLvoid*)(positions_array.data()));
+  // glDrawElements(GL_TRIANGLES, triangles_array.size(), GL_UNSIGNED_INT, (GLvoid*)(triangles_array.data()));
+
+  Renderer *rd = Renderer::get_singleton();
+  rd->set_model_matrix(kmath::Mat4::IDENTITY);
+  rd->set_color(material.albedo);
+  
+  tputils::ImmediateGeometry &imgeo = rd->immediate_geometry();
+
+  imgeo.begin(tputils::ImmediateGeometry::Mode::TRIANGLES, rd->get_default_buffer_layout());
+  for (const uint32_t &index : triangle_elements) {
+    const kmath::Vec3 position{
+      vertex_positions[3 * index + 0],
+      vertex_positions[3 * index + 1],
+      vertex_positions[3 * index + 2],
+    };
+    imgeo.push_vec3(position);
+    const kmath::Vec3 normal{
+      vertex_normals[3 * index + 0],
+      vertex_normals[3 * index + 1],
+      vertex_normals[3 * index + 2],
+    };
+    imgeo.push_vec3(normal);
+    const kmath::Vec2 uv{
+      vertex_uvs[2 * index + 0],
+      vertex_uvs[2 * index + 1],
+    };
+    imgeo.push_vec2(uv);
+  }
+  imgeo.end();
+
+  if (acceleration_structure.has_value()) {
+    std::visit([](const auto &p_structure) -> void { p_structure.draw(); }, acceleration_structure.value());
+  }
+}
+
+
+void Scene::draw() const {
+  for(size_t i = 0 ; i < meshes.size() ; ++i) {
+    const Mesh &mesh = meshes[i];
+    mesh.draw();
+  }
+  for(size_t i = 0 ; i < spheres.size() ; ++i) {
+    const Sphere &sphere = spheres[i];
+    Renderer::get_singleton()->draw_sphere(sphere);
+  }
+  for(size_t i = 0 ; i < squares.size() ; ++i) {
+    const Square &square = squares[i];
+    Renderer::get_singleton()->draw_rect(square);
+  }
+}
@@ -39,149 +39,444 @@
 
 
 #include <algorithm>
+#include <array>
 #include <cfloat>
+#include <cmath>
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <ostream>
 #include <span>
-#include <stack>
 #include <tuple>
 #include <utility>
-#include <variant>
 #include <vector>
 
 #include "geometry/ray.hpp"
 #include "geometry/triangle.hpp"
+#include "geometry/triangle_packet.hpp"
 #include "thirdparty/kmath/color.hpp"
 #include "thirdparty/kmath/vector.hpp"
+#include "tp_utils/src/data_structures/stack_vector.hpp"
 #include "tp_utils/src/debug.hpp"
-#include "tp_utils/src/rendering/immediate_geometry.hpp"
 #include "utils/random.hpp"
-#include "utils/renderer.hpp"
+#include "utils/thread_pool.hpp"
 
 
 using namespace kmath;
 using namespace tputils;
 
 
-void draw_aabb(const AABB &p_aabb) {
-  Renderer *rd = Renderer::get_singleton();
-
-  tputils::ImmediateGeometry &imgeo = rd->immediate_geometry();
-
-  imgeo.begin(tputils::ImmediateGeometry::Mode::LINES, rd->get_default_buffer_layout());
-
-  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.begin.y, p_aabb.begin.z));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.begin.y, p_aabb.begin.z));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-
-  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.begin.y, p_aabb.begin.z));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.end.y  , p_aabb.begin.z));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-
-  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.begin.y, p_aabb.begin.z));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.begin.y, p_aabb.end.z  ));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  // =
-  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.end.y  , p_aabb.end.z  ));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.end.y  , p_aabb.end.z  ));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-
-  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.end.y  , p_aabb.end.z  ));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.begin.y, p_aabb.end.z  ));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-
-  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.end.y  , p_aabb.end.z  ));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.end.y  , p_aabb.begin.z));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  // =
-  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.begin.y, p_aabb.begin.z));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.end.y  , p_aabb.begin.z));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-
-  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.begin.y, p_aabb.begin.z));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.begin.y, p_aabb.end.z  ));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  // =
-  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.end.y  , p_aabb.begin.z));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.end.y  , p_aabb.begin.z));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-
-  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.end.y  , p_aabb.begin.z));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.end.y  , p_aabb.end.z  ));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  // =
-  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.begin.y, p_aabb.end.z  ));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  imgeo.push_vec3(Vec3(p_aabb.end.x  , p_aabb.begin.y, p_aabb.end.z  ));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-
-  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.begin.y, p_aabb.end.z  ));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  imgeo.push_vec3(Vec3(p_aabb.begin.x, p_aabb.end.y  , p_aabb.end.z  ));
-  imgeo.push_vec3(Vec3::ZERO);
-  imgeo.push_vec2(Vec2::ZERO);
-  
-  imgeo.end();
+RayMeshIntersection fetch_shading_data(const TriangleHit &p_hit, std::span<const Vec3i> p_triangles, std::span<const Vec3> p_positions, std::span<const Vec3> p_normals, std::span<const Vec2> p_uvs) {
+  RayMeshIntersection intersection;
+  intersection.distance = FLT_MAX;
+  intersection.exists = false;
+
+  if (!p_hit.exists()) {
+    return intersection;
+  }
+
+  const Vec3i element = p_triangles[p_hit.triangle_index];
+  const Vec3 &bary = p_hit.barycentric;
+
+  intersection.position = (
+    bary.x * p_positions[element.x]
+    + bary.y * p_positions[element.y]
+    + bary.z * p_positions[element.z]
+  );
+  intersection.distance = p_hit.distance;
+  intersection.normal = normalized(
+    bary.x * p_normals[element.x]
+    + bary.y * p_normals[element.y]
+    + bary.z * p_normals[element.z]
+  );
+  intersection.uv = (
+    bary.x * p_uvs[element.x]
+    + bary.y * p_uvs[element.y]
+    + bary.z * p_uvs[element.z]
+  );
+  intersection.barycentric = bary;
+  intersection.exists = true;
+  return intersection;
+}
+
+
+static float get_surface_area(const AABB &p_aabb) {
+  const Vec3 extent = p_aabb.end - p_aabb.begin;
+  return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
 }
 
 
-std::pair<AABB, AABB> KDTree::_cut_aabb(const AABB &p_parent, const float p_value, const Node::Subdivision::Axis p_axis) {
+// Triangles in the order they are referenced by the leaves, in the form used by the intersection kernel
+static std::vector<PrecomputedTriangle> get_leaf_triangles(std::span<const uint32_t> p_triangle_indices, std::span<const Vec3i> p_triangles, std::span<const Vec3> p_positions) {
+  std::vector<PrecomputedTriangle> leaf_triangles;
+  leaf_triangles.reserve(p_triangle_indices.size());
+  for (const uint32_t triangle_index : p_triangle_indices) {
+    const Vec3i element = p_triangles[triangle_index];
+    leaf_triangles.push_back(PrecomputedTriangle(p_positions[element.x], p_positions[element.y], p_positions[element.z]));
+  }
+  return leaf_triangles;
+}
+
+
+// Groups the triangles referenced by the leaves into packets, p_triangle_indices is padded to a multiple of the packet
+// width, with UINT32_MAX for the unused lanes.
+static std::vector<TrianglePacket> get_leaf_packets(std::span<const uint32_t> p_triangle_indices, std::span<const Vec3i> p_triangles, std::span<const Vec3> p_positions) {
+  std::vector<TrianglePacket> leaf_packets(p_triangle_indices.size() / TRIANGLE_PACKET_WIDTH);
+  parallel_for(0, leaf_packets.size(), [&](const size_t, const size_t p_packet_index) {
+    for (size_t lane = 0; lane < TRIANGLE_PACKET_WIDTH; lane++) {
+      const uint32_t triangle_index = p_triangle_indices[p_packet_index * TRIANGLE_PACKET_WIDTH + lane];
+      if (triangle_index == UINT32_MAX) continue;
+      const Vec3i element = p_triangles[triangle_index];
+      leaf_packets[p_packet_index].set(lane, PrecomputedTriangle(p_positions[element.x], p_positions[element.y], p_positions[element.z]));
+    }
+  });
+  return leaf_packets;
+}
+
+
+static AABB get_triangle_aabb(const Vec3i &p_triangle, std::span<const Vec3> p_positions) {
+  const Vec3 &a = p_positions[p_triangle.x];
+  const Vec3 &b = p_positions[p_triangle.y];
+  const Vec3 &c = p_positions[p_triangle.z];
+  return AABB(kmath::min(a, kmath::min(b, c)), kmath::max(a, kmath::max(b, c)));
+}
+
+
+std::pair<AABB, AABB> KDTree::_cut_aabb(const AABB &p_parent, const float p_value, const Axis p_axis) {
   switch (p_axis) {
-  case Node::Subdivision::Axis::X:
+  case Axis::X:
     return {
       AABB(p_parent.begin, Vec3(p_value, p_parent.end.y, p_parent.end.z)),
       AABB(Vec3(p_value, p_parent.begin.y, p_parent.begin.z), p_parent.end),
     };
-  case Node::Subdivision::Axis::Y:
+  case Axis::Y:
     return {
       AABB(p_parent.begin, Vec3(p_parent.end.x, p_value, p_parent.end.z)),
       AABB(Vec3(p_parent.begin.x, p_value, p_parent.begin.z), p_parent.end),
     };
-  case Node::Subdivision::Axis::Z:
+  case Axis::Z:
     return {
       AABB(p_parent.begin, Vec3(p_parent.end.x, p_parent.end.y, p_value)),
       AABB(Vec3(p_parent.begin.x, p_parent.begin.y, p_value), p_parent.end),
     };
-  case Node::Subdivision::Axis::AXIS_MAX:
+  case Axis::AXIS_MAX:
     break;
   }
   return {};
 }
 
 
+// Builds the KDTree with the sweep of "On building fast kd-Trees for Ray Tracing, and on doing that in O(N log N)",
+// Wald & Havran. The bounds of the triangles are sorted once along each axis, splitting a node then distributes its
+// sorted events to its children without sorting them again.
+// The top of the tree is split one level at a time, splitting the nodes of a level in parallel. Once there are enough
+// nodes, their subtrees are built in parallel, each into its own arrays which are then concatenated.
+class KDTree::Builder {
+public:
+  enum class EventType : uint32_t {
+    END = 0, PLANAR = 1, START = 2,
+  };
+
+  // Bound of a triangle along an axis, clipped to the node. The type is in the upper bits of `key`.
+  struct Event {
+    float position;
+    uint32_t key;
+
+  public:
+    inline EventType get_type() const { return static_cast<EventType>(key >> TYPE_SHIFT); }
+    inline uint32_t get_triangle() const { return key & TRIANGLE_MASK; }
+
+    // At the same position, the triangles ending are counted before those lying in the plane and those starting
+    inline bool operator<(const Event &p_other) const {
+      return position < p_other.position || (position == p_other.position && (key >> TYPE_SHIFT) < (p_other.key >> TYPE_SHIFT));
+    }
+
+    static inline Event make(const float p_position, const EventType p_type, const uint32_t p_triangle) {
+      return Event{p_position, (static_cast<uint32_t>(p_type) << TYPE_SHIFT) | p_triangle};
+    }
+  };
+  constexpr static uint32_t TYPE_SHIFT = 30;
+  constexpr static uint32_t TRIANGLE_MASK = (1u << TYPE_SHIFT) - 1;
+
+  // Sorted events of the triangles of a node, along each axis
+  typedef std::array<std::vector<Event>, 3> EventLists;
+
+  struct Split {
+    float cost = FLT_MAX;
+    float value = 0.0f;
+    Axis axis = Axis::AXIS_MAX; // AXIS_MAX when the node is a leaf
+    bool planar_left = false; // Side receiving the triangles lying in the split plane
+    uint32_t left_count = 0;
+    uint32_t right_count = 0;
+  };
+
+  enum class Side : uint8_t {
+    LEFT, RIGHT, BOTH,
+  };
+
+  // Scratch memory of a thread, reused for every node it splits
+  struct ThreadArena {
+    std::unique_ptr<Side[]> sides; // Side of the split of the triangles of the node, indexed by triangle
+    std::vector<EventLists> left_events; // Events of the children, per depth
+    std::vector<EventLists> right_events;
+    std::vector<Event> straddling_events;
+    std::vector<uint32_t> leaf_triangles;
+  };
+
+  // Nodes and leaf triangle references of a part of the tree, whose root is the first node
+  struct Subtree {
+    std::vector<Node> nodes;
+    std::vector<uint32_t> triangle_indices;
+  };
+
+public:
+  EventLists get_root_events(const AABB &p_root_aabb) const;
+
+  // Returns a split with the AXIS_MAX axis when the node should be a leaf
+  Split find_split(const EventLists &p_events, const uint32_t p_triangle_count, const AABB &p_node_aabb, const size_t p_depth) const;
+  void split_events(ThreadArena &r_arena, const EventLists &p_events, const Split &p_split, EventLists &r_left, EventLists &r_right) const;
+
+  void make_leaf(ThreadArena &r_arena, const EventLists &p_events, Subtree &r_subtree, const uint32_t p_node_index) const;
+  void build_subtree(ThreadArena &r_arena, const EventLists &p_events, const uint32_t p_triangle_count, const AABB &p_node_aabb, const size_t p_depth, Subtree &r_subtree, const uint32_t p_node_index) const;
+
+  ThreadArena create_arena() const;
+
+  Builder(std::span<const AABB> p_triangles_aabb, const size_t p_max_depth): triangles_aabb(p_triangles_aabb), max_depth(p_max_depth) {}
+
+private:
+  // Extent of the triangle's bounds along the axis, restricted to the node.
+  inline std::pair<float, float> _get_clipped_extent(const uint32_t p_tri_index, const AABB &p_node_aabb, const Axis p_axis) const {
+    const AABB &tri_aabb = triangles_aabb[p_tri_index];
+    return {
+      std::max(_get_component(tri_aabb.begin, p_axis), _get_component(p_node_aabb.begin, p_axis)),
+      std::min(_get_component(tri_aabb.end, p_axis), _get_component(p_node_aabb.end, p_axis)),
+    };
+  }
+
+  static inline float _get_sah_cost(const float p_left_probability, const float p_right_probability, const size_t p_left_count, const size_t p_right_count) {
+    const float bonus = (p_left_count == 0 || p_right_count == 0)? EMPTY_SPACE_BONUS : 1.0f;
+    return bonus * (
+      TRAVERSAL_COST
+      + p_left_probability * _get_leaf_cost(p_left_count) + p_right_probability * _get_leaf_cost(p_right_count)
+    );
+  }
+
+private:
+  std::span<const AABB> triangles_aabb;
+  size_t max_depth;
+};
+
+
+KDTree::Builder::EventLists KDTree::Builder::get_root_events(const AABB &p_root_aabb) const {
+  EventLists events;
+
+  parallel_for(0, 3, [&](const size_t, const size_t p_axis_index) {
+    const Axis axis = static_cast<Axis>(p_axis_index);
+    std::vector<Event> &axis_events = events[p_axis_index];
+    axis_events.reserve(2 * triangles_aabb.size());
+
+    for (uint32_t tri_index = 0; tri_index < triangles_aabb.size(); tri_index++) {
+      const auto [tri_begin, tri_end] = _get_clipped_extent(tri_index, p_root_aabb, axis);
+      if (tri_begin == tri_end) {
+        axis_events.push_back(Event::make(tri_begin, EventType::PLANAR, tri_index));
+      } else {
+        axis_events.push_back(Event::make(tri_begin, EventType::START, tri_index));
+        axis_events.push_back(Event::make(tri_end, EventType::END, tri_index));
+      }
+    }
+    std::sort(axis_events.begin(), axis_events.end());
+  }, 1);
+
+  return events;
+}
+
+
+KDTree::Builder::Split KDTree::Builder::find_split(const EventLists &p_events, const uint32_t p_triangle_count, const AABB &p_node_aabb, const size_t p_depth) const {
+  Split best;
+  if (p_depth >= max_depth || p_triangle_count <= 1) {
+    return best;
+  }
+
+  const float inv_node_area = 1.0f / get_surface_area(p_node_aabb);
+
+  // Sweep over the sorted events of each axis, keeping count of the triangles on each side of the plane
+  for (int axis_index = 0; axis_index < static_cast<int>(Axis::AXIS_MAX); axis_index++) {
+    const Axis axis = static_cast<Axis>(axis_index);
+    const float axis_begin = _get_component(p_node_aabb.begin, axis);
+    const float axis_end = _get_component(p_node_aabb.end, axis);
+    if (axis_end <= axis_begin) continue;
+
+    const std::vector<Event> &events = p_events[axis_index];
+    uint32_t left_count = 0;
+    uint32_t right_count = p_triangle_count;
+
+    for (size_t i = 0; i < events.size();) {
+      const float position = events[i].position;
+      uint32_t ending_count = 0, planar_count = 0, starting_count = 0;
+
+      while (i < events.size() && events[i].position == position && events[i].get_type() == EventType::END) {
+        ending_count++; i++;
+      }
+      while (i < events.size() && events[i].position == position && events[i].get_type() == EventType::PLANAR) {
+        planar_count++; i++;
+      }
+      while (i < events.size() && events[i].position == position && events[i].get_type() == EventType::START) {
+        starting_count++; i++;
+      }
+
+      right_count -= planar_count + ending_count;
+
+      // Splitting on the node's boundary only creates an empty node of null volume
+      if (axis_begin < position && position < axis_end) {
+        const auto [le_aabb, ge_aabb] = _cut_aabb(p_node_aabb, position, axis);
+        const float left_probability = get_surface_area(le_aabb) * inv_node_area;
+        const float right_probability = get_surface_area(ge_aabb) * inv_node_area;
+
+        const float planar_left_cost = _get_sah_cost(left_probability, right_probability, left_count + planar_count, right_count);
+        const float planar_right_cost = _get_sah_cost(left_probability, right_probability, left_count, right_count + planar_count);
+
+        if (planar_left_cost < best.cost) {
+          best = Split{planar_left_cost, position, axis, true, left_count + planar_count, right_count};
+        }
+        if (planar_right_cost < best.cost) {
+          best = Split{planar_right_cost, position, axis, false, left_count, right_count + planar_count};
+        }
+      }
+
+      left_count += starting_count + planar_count;
+    }
+  }
+
+  // Only subdivide when it is expected to be cheaper than intersecting every triangle of the node
+  if (best.cost >= _get_leaf_cost(p_triangle_count)) {
+    best.axis = Axis::AXIS_MAX;
+  }
+  return best;
+}
+
+
+void KDTree::Builder::split_events(ThreadArena &r_arena, const EventLists &p_events, const Split &p_split, EventLists &r_left, EventLists &r_right) const {
+  const uint32_t split_axis_index = static_cast<uint32_t>(p_split.axis);
+  Side *sides = r_arena.sides.get();
+
+  // Classify the triangles from their bounds along the split axis, the start of a triangle comes before its end
+  for (const Event &event : p_events[split_axis_index]) {
+    const uint32_t tri_index = event.get_triangle();
+    switch (event.get_type()) {
+    case EventType::START:
+      sides[tri_index] = (event.position >= p_split.value)? Side::RIGHT : Side::BOTH;
+      break;
+    case EventType::END:
+      if (event.position <= p_split.value) {
+        sides[tri_index] = Side::LEFT;
+      }
+      break;
+    case EventType::PLANAR:
+      if (event.position == p_split.value) {
+        sides[tri_index] = (p_split.planar_left)? Side::LEFT : Side::RIGHT;
+      } else {
+        sides[tri_index] = (event.position < p_split.value)? Side::LEFT : Side::RIGHT;
+      }
+      break;
+    }
+  }
+
+  for (uint32_t axis_index = 0; axis_index < 3; axis_index++) {
+    std::vector<Event> &left = r_left[axis_index];
+    std::vector<Event> &right = r_right[axis_index];
+    left.clear();
+    right.clear();
+
+    if (axis_index != split_axis_index) {
+      // The bounds of the triangles along the other axes are the same in the children, they stay sorted
+      for (const Event &event : p_events[axis_index]) {
+        const Side side = sides[event.get_triangle()];
+        if (side != Side::RIGHT) left.push_back(event);
+        if (side != Side::LEFT) right.push_back(event);
+      }
+      continue;
+    }
+
+    // Triangles crossing the plane are clipped by it: they end on the plane in the left child and start on it in the
+    // right one. Those events are merged back in the sorted events.
+    std::vector<Event> &straddling = r_arena.straddling_events;
+    straddling.clear();
+    for (const Event &event : p_events[axis_index]) {
+      const uint32_t tri_index = event.get_triangle();
+      const Side side = sides[tri_index];
+      if (side == Side::LEFT || (side == Side::BOTH && event.get_type() == EventType::START)) {
+        left.push_back(event);
+      }
+      if (side == Side::RIGHT || (side == Side::BOTH && event.get_type() == EventType::END)) {
+        right.push_back(event);
+      }
+      if (side == Side::BOTH && event.get_type() == EventType::START) {
+        straddling.push_back(Event::make(p_split.value, EventType::END, tri_index));
+      }
+    }
+    left.insert(std::upper_bound(left.begin(), left.end(), Event::make(p_split.value, EventType::END, 0)), straddling.begin(), straddling.end());
+
+    for (Event &event : straddling) {
+      event = Event::make(p_split.value, EventType::START, event.get_triangle());
+    }
+    right.insert(std::upper_bound(right.begin(), right.end(), Event::make(p_split.value, EventType::PLANAR, 0)), straddling.begin(), straddling.end());
+  }
+}
+
+
+void KDTree::Builder::make_leaf(ThreadArena &r_arena, const EventLists &p_events, Subtree &r_subtree, const uint32_t p_node_index) const {
+  // Every triangle of the node has a single start or planar event along an axis
+  std::vector<uint32_t> &leaf_triangles = r_arena.leaf_triangles;
+  leaf_triangles.clear();
+  for (const Event &event : p_events[0]) {
+    if (event.get_type() != EventType::END) {
+      leaf_triangles.push_back(event.get_triangle());
+    }
+  }
+  std::sort(leaf_triangles.begin(), leaf_triangles.end());
+
+  std::vector<uint32_t> &triangle_indices = r_subtree.triangle_indices;
+  r_subtree.nodes[p_node_index] = Node::leaf(triangle_indices.size(), leaf_triangles.size());
+  triangle_indices.insert(triangle_indices.end(), leaf_triangles.begin(), leaf_triangles.end());
+  // Leaves start on a packet boundary, the padding references no triangle
+  const size_t packet_count = (leaf_triangles.size() + TRIANGLE_PACKET_WIDTH - 1) / TRIANGLE_PACKET_WIDTH;
+  triangle_indices.resize(triangle_indices.size() - leaf_triangles.size() + packet_count * TRIANGLE_PACKET_WIDTH, UINT32_MAX);
+}
+
+
+void KDTree::Builder::build_subtree(ThreadArena &r_arena, const EventLists &p_events, const uint32_t p_triangle_count, const AABB &p_node_aabb, const size_t p_depth, Subtree &r_subtree, const uint32_t p_node_index) const {
+  const Split split = find_split(p_events, p_triangle_count, p_node_aabb, p_depth);
+  if (split.axis == Axis::AXIS_MAX) {
+    make_leaf(r_arena, p_events, r_subtree, p_node_index);
+    return;
+  }
+
+  // The events of the children live in the arena until their subtree is built
+  EventLists &left_events = r_arena.left_events[p_depth];
+  EventLists &right_events = r_arena.right_events[p_depth];
+  split_events(r_arena, p_events, split, left_events, right_events);
+
+  // Both children are allocated together so that they are next to each other
+  const uint32_t children_index = r_subtree.nodes.size();
+  r_subtree.nodes.resize(r_subtree.nodes.size() + 2);
+  r_subtree.nodes[p_node_index] = Node::subdivision(split.axis, split.value, children_index);
+
+  const auto [le_aabb, ge_aabb] = _cut_aabb(p_node_aabb, split.value, split.axis);
+  build_subtree(r_arena, left_events, split.left_count, le_aabb, p_depth + 1, r_subtree, children_index + 0);
+  build_subtree(r_arena, right_events, split.right_count, ge_aabb, p_depth + 1, r_subtree, children_index + 1);
+}
+
+
+KDTree::Builder::ThreadArena KDTree::Builder::create_arena() const {
+  ThreadArena arena;
+  // Left uninitialized, only the entries of the triangles of a node are read after being written
+  arena.sides = std::unique_ptr<Side[]>(new Side[triangles_aabb.size()]);
+  arena.left_events.resize(max_depth + 1);
+  arena.right_events.resize(max_depth + 1);
+  return arena;
+}
+
+
 KDTree KDTree::build_kdtree(std::span<const Vec3i> p_triangles, std::span<const Vec3> p_positions, std::span<const kmath::Vec3> p_normals, std::span<const kmath::Vec2> p_uvs) {
   const Vec3 EPSILON = 0.001f * Vec3::ONE;
 
@@ -210,297 +505,850 @@ KDTree KDTree::build_kdtree(std::span<const Vec3i> p_triangles, std::span<const
     tree.aabb = AABB(minimum - EPSILON, maximum + EPSILON);
   }
 
-  std::vector<Vec3> tri_positions(p_triangles.size());
-  { // Get an idea of triangle positions
-    constexpr float THIRD = 1.0f / 3.0f;
+  ThreadPool *pool = ThreadPool::get_singleton();
 
-    for (size_t i = 0; i < p_triangles.size(); i++) {
-      const Vec3i &tri = p_triangles[i];
-      tri_positions[i] = (p_positions[tri.x] + p_positions[tri.y] + p_positions[tri.z]) * THIRD;
+  std::vector<AABB> triangles_aabb(p_triangles.size());
+  parallel_for(0, p_triangles.size(), [&](const size_t, const size_t p_tri_index) {
+    triangles_aabb[p_tri_index] = get_triangle_aabb(p_triangles[p_tri_index], p_positions);
+  });
+
+  // Past this depth, splitting mostly duplicates triangles (see PBRT, 4.5)
+  const size_t max_depth = 8 + static_cast<size_t>(1.3f * std::log2(static_cast<float>(std::max<size_t>(p_triangles.size(), 1))));
+
+  const Builder builder(triangles_aabb, max_depth);
+  std::vector<Builder::ThreadArena> arenas(pool->get_thread_count());
+  for (Builder::ThreadArena &arena : arenas) {
+    arena = builder.create_arena();
+  }
+
+  // Nodes whose subtree is not built yet
+  struct PendingNode {
+    Builder::EventLists events;
+    uint32_t triangle_count;
+    AABB aabb;
+    size_t depth;
+    uint32_t node_index;
+  };
+
+  Builder::Subtree top;
+  top.nodes.resize(1);
+  std::vector<PendingNode> pending_nodes;
+  pending_nodes.push_back(PendingNode{builder.get_root_events(tree.aabb), static_cast<uint32_t>(p_triangles.size()), tree.aabb, 0, 0});
+
+  // Split the top of the tree one level at a time until there are enough subtrees to keep every thread busy
+  const size_t subtree_count = SUBTREES_PER_THREAD * pool->get_thread_count();
+  while (!pending_nodes.empty() && pending_nodes.size() < subtree_count) {
+    std::vector<Builder::Split> splits(pending_nodes.size());
+    std::vector<Builder::EventLists> children_events(2 * pending_nodes.size());
+
+    parallel_for(0, pending_nodes.size(), [&](const size_t p_thread_id, const size_t p_index) {
+      PendingNode &node = pending_nodes[p_index];
+      splits[p_index] = builder.find_split(node.events, node.triangle_count, node.aabb, node.depth);
+      if (splits[p_index].axis != Axis::AXIS_MAX) {
+        builder.split_events(arenas[p_thread_id], node.events, splits[p_index], children_events[2 * p_index + 0], children_events[2 * p_index + 1]);
+        node.events = Builder::EventLists();
+      }
+    }, 1);
+
+    std::vector<PendingNode> children;
+    for (size_t i = 0; i < pending_nodes.size(); i++) {
+      const PendingNode &node = pending_nodes[i];
+      const Builder::Split &split = splits[i];
+      if (split.axis == Axis::AXIS_MAX) {
+        builder.make_leaf(arenas[0], node.events, top, node.node_index);
+        continue;
+      }
+
+      const uint32_t children_index = top.nodes.size();
+      top.nodes.resize(top.nodes.size() + 2);
+      top.nodes[node.node_index] = Node::subdivision(split.axis, split.value, children_index);
+
+      const auto [le_aabb, ge_aabb] = _cut_aabb(node.aabb, split.value, split.axis);
+      children.push_back(PendingNode{std::move(children_events[2 * i + 0]), split.left_count, le_aabb, node.depth + 1, children_index + 0});
+      children.push_back(PendingNode{std::move(children_events[2 * i + 1]), split.right_count, ge_aabb, node.depth + 1, children_index + 1});
     }
+    pending_nodes = std::move(children);
   }
 
-  std::vector<AABB> triangles_aabb(p_triangles.size());
-  { // Get AABBs for each triangles
-    for (size_t i = 0; i < p_triangles.size(); i++) {
-      AABB &aabb = triangles_aabb[i];
-      const Vec3i &tri = p_triangles[i];
+  // Build the remaining subtrees, each in its own arrays
+  std::vector<Builder::Subtree> subtrees(pending_nodes.size());
+  parallel_for(0, pending_nodes.size(), [&](const size_t p_thread_id, const size_t p_index) {
+    PendingNode &node = pending_nodes[p_index];
+    Builder::Subtree &subtree = subtrees[p_index];
+    subtree.nodes.resize(1);
+    builder.build_subtree(arenas[p_thread_id], node.events, node.triangle_count, node.aabb, node.depth, subtree, 0);
+    node.events = Builder::EventLists();
+  }, 1);
+  arenas.clear();
+
+  // Concatenate the subtrees after the top of the tree. Their roots replace the pending nodes, their other nodes and
+  // their triangle references are appended.
+  std::vector<size_t> node_offsets(subtrees.size());
+  std::vector<size_t> triangle_offsets(subtrees.size());
+  size_t node_count = top.nodes.size();
+  size_t triangle_count = top.triangle_indices.size();
+  for (size_t i = 0; i < subtrees.size(); i++) {
+    node_offsets[i] = node_count - 1;
+    triangle_offsets[i] = triangle_count;
+    node_count += subtrees[i].nodes.size() - 1;
+    triangle_count += subtrees[i].triangle_indices.size();
+  }
 
-      aabb.begin = p_positions[tri.x];
-      aabb.end = p_positions[tri.x];
+  std::vector<Node> nodes = std::move(top.nodes);
+  std::vector<uint32_t> triangle_indices = std::move(top.triangle_indices);
+  nodes.resize(node_count);
+  triangle_indices.resize(triangle_count);
 
-      aabb.begin = apply(aabb.begin, p_positions[tri.y], minf);
-      aabb.end = apply(aabb.end, p_positions[tri.y], maxf);
+  parallel_for(0, subtrees.size(), [&](const size_t, const size_t p_index) {
+    const Builder::Subtree &subtree = subtrees[p_index];
+    auto relocate = [&](const Node &p_node) -> Node {
+      if (p_node.is_leaf()) {
+        return Node::leaf(p_node.triangles_offset + triangle_offsets[p_index], p_node.get_triangle_count());
+      }
+      return Node::subdivision(p_node.get_axis(), p_node.split, p_node.get_children_index() + node_offsets[p_index]);
+    };
 
-      aabb.begin = apply(aabb.begin, p_positions[tri.z], minf);
-      aabb.end = apply(aabb.end, p_positions[tri.z], maxf);
+    nodes[pending_nodes[p_index].node_index] = relocate(subtree.nodes[0]);
+    for (size_t i = 1; i < subtree.nodes.size(); i++) {
+      nodes[node_offsets[p_index] + i] = relocate(subtree.nodes[i]);
     }
+    std::copy(subtree.triangle_indices.begin(), subtree.triangle_indices.end(), triangle_indices.begin() + triangle_offsets[p_index]);
+  }, 1);
+
+  tree.leaf_packets = get_leaf_packets(triangle_indices, p_triangles, p_positions);
+  tree.nodes = std::move(nodes);
+  tree.triangle_indices = std::move(triangle_indices);
+  tree._compute_statistics();
+
+  return tree;
+}
+
+
+void KDTree::_compute_statistics() {
+  statistics = Statistics{};
+
+  // Returns the SAH cost of the subtree, relative to the probability of entering its root
+  std::function<float(const uint32_t, const AABB&, const size_t)> visit =
+    [&](const uint32_t p_node_index, const AABB &p_node_aabb, const size_t p_depth) -> float {
+      const Node &node = nodes[p_node_index];
+      statistics.node_count += 1;
+      statistics.max_depth = std::max(statistics.max_depth, p_depth);
+
+      if (node.is_leaf()) {
+        const size_t triangle_count = node.get_triangle_count();
+        statistics.leaf_count += 1;
+        statistics.empty_leaf_count += (triangle_count == 0)? 1 : 0;
+        statistics.max_leaf_size = std::max(statistics.max_leaf_size, triangle_count);
+        statistics.triangle_references += triangle_count;
+        return _get_leaf_cost(triangle_count);
+      }
+
+      const auto [le_aabb, ge_aabb] = _cut_aabb(p_node_aabb, node.split, node.get_axis());
+      const float inv_node_area = 1.0f / get_surface_area(p_node_aabb);
+
+      return TRAVERSAL_COST
+        + get_surface_area(le_aabb) * inv_node_area * visit(node.get_children_index() + 0, le_aabb, p_depth + 1)
+        + get_surface_area(ge_aabb) * inv_node_area * visit(node.get_children_index() + 1, ge_aabb, p_depth + 1);
+    };
+
+  statistics.sah_cost = visit(0, aabb, 0);
+  if (!triangle_elements.empty()) {
+    statistics.duplication_factor = static_cast<float>(statistics.triangle_references) / triangle_elements.size();
+  }
+  statistics.memory_size = nodes.size() * sizeof(Node) + triangle_indices.size() * sizeof(uint32_t) + leaf_packets.size() * sizeof(TrianglePacket);
+}
+
+
+std::ostream &operator<<(std::ostream &p_stream, const AccelerationStructureStatistics &p_statistics) {
+  p_stream << "(sah_cost: " << p_statistics.sah_cost
+    << ", depth: " << p_statistics.max_depth
+    << ", nodes: " << p_statistics.node_count
+    << ", leaves: " << p_statistics.leaf_count
+    << " (" << p_statistics.empty_leaf_count << " empty, largest: " << p_statistics.max_leaf_size << ")"
+    << ", duplication: " << p_statistics.duplication_factor
+    << ", memory: " << p_statistics.memory_size << "B)";
+  return p_stream;
+}
+
+
+RayMeshIntersection KDTree::intersect(const Ray &p_ray) const {
+  TriangleHit closest_hit;
+  intersect(p_ray, closest_hit);
+  return fetch_shading_data(closest_hit, triangle_elements, vertex_positions, vertex_normals, vertex_uvs);
+}
+
+
+bool KDTree::intersect(const Ray &p_ray, TriangleHit &r_hit) const {
+  // We know that we don't need to traverse the kdtree, the ray goes outside
+  const Vec3 inv_direction = Vec3::ONE / p_ray.direction;
+  const auto [t_near, t_far] = get_aabb_intersection(p_ray.origin, inv_direction, aabb);
+  if (t_far < t_near || t_near >= r_hit.distance) {
+    return false;
   }
 
+  const uint32_t previous_index = r_hit.triangle_index;
+  const float previous_distance = r_hit.distance;
+  _intersect_subtree(p_ray, 0, t_near, std::min(t_far, r_hit.distance), r_hit);
+  return r_hit.triangle_index != previous_index || r_hit.distance != previous_distance;
+}
 
-  // Helper functions
-  auto sort_triangles = [&](std::span<size_t> p_triangle_indices, const Node::Subdivision::Axis p_division_axis) -> void {
-    switch (p_division_axis) {
-    break; case Node::Subdivision::Axis::X:
-      std::sort(
-        p_triangle_indices.begin(),
-        p_triangle_indices.end(),
-        [&](const size_t a, const size_t b) -> bool { return tri_positions[a].x < tri_positions[b].x;
+
+bool KDTree::_intersect_subtree(const Ray &p_ray, const uint32_t p_node_index, const float p_t_min, const float p_t_max, TriangleHit &r_hit) const {
+  // Structure traversal
+  struct ToExplore {
+    uint32_t node_index;
+    float t_min, t_max;
+  };
+  StackVector<ToExplore, MAX_TRAVERSAL_DEPTH> to_explore;
+  to_explore.push_back({p_node_index, p_t_min, p_t_max});
+
+  while (!to_explore.empty()) {
+    const auto [node_index, t_min, t_max] = to_explore.back();
+    to_explore.pop_back();
+    const Node &node = nodes[node_index];
+
+    if (node.is_leaf()) {
+      // Perform an intersection with every element of the leaf
+      TriangleHit leaf_hit = r_hit;
+      if (intersect_triangle_packets(p_ray, _get_leaf_packets(node), leaf_hit)) {
+        r_hit = leaf_hit;
+        r_hit.triangle_index = triangle_indices[node.triangles_offset + leaf_hit.triangle_index];
+      }
+
+      // Triangles overlapping several cells can be hit past this leaf, with a closer hit in a later leaf
+      if (r_hit.distance <= t_max) {
+        return true;
+      }
+    } else {
+      const Axis axis = node.get_axis();
+      const float ray_origin_comp = _get_component(p_ray.origin, axis);
+      const float ray_direction_comp = _get_component(p_ray.direction, axis);
+      const float t_hit = (node.split - ray_origin_comp) / ray_direction_comp;
+
+      const bool le_first = (ray_origin_comp < node.split)
+        || (ray_origin_comp == node.split && ray_direction_comp <= 0.0f);
+
+      const uint32_t first = node.get_children_index() + (le_first? 0 : 1);
+      const uint32_t second = node.get_children_index() + (le_first? 1 : 0);
+
+      if (t_max <= t_hit || t_hit < 0.0f) {
+        to_explore.push_back({first, t_min, t_max});
+      } else if (t_hit <= t_min) {
+        to_explore.push_back({second, t_min, t_max});
+      } else {
+        to_explore.push_back({second, t_hit, t_max});
+        to_explore.push_back({first, t_min, t_hit});
+      }
+    }
+  }
+
+  return false;
+}
+
+
+bool KDTree::occluded(const Ray &p_ray, const float p_max_distance) const {
+  const Vec3 inv_direction = Vec3::ONE / p_ray.direction;
+  const auto [t_near, t_far] = get_aabb_intersection(p_ray.origin, inv_direction, aabb);
+  if (t_far < t_near || t_far < 0.0f || t_near >= p_max_distance) {
+    return false;
+  }
+
+  // Structure traversal, the part of the ray beyond p_max_distance is never explored
+  struct ToExplore {
+    uint32_t node_index;
+    float t_min, t_max;
+  };
+  StackVector<ToExplore, MAX_TRAVERSAL_DEPTH> to_explore;
+  to_explore.push_back({0, t_near, std::min(t_far, p_max_distance)});
+
+  while (!to_explore.empty()) {
+    const auto [node_index, t_min, t_max] = to_explore.back();
+    to_explore.pop_back();
+    const Node &node = nodes[node_index];
+
+    if (node.is_leaf()) {
+      if (occluded_by_triangle_packets(p_ray, _get_leaf_packets(node), p_max_distance)) {
+        return true;
+      }
+    } else {
+      const Axis axis = node.get_axis();
+      const float ray_origin_comp = _get_component(p_ray.origin, axis);
+      const float ray_direction_comp = _get_component(p_ray.direction, axis);
+      const float t_hit = (node.split - ray_origin_comp) / ray_direction_comp;
+
+      const bool le_first = (ray_origin_comp < node.split)
+        || (ray_origin_comp == node.split && ray_direction_comp <= 0.0f);
+
+      const uint32_t first = node.get_children_index() + (le_first? 0 : 1);
+      const uint32_t second = node.get_children_index() + (le_first? 1 : 0);
+
+      if (t_max <= t_hit || t_hit < 0.0f) {
+        to_explore.push_back({first, t_min, t_max});
+      } else if (t_hit <= t_min) {
+        to_explore.push_back({second, t_min, t_max});
+      } else {
+        to_explore.push_back({second, t_hit, t_max});
+        to_explore.push_back({first, t_min, t_hit});
+      }
+    }
+  }
+
+  return false;
+}
+
+// Entry of the packet traversal stacks, the rays of `mask` go through the node on their own [t_min, t_max] range.
+struct KDTreePacketToExplore {
+  uint32_t node_index;
+  RayMask mask;
+  float t_min[MAX_RAY_PACKET_SIZE];
+  float t_max[MAX_RAY_PACKET_SIZE];
+};
+
+
+RayMask KDTree::intersect_packet(std::span<const Ray> p_rays, const RayMask p_mask, std::span<TriangleHit> r_hits) const {
+  RayMask hit_mask = 0;
+  RayMask done_mask = ~p_mask; // Rays whose closest hit is known
+  StackVector<KDTreePacketToExplore, MAX_TRAVERSAL_DEPTH> to_explore;
+
+  // Clip the rays to the bounds of the tree
+  to_explore.push_back({});
+  KDTreePacketToExplore &root = to_explore.back();
+  root.node_index = 0;
+  root.mask = 0;
+  for_each_ray(p_mask, [&](const size_t p_ray_index) {
+    const Ray &ray = p_rays[p_ray_index];
+    const auto [t_near, t_far] = get_aabb_intersection(ray.origin, Vec3::ONE / ray.direction, aabb);
+    if (t_far < t_near || t_near >= r_hits[p_ray_index].distance) {
+      done_mask |= RayMask(1) << p_ray_index;
+      return;
+    }
+    root.mask |= RayMask(1) << p_ray_index;
+    root.t_min[p_ray_index] = t_near;
+    root.t_max[p_ray_index] = std::min(t_far, r_hits[p_ray_index].distance);
+  });
+
+  KDTreePacketToExplore current;
+  while (!to_explore.empty() && done_mask != ~RayMask(0)) {
+    current = to_explore.back();
+    to_explore.pop_back();
+
+    const RayMask active_mask = current.mask & ~done_mask;
+    if (active_mask == 0) continue;
+
+    const Node &node = nodes[current.node_index];
+
+    if (node.is_leaf()) {
+      const std::span<const TrianglePacket> packets = _get_leaf_packets(node);
+
+      for_each_ray(active_mask, [&](const size_t p_ray_index) {
+        TriangleHit &hit = r_hits[p_ray_index];
+        TriangleHit leaf_hit = hit;
+        if (intersect_triangle_packets(p_rays[p_ray_index], packets, leaf_hit)) {
+          hit = leaf_hit;
+          hit.triangle_index = triangle_indices[node.triangles_offset + leaf_hit.triangle_index];
+          hit_mask |= RayMask(1) << p_ray_index;
+        }
+
+        // Same termination as the single ray traversal
+        if (hit.distance <= current.t_max[p_ray_index]) {
+          done_mask |= RayMask(1) << p_ray_index;
+        }
       });
-    break; case Node::Subdivision::Axis::Y:
-      std::sort(
-        p_triangle_indices.begin(),
-        p_triangle_indices.end(),
-        [&](const size_t a, const size_t b) -> bool { return tri_positions[a].y < tri_positions[b].y;
+      continue;
+    }
+
+    const Axis axis = node.get_axis();
+
+    // The whole packet can only be traversed in one order if its rays agree on which child is the closest
+    RayMask le_first_mask = 0;
+    for_each_ray(active_mask, [&](const size_t p_ray_index) {
+      const Ray &ray = p_rays[p_ray_index];
+      const float ray_origin_comp = _get_component(ray.origin, axis);
+      const float ray_direction_comp = _get_component(ray.direction, axis);
+      const bool le_first = (ray_origin_comp < node.split)
+        || (ray_origin_comp == node.split && ray_direction_comp <= 0.0f);
+      le_first_mask |= RayMask(le_first) << p_ray_index;
+    });
+
+    if (le_first_mask != 0 && le_first_mask != active_mask) {
+      for_each_ray(active_mask, [&](const size_t p_ray_index) {
+        const TriangleHit previous_hit = r_hits[p_ray_index];
+        if (_intersect_subtree(p_rays[p_ray_index], current.node_index, current.t_min[p_ray_index], current.t_max[p_ray_index], r_hits[p_ray_index])) {
+          done_mask |= RayMask(1) << p_ray_index;
+        }
+        if (r_hits[p_ray_index].distance != previous_hit.distance) {
+          hit_mask |= RayMask(1) << p_ray_index;
+        }
       });
-    break; case Node::Subdivision::Axis::Z:
-      std::sort(
-        p_triangle_indices.begin(),
-        p_triangle_indices.end(),
-        [&](const size_t a, const size_t b) -> bool { return tri_positions[a].z < tri_positions[b].z;
+      continue;
+    }
+
+    const bool le_first = le_first_mask != 0;
+    const uint32_t first = node.get_children_index() + (le_first? 0 : 1);
+    const uint32_t second = node.get_children_index() + (le_first? 1 : 0);
+
+    to_explore.push_back({});
+    KDTreePacketToExplore &second_entry = to_explore.back();
+    to_explore.push_back({});
+    KDTreePacketToExplore &first_entry = to_explore.back();
+    second_entry.node_index = second;
+    second_entry.mask = 0;
+    first_entry.node_index = first;
+    first_entry.mask = 0;
+
+    for_each_ray(active_mask, [&](const size_t p_ray_index) {
+      const Ray &ray = p_rays[p_ray_index];
+      const float t_min = current.t_min[p_ray_index];
+      const float t_max = current.t_max[p_ray_index];
+      const float t_hit = (node.split - _get_component(ray.origin, axis)) / _get_component(ray.direction, axis);
+      const RayMask ray_bit = RayMask(1) << p_ray_index;
+
+      if (t_max <= t_hit || t_hit < 0.0f) {
+        first_entry.mask |= ray_bit;
+        first_entry.t_min[p_ray_index] = t_min;
+        first_entry.t_max[p_ray_index] = t_max;
+      } else if (t_hit <= t_min) {
+        second_entry.mask |= ray_bit;
+        second_entry.t_min[p_ray_index] = t_min;
+        second_entry.t_max[p_ray_index] = t_max;
+      } else {
+        first_entry.mask |= ray_bit;
+        first_entry.t_min[p_ray_index] = t_min;
+        first_entry.t_max[p_ray_index] = t_hit;
+        second_entry.mask |= ray_bit;
+        second_entry.t_min[p_ray_index] = t_hit;
+        second_entry.t_max[p_ray_index] = t_max;
+      }
+    });
+  }
+
+  return hit_mask;
+}
+
+
+RayMask KDTree::occluded_packet(std::span<const Ray> p_rays, const RayMask p_mask, std::span<const float> p_max_distances) const {
+  RayMask occluded_mask = 0;
+  StackVector<KDTreePacketToExplore, MAX_TRAVERSAL_DEPTH> to_explore;
+
+  // Clip the rays to the bounds of the tree, the part of the rays beyond their maximum distance is never explored
+  to_explore.push_back({});
+  KDTreePacketToExplore &root = to_explore.back();
+  root.node_index = 0;
+  root.mask = 0;
+  for_each_ray(p_mask, [&](const size_t p_ray_index) {
+    const Ray &ray = p_rays[p_ray_index];
+    const auto [t_near, t_far] = get_aabb_intersection(ray.origin, Vec3::ONE / ray.direction, aabb);
+    if (t_far < t_near || t_far < 0.0f || t_near >= p_max_distances[p_ray_index]) {
+      return;
+    }
+    root.mask |= RayMask(1) << p_ray_index;
+    root.t_min[p_ray_index] = t_near;
+    root.t_max[p_ray_index] = std::min(t_far, p_max_distances[p_ray_index]);
+  });
+
+  // The order of the visit does not matter, the packet never has to be split
+  KDTreePacketToExplore current;
+  while (!to_explore.empty() && occluded_mask != p_mask) {
+    current = to_explore.back();
+    to_explore.pop_back();
+
+    const RayMask active_mask = current.mask & ~occluded_mask;
+    if (active_mask == 0) continue;
+
+    const Node &node = nodes[current.node_index];
+
+    if (node.is_leaf()) {
+      const std::span<const TrianglePacket> packets = _get_leaf_packets(node);
+      for_each_ray(active_mask, [&](const size_t p_ray_index) {
+        if (occluded_by_triangle_packets(p_rays[p_ray_index], packets, p_max_distances[p_ray_index])) {
+          occluded_mask |= RayMask(1) << p_ray_index;
+        }
       });
-    break; case Node::Subdivision::Axis::AXIS_MAX: return; // Do nothing
+      continue;
     }
+
+    const Axis axis = node.get_axis();
+
+    to_explore.push_back({});
+    KDTreePacketToExplore &ge_entry = to_explore.back();
+    to_explore.push_back({});
+    KDTreePacketToExplore &le_entry = to_explore.back();
+    le_entry.node_index = node.get_children_index() + 0;
+    le_entry.mask = 0;
+    ge_entry.node_index = node.get_children_index() + 1;
+    ge_entry.mask = 0;
+
+    for_each_ray(active_mask, [&](const size_t p_ray_index) {
+      const Ray &ray = p_rays[p_ray_index];
+      const float ray_origin_comp = _get_component(ray.origin, axis);
+      const float ray_direction_comp = _get_component(ray.direction, axis);
+      const float t_hit = (node.split - ray_origin_comp) / ray_direction_comp;
+      const float t_min = current.t_min[p_ray_index];
+      const float t_max = current.t_max[p_ray_index];
+      const RayMask ray_bit = RayMask(1) << p_ray_index;
+
+      const bool le_first = (ray_origin_comp < node.split)
+        || (ray_origin_comp == node.split && ray_direction_comp <= 0.0f);
+      KDTreePacketToExplore &first_entry = le_first? le_entry : ge_entry;
+      KDTreePacketToExplore &second_entry = le_first? ge_entry : le_entry;
+
+      if (t_max <= t_hit || t_hit < 0.0f) {
+        first_entry.mask |= ray_bit;
+        first_entry.t_min[p_ray_index] = t_min;
+        first_entry.t_max[p_ray_index] = t_max;
+      } else if (t_hit <= t_min) {
+        second_entry.mask |= ray_bit;
+        second_entry.t_min[p_ray_index] = t_min;
+        second_entry.t_max[p_ray_index] = t_max;
+      } else {
+        first_entry.mask |= ray_bit;
+        first_entry.t_min[p_ray_index] = t_min;
+        first_entry.t_max[p_ray_index] = t_hit;
+        second_entry.mask |= ray_bit;
+        second_entry.t_min[p_ray_index] = t_hit;
+        second_entry.t_max[p_ray_index] = t_max;
+      }
+    });
+  }
+
+  return occluded_mask;
+}
+
+
+
+// =======
+// = BVH =
+// =======
+
+
+// Builds BVH nodes over p_aabbs with a binned Surface Area Heuristic, r_indices is filled with the primitive indices referenced by the leaves.
+static void build_bvh_nodes(std::span<const AABB> p_aabbs, const float p_traversal_cost, const float p_intersection_cost, const size_t p_max_depth, std::vector<BVHNode> &r_nodes, std::vector<uint32_t> &r_indices) {
+  constexpr size_t BIN_COUNT = 16;
+
+  std::vector<Vec3> centroids(p_aabbs.size());
+  for (size_t i = 0; i < p_aabbs.size(); i++) {
+    centroids[i] = 0.5f * (p_aabbs[i].begin + p_aabbs[i].end);
+  }
+
+  r_indices.resize(p_aabbs.size());
+  for (size_t i = 0; i < p_aabbs.size(); i++) {
+    r_indices[i] = i;
+  }
+  r_nodes.clear();
+
+  if (p_aabbs.empty()) {
+    return;
+  }
+
+
+  // Helper functions
+  auto grow = [](AABB &p_aabb, const AABB &p_other) -> void {
+    p_aabb.begin = kmath::min(p_aabb.begin, p_other.begin);
+    p_aabb.end = kmath::max(p_aabb.end, p_other.end);
   };
 
-  auto next_axis = [&](const Node::Subdivision::Axis p_division_axis) -> Node::Subdivision::Axis {
-    using Axis = Node::Subdivision::Axis;
-    return static_cast<Axis>((static_cast<int>(p_division_axis) + 1) % static_cast<int>(Axis::AXIS_MAX));
+  const AABB EMPTY_AABB = AABB(Vec3::INF, -Vec3::INF);
+
+  struct Bin {
+    AABB aabb;
+    size_t count;
   };
 
-  // Recursive function to build the kdtree
-  std::function<Node(std::span<size_t>, const Node::Subdivision::Axis)> build_node =
-    [&](std::span<size_t> p_triangle_indices, const Node::Subdivision::Axis p_division_axis) -> Node {
-      // When the condition to stop building the kdtree is met, create a leaf
-      if (p_triangle_indices.size() <= MAX_ELEM_PER_LEAF) {
-        Node::Leaf leaf{};
-        for (const size_t &idx : p_triangle_indices) {
-          leaf.elements.push_back(idx);
-        }
-        return Node(std::move(leaf));
+  struct Split {
+    float cost = FLT_MAX;
+    int axis = -1;
+    size_t bin = 0; // Primitives in bins up to this one go to the first child
+  };
+
+  // Recursive function to build the bvh, writing the node at p_node_index over r_indices[p_begin, p_end)
+  std::function<void(const uint32_t, const uint32_t, const uint32_t, const size_t)> build_node =
+    [&](const uint32_t p_node_index, const uint32_t p_begin, const uint32_t p_end, const size_t p_depth) -> void {
+      const uint32_t primitive_count = p_end - p_begin;
+
+      AABB node_aabb = EMPTY_AABB;
+      AABB centroid_aabb = EMPTY_AABB;
+      for (uint32_t i = p_begin; i < p_end; i++) {
+        const uint32_t primitive_index = r_indices[i];
+        grow(node_aabb, p_aabbs[primitive_index]);
+        grow(centroid_aabb, AABB(centroids[primitive_index], centroids[primitive_index]));
       }
+      r_nodes[p_node_index] = BVHNode{node_aabb, p_begin, primitive_count};
 
-      // Build the space subdivision
-      Node::Subdivision sub{};
-      sub.axis = p_division_axis;
-
-      // Split the triangles using the median
-      sort_triangles(p_triangle_indices, p_division_axis);
-      if (p_triangle_indices.size() % 2 == 0) {
-        const size_t mid = p_triangle_indices.size() / 2;
-        const Vec3 a = tri_positions[p_triangle_indices[mid]];
-        const Vec3 b = tri_positions[p_triangle_indices[mid + 1]];
-        sub.value = _get_component(0.5f * (a + b), p_division_axis);
-      } else {
-        const size_t mid = p_triangle_indices.size() / 2;
-        sub.value = _get_component(tri_positions[p_triangle_indices[mid]], p_division_axis);
+      if (primitive_count <= 1 || p_depth + 1 >= p_max_depth) {
+        return; // Leaf
       }
 
-      std::vector<size_t> less_triangle_indices;
-      std::vector<size_t> greater_triangles_indices;
+      // Evaluate the SAH on the boundaries of bins spread evenly over the primitive centroids
+      Split best;
+      const float inv_node_area = 1.0f / get_surface_area(node_aabb);
 
-      for (const size_t tri_index : p_triangle_indices) {
-        if (_get_component(triangles_aabb[tri_index].begin, p_division_axis) <= sub.value) {
-          less_triangle_indices.push_back(tri_index);
+      for (int axis = 0; axis < 3; axis++) {
+        const float centroid_begin = centroid_aabb.begin[axis];
+        const float centroid_end = centroid_aabb.end[axis];
+        if (centroid_end <= centroid_begin) continue;
+
+        Bin bins[BIN_COUNT];
+        for (Bin &bin : bins) {
+          bin = Bin{EMPTY_AABB, 0};
         }
-        if (_get_component(triangles_aabb[tri_index].end, p_division_axis) >= sub.value) {
-          greater_triangles_indices.push_back(tri_index);
+
+        const float bin_scale = BIN_COUNT / (centroid_end - centroid_begin);
+        auto get_bin = [&](const uint32_t p_primitive_index) -> size_t {
+          const size_t bin = (centroids[p_primitive_index][axis] - centroid_begin) * bin_scale;
+          return std::min(bin, BIN_COUNT - 1);
+        };
+
+        for (uint32_t i = p_begin; i < p_end; i++) {
+          const uint32_t primitive_index = r_indices[i];
+          Bin &bin = bins[get_bin(primitive_index)];
+          grow(bin.aabb, p_aabbs[primitive_index]);
+          bin.count += 1;
         }
+
+        // Sweep from the right to get the cost of every second child, then from the left
+        float right_costs[BIN_COUNT];
+        AABB right_aabb = EMPTY_AABB;
+        size_t right_count = 0;
+        for (size_t bin = BIN_COUNT - 1; bin > 0; bin--) {
+          grow(right_aabb, bins[bin].aabb);
+          right_count += bins[bin].count;
+          right_costs[bin - 1] = (right_count)? get_surface_area(right_aabb) * right_count : 0.0f;
+        }
+
+        AABB left_aabb = EMPTY_AABB;
+        size_t left_count = 0;
+        for (size_t bin = 0; bin < BIN_COUNT - 1; bin++) {
+          grow(left_aabb, bins[bin].aabb);
+          left_count += bins[bin].count;
+          if (left_count == 0 || left_count == primitive_count) continue;
+
+          const float cost = p_traversal_cost
+            + p_intersection_cost * (get_surface_area(left_aabb) * left_count + right_costs[bin]) * inv_node_area;
+          if (cost < best.cost) {
+            best = Split{cost, axis, bin};
+          }
+        }
+      }
+
+      // Only subdivide when it is expected to be cheaper than intersecting every primitive of the node
+      if (best.axis < 0 || best.cost >= p_intersection_cost * primitive_count) {
+        return; // Leaf
       }
 
-      Node::Subdivision::Axis next_division_axis = next_axis(p_division_axis);
+      const float bin_scale = BIN_COUNT / (centroid_aabb.end[best.axis] - centroid_aabb.begin[best.axis]);
+      uint32_t *middle = std::partition(
+        r_indices.data() + p_begin,
+        r_indices.data() + p_end,
+        [&](const uint32_t p_primitive_index) -> bool {
+          const size_t bin = (centroids[p_primitive_index][best.axis] - centroid_aabb.begin[best.axis]) * bin_scale;
+          return std::min(bin, BIN_COUNT - 1) <= best.bin;
+        }
+      );
+      const uint32_t middle_index = middle - r_indices.data();
+
+      // Both children are allocated together so that they are next to each other
+      const uint32_t children_index = r_nodes.size();
+      r_nodes.resize(r_nodes.size() + 2);
+      r_nodes[p_node_index].offset = children_index;
+      r_nodes[p_node_index].count = 0;
+
+      build_node(children_index + 0, p_begin, middle_index, p_depth + 1);
+      build_node(children_index + 1, middle_index, p_end, p_depth + 1);
+    };
 
-      if (less_triangle_indices.size() == p_triangle_indices.size() || greater_triangles_indices.size() == p_triangle_indices.size()) {
-        LOG_WARNING("MESH WITH TOO MANY TRIANGLES ON THE SAME PLANE, CANNOT BUILD KDTREE");
+  // Build the tree
+  r_nodes.reserve(2 * p_aabbs.size());
+  r_nodes.resize(1);
+  build_node(0, 0, p_aabbs.size(), 0);
+  r_nodes.shrink_to_fit();
+}
+
+
+static AccelerationStructureStatistics get_bvh_statistics(std::span<const BVHNode> p_nodes, const size_t p_primitive_count, const float p_traversal_cost, const float p_intersection_cost) {
+  AccelerationStructureStatistics statistics;
+
+  // Returns the SAH cost of the subtree, relative to the probability of entering its root
+  std::function<float(const uint32_t, const size_t)> visit =
+    [&](const uint32_t p_node_index, const size_t p_depth) -> float {
+      const BVHNode &node = p_nodes[p_node_index];
+      statistics.node_count += 1;
+      statistics.max_depth = std::max(statistics.max_depth, p_depth);
+
+      if (node.is_leaf()) {
+        statistics.leaf_count += 1;
+        statistics.max_leaf_size = std::max<size_t>(statistics.max_leaf_size, node.count);
+        statistics.triangle_references += node.count;
+        return p_intersection_cost * node.count;
       }
-      
-      sub.le = std::make_unique<Node>(build_node(
-        std::span<size_t>(less_triangle_indices), next_division_axis
-      ));
-      sub.ge = std::make_unique<Node>(build_node(
-        std::span<size_t>(greater_triangles_indices), next_division_axis
-      ));
-
-      return Node(std::move(sub));
+
+      const float inv_node_area = 1.0f / get_surface_area(node.aabb);
+      const BVHNode &first = p_nodes[node.offset + 0];
+      const BVHNode &second = p_nodes[node.offset + 1];
+
+      return p_traversal_cost
+        + get_surface_area(first.aabb) * inv_node_area * visit(node.offset + 0, p_depth + 1)
+        + get_surface_area(second.aabb) * inv_node_area * visit(node.offset + 1, p_depth + 1);
     };
 
+  if (!p_nodes.empty()) {
+    statistics.sah_cost = visit(0, 0);
+  }
+  if (p_primitive_count) {
+    statistics.duplication_factor = static_cast<float>(statistics.triangle_references) / p_primitive_count;
+  }
+  statistics.memory_size = p_nodes.size() * sizeof(BVHNode) + statistics.triangle_references * sizeof(uint32_t);
+  return statistics;
+}
 
-  // Build the tree
-  std::vector<size_t> triangle_indices(p_triangles.size());
+
+BVH BVH::build_bvh(std::span<const Vec3i> p_triangles, std::span<const Vec3> p_positions, std::span<const kmath::Vec3> p_normals, std::span<const kmath::Vec2> p_uvs) {
+  BVH bvh;
+  bvh.triangle_elements = p_triangles;
+  bvh.vertex_positions = p_positions;
+  bvh.vertex_normals = p_normals;
+  bvh.vertex_uvs = p_uvs;
+
+  std::vector<AABB> triangles_aabb(p_triangles.size());
   for (size_t i = 0; i < p_triangles.size(); i++) {
-    triangle_indices[i] = i;
+    triangles_aabb[i] = get_triangle_aabb(p_triangles[i], p_positions);
   }
-  tree.root = build_node(triangle_indices, Node::Subdivision::Axis::X);
-  
-  return tree;
+
+  build_bvh_nodes(triangles_aabb, TRAVERSAL_COST, INTERSECTION_COST, MAX_DEPTH, bvh.nodes, bvh.triangle_indices);
+  bvh.leaf_triangles = get_leaf_triangles(bvh.triangle_indices, p_triangles, p_positions);
+  bvh.statistics = get_bvh_statistics(bvh.nodes, p_triangles.size(), TRAVERSAL_COST, INTERSECTION_COST);
+  bvh.statistics.memory_size += bvh.leaf_triangles.size() * sizeof(PrecomputedTriangle);
+
+  return bvh;
 }
 
 
-RayMeshIntersection KDTree::intersect(const Ray &p_ray) const {
-  RayMeshIntersection closest_intersection;
-  closest_intersection.exists = false;
-  closest_intersection.distance = FLT_MAX;
+ObjectBVH ObjectBVH::build_object_bvh(std::span<const AABB> p_objects_aabb) {
+  ObjectBVH bvh;
+  build_bvh_nodes(p_objects_aabb, TRAVERSAL_COST, INTERSECTION_COST, MAX_DEPTH, bvh.nodes, bvh.object_indices);
+  bvh.statistics = get_bvh_statistics(bvh.nodes, p_objects_aabb.size(), TRAVERSAL_COST, INTERSECTION_COST);
+  return bvh;
+}
 
 
-  // Helper functions
-  auto get_full_aabb_intersect = [&](const AABB &p_aabb) -> std::pair<float, float> {
-    const float txb = (p_aabb.begin.x - p_ray.origin.x) / p_ray.direction.x;
-    const float txe = (p_aabb.end.x   - p_ray.origin.x) / p_ray.direction.x;
-    const float tyb = (p_aabb.begin.y - p_ray.origin.y) / p_ray.direction.y;
-    const float tye = (p_aabb.end.y   - p_ray.origin.y) / p_ray.direction.y;
-    const float tzb = (p_aabb.begin.z - p_ray.origin.z) / p_ray.direction.z;
-    const float tze = (p_aabb.end.z   - p_ray.origin.z) / p_ray.direction.z;
+RayMeshIntersection BVH::intersect(const Ray &p_ray) const {
+  TriangleHit closest_hit;
+  intersect(p_ray, closest_hit);
+  return fetch_shading_data(closest_hit, triangle_elements, vertex_positions, vertex_normals, vertex_uvs);
+}
 
-    return {
-      std::max({std::min(txb, txe), std::min(tyb, tye), std::min(tzb, tze)}),
-      std::min({std::max(txb, txe), std::max(tyb, tye), std::max(tzb, tze)}),
-    };
-  };
 
-  // We know that we don't need to traverse the kdtree, the ray goes outside
-  const auto [t_near, t_far] = get_full_aabb_intersect(aabb);
-  if (t_far < t_near) {
-    return closest_intersection;
+bool BVH::intersect(const Ray &p_ray, TriangleHit &r_hit) const {
+  if (triangle_elements.empty()) {
+    return false;
   }
 
+  const Vec3 inv_direction = Vec3::ONE / p_ray.direction;
+
+  // Returns the distance at which the ray enters the box, or FLT_MAX if it misses it
+  auto get_entry_distance = [&](const AABB &p_aabb) -> float {
+    const auto [t_near, t_far] = get_aabb_intersection(p_ray.origin, inv_direction, p_aabb);
+    return (t_near <= t_far && t_far >= 0.0f)? t_near : FLT_MAX;
+  };
+
+  const uint32_t previous_index = r_hit.triangle_index;
+  const float previous_distance = r_hit.distance;
+
   // Structure traversal
-  std::stack<std::tuple<const Node*, float, float>> to_explore;
-  to_explore.push({&root, t_near, t_far});
+  struct ToExplore {
+    uint32_t node_index;
+    float t_near;
+  };
+  StackVector<ToExplore, MAX_DEPTH + 1> to_explore;
+
+  const float root_distance = get_entry_distance(nodes[0].aabb);
+  if (root_distance != FLT_MAX) {
+    to_explore.push_back({0, root_distance});
+  }
 
   while (!to_explore.empty()) {
-    const auto [node, t_min, t_max] = to_explore.top();
-    to_explore.pop();
+    const auto [node_index, t_near] = to_explore.back();
+    to_explore.pop_back();
+
+    // A closer hit was found since this node was pushed
+    if (t_near >= r_hit.distance) continue;
 
-    if (std::holds_alternative<Node::Leaf>(node->data)) {
-      const Node::Leaf &leaf = std::get<Node::Leaf>(node->data);
+    const BVHNode &node = nodes[node_index];
 
+    if (node.is_leaf()) {
       // Perform an intersection with every element of the leaf
-      for (const size_t tri_index : leaf.elements) {
-        const Vec3i element = triangle_elements[tri_index];
-        const Triangle tri{{
-         vertex_positions[element.x],
-         vertex_positions[element.y],
-         vertex_positions[element.z]
-        }};
-
-        const auto intersection_opt = get_intersection(p_ray, tri);
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+        const auto intersection_opt = get_intersection(p_ray, leaf_triangles[i]);
         if (!intersection_opt.has_value()) continue;
         const RayTriangleIntersection intersection = intersection_opt.value();
 
-        if (intersection.distance >= closest_intersection.distance) continue;
-
-        const Vec3 normal = normalized(
-          intersection.barycentric.x * vertex_normals[element.x]
-          + intersection.barycentric.y * vertex_normals[element.y]
-          + intersection.barycentric.z * vertex_normals[element.z]
-        );
-
-        const Vec2 uv = (
-          intersection.barycentric.x * vertex_uvs[element.x]
-          + intersection.barycentric.y * vertex_uvs[element.y]
-          + intersection.barycentric.z * vertex_uvs[element.z]
-        );
-
-        closest_intersection.position = intersection.position;
-        closest_intersection.distance = intersection.distance;
-        closest_intersection.normal = normal;
-        closest_intersection.uv = uv;
-        closest_intersection.barycentric = intersection.barycentric;
-        closest_intersection.exists = true;
-      }
+        if (intersection.distance >= r_hit.distance) continue;
 
-      if (closest_intersection.exists) {
-        return closest_intersection;
+        r_hit = TriangleHit{triangle_indices[i], intersection.distance, intersection.barycentric};
       }
-    } else {
-      const Node::Subdivision &sub = std::get<Node::Subdivision>(node->data);
-
-      const float ray_origin_comp = _get_component(p_ray.origin, sub.axis);
-      const float ray_direction_comp = _get_component(p_ray.direction, sub.axis);
-      const float t_hit = (sub.value - ray_origin_comp) / ray_direction_comp;
-
-      const bool le_first = (ray_origin_comp < sub.value)
-        || (ray_origin_comp == sub.value && ray_direction_comp <= 0.0f);
+      continue;
+    }
 
-      const Node *first, *second;
-      if (le_first) {
-        first = sub.le.get();
-        second = sub.ge.get();
-      } else {
-        first = sub.ge.get();
-        second = sub.le.get();
-      }
+    // Visit the closest child first
+    uint32_t first = node.offset + 0;
+    uint32_t second = node.offset + 1;
+    float first_distance = get_entry_distance(nodes[first].aabb);
+    float second_distance = get_entry_distance(nodes[second].aabb);
+    if (second_distance < first_distance) {
+      std::swap(first, second);
+      std::swap(first_distance, second_distance);
+    }
 
-      if (t_max <= t_hit || t_hit < 0.0f) {
-        to_explore.push({first, t_min, t_max});
-      } else if (t_hit <= t_min) {
-        to_explore.push({second, t_min, t_max});
-      } else {
-        to_explore.push({second, t_hit, t_max});
-        to_explore.push({first, t_min, t_hit});
-      }
+    if (second_distance < r_hit.distance) {
+      to_explore.push_back({second, second_distance});
+    }
+    if (first_distance < r_hit.distance) {
+      to_explore.push_back({first, first_distance});
     }
   }
 
-  return closest_intersection;
+  return r_hit.triangle_index != previous_index || r_hit.distance != previous_distance;
 }
 
 
-void KDTree::draw() const {
-  Renderer *rd = Renderer::get_singleton();
-  tputils::ImmediateGeometry &imgeo = rd->immediate_geometry();
-  
-  std::stack<std::tuple<const Node*, AABB>> to_explore;
-  to_explore.push({&root, aabb});
+bool BVH::occluded(const Ray &p_ray, const float p_max_distance) const {
+  if (triangle_elements.empty()) {
+    return false;
+  }
 
-  // DEBUG: values to see only part of the tree :)
-  const size_t path = 0b110;
-  const size_t path_size = 0;
-  size_t path_index = 0;
+  const Vec3 inv_direction = Vec3::ONE / p_ray.direction;
 
-  while (!to_explore.empty()) {
-    const auto [node, parent_aabb] = to_explore.top();
-    to_explore.pop();
-
-    if (std::holds_alternative<Node::Leaf>(node->data)) {
-      const Node::Leaf &leaf = std::get<Node::Leaf>(node->data);
-      const Lrgb color = Lrgb(
-        0.5f + 0.5f * spatial_random(parent_aabb.begin.x + parent_aabb.end.y),
-        0.5f + 0.5f * spatial_random(parent_aabb.begin.y + parent_aabb.end.z),
-        0.5f + 0.5f * spatial_random(parent_aabb.begin.z + parent_aabb.end.x)
-      );
-      rd->set_color(color);
-
-      imgeo.begin(ImmediateGeometry::Mode::POINTS, rd->get_default_buffer_layout());
-      for (const size_t tri_index : leaf.elements) {
-        const Vec3i tri = triangle_elements[tri_index];
-        const Vec3 pos = 0.3333f * (
-          vertex_positions[tri.x] + vertex_positions[tri.y] + vertex_positions[tri.z]
-        );
-        imgeo.push_vec3(pos);
-        imgeo.push_vec3(Vec3::ZERO);
-        imgeo.push_vec2(Vec2::ZERO);
-      }
-      imgeo.end();
+  // The order of the visit does not matter, any hit stops the traversal
+  auto is_hit = [&](const AABB &p_aabb) -> bool {
+    const auto [t_near, t_far] = get_aabb_intersection(p_ray.origin, inv_direction, p_aabb);
+    return t_near <= t_far && t_far >= 0.0f && t_near < p_max_distance;
+  };
 
-      draw_aabb(parent_aabb);
-    } else {
-      const Node::Subdivision &sub = std::get<Node::Subdivision>(node->data);
-      const auto [le_aabb, ge_aabb] = _cut_aabb(parent_aabb, sub.value, sub.axis);
-
-      if (path_index < path_size) {
-        const size_t next = (path >> path_index) & 1;
-        path_index += 1;
-        if (next) {
-          to_explore.push({sub.ge.get(), ge_aabb});
-        } else {
-          to_explore.push({sub.le.get(), le_aabb});
+  StackVector<uint32_t, MAX_DEPTH + 1> to_explore;
+  if (is_hit(nodes[0].aabb)) {
+    to_explore.push_back(0);
+  }
+
+  while (!to_explore.empty()) {
+    const BVHNode &node = nodes[to_explore.back()];
+    to_explore.pop_back();
+
+    if (node.is_leaf()) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+        const auto intersection_opt = get_intersection(p_ray, leaf_triangles[i]);
+        if (intersection_opt.has_value() && intersection_opt.value().distance < p_max_distance) {
+          return true;
         }
-        continue;
       }
-      to_explore.push({sub.le.get(), le_aabb});
-      to_explore.push({sub.ge.get(), ge_aabb});
+      continue;
+    }
+
+    if (is_hit(nodes[node.offset + 1].aabb)) {
+      to_explore.push_back(node.offset + 1);
+    }
+    if (is_hit(nodes[node.offset + 0].aabb)) {
+      to_explore.push_back(node.offset + 0);
     }
   }
-}
 
+  return false;
+}
@@ -38,79 +38,507 @@
 #pragma once
 
 
+#include <algorithm>
+#include <bit>
+#include <cfloat>
 #include <cstddef>
-#include <memory>
+#include <cstdint>
+#include <ostream>
 #include <span>
-#include <variant>
+#include <vector>
 
 
 #include "geometry/ray.hpp"
-#include "tp_utils/src/data_structures/stack_vector.hpp"
+#include "geometry/triangle.hpp"
+#include "geometry/triangle_packet.hpp"
 #include "tp_utils/src/data_structures/aabb.hpp"
+#include "tp_utils/src/data_structures/stack_vector.hpp"
+#include "utils/mapped_array.hpp"
+
+
+// Quality metrics of a built acceleration structure, used to compare builders.
+struct AccelerationStructureStatistics {
+  float sah_cost = 0.0f; // Expected cost of tracing a random ray through the structure
+  size_t max_depth = 0;
+  size_t node_count = 0;
+  size_t leaf_count = 0;
+  size_t empty_leaf_count = 0;
+  size_t max_leaf_size = 0;
+  size_t triangle_references = 0; // Sum of the sizes of every leaf
+  float duplication_factor = 0.0f; // triangle_references / triangle count
+  size_t memory_size = 0; // Size of the nodes, triangle references and leaf triangles, in bytes
+};
+
+
+// Returns the distances at which a ray enters and exits p_aabb, the box is missed when the first one is greater than the second.
+inline std::pair<float, float> get_aabb_intersection(const kmath::Vec3 &p_origin, const kmath::Vec3 &p_inv_direction, const tputils::AABB &p_aabb) {
+  const kmath::Vec3 t_begin = (p_aabb.begin - p_origin) * p_inv_direction;
+  const kmath::Vec3 t_end = (p_aabb.end - p_origin) * p_inv_direction;
+  const kmath::Vec3 t_min = kmath::min(t_begin, t_end);
+  const kmath::Vec3 t_max = kmath::max(t_begin, t_end);
+  return {
+    std::max({t_min.x, t_min.y, t_min.z}),
+    std::min({t_max.x, t_max.y, t_max.z}),
+  };
+}
+
+
+RayMeshIntersection fetch_shading_data(const TriangleHit &p_hit, std::span<const kmath::Vec3i> p_triangles, std::span<const kmath::Vec3> p_positions, std::span<const kmath::Vec3> p_normals, std::span<const kmath::Vec2> p_uvs);
+
+
+enum class AccelerationStructureType {
+  KD_TREE,
+  BVH,
+};
 
 
 class KDTree {
+public:
+  typedef AccelerationStructureStatistics Statistics;
+
 public:
 
   RayMeshIntersection intersect(const Ray &p_ray) const;
+  // Finds the closest triangle hit closer than r_hit.distance, r_hit is updated and true is returned when there is one.
+  bool intersect(const Ray &p_ray, TriangleHit &r_hit) const;
+  // Returns true as soon as a triangle is hit closer than p_max_distance, without computing the hit attributes.
+  bool occluded(const Ray &p_ray, const float p_max_distance) const;
+
+  // Packet versions of `intersect` and `occluded`, for the rays of p_mask. The rays share the node fetches and the
+  // traversal stops once all of them are done. Rays not agreeing on the order of the children of a node are finished
+  // one at a time from that node.
+  // Both return the mask of the rays that were hit.
+  RayMask intersect_packet(std::span<const Ray> p_rays, const RayMask p_mask, std::span<TriangleHit> r_hits) const;
+  RayMask occluded_packet(std::span<const Ray> p_rays, const RayMask p_mask, std::span<const float> p_max_distances) const;
+
   void draw() const;
 
+  inline const Statistics &get_statistics() const { return statistics; }
+
   // The lifetime of the KDTree should exced that of the data pointed by p_triangles and p_positions.
   static KDTree build_kdtree(std::span<const kmath::Vec3i> p_triangles, std::span<const kmath::Vec3> p_vertex_positions, std::span<const kmath::Vec3> p_normals, std::span<const kmath::Vec2> p_uvs);
 
 
 private:
-  KDTree() = default;  
+  KDTree() = default;
+
+  // Reads and writes the tree data
+  friend class MeshCache;
 
 private:
-  constexpr static size_t MAX_ELEM_PER_LEAF = 32;
+  // Surface Area Heuristic costs, the actual values only matter relative to each other.
+  constexpr static float TRAVERSAL_COST = 1.0f;
+  constexpr static float INTERSECTION_COST = 2.5f; // For a whole packet of triangles
+  // Cost multiplier for splits cutting off empty space, makes rays exit the tree earlier.
+  constexpr static float EMPTY_SPACE_BONUS = 0.8f;
+  // The top of the tree is split until there are this many subtrees per thread to build in parallel
+  constexpr static size_t SUBTREES_PER_THREAD = 4;
+
+
+public:
+  enum class Axis : uint32_t {
+    X = 0, Y = 1, Z = 2, AXIS_MAX = 3
+  };
 
 
 private:
+  // Compact node: the children of a subdivision are stored next to each other in `nodes`, and leaves
+  // reference a range of `triangle_indices`.
   struct Node {
   public:
-    struct Leaf {
-      tputils::StackVector<size_t, MAX_ELEM_PER_LEAF> elements;
-
+    union {
+      float split;               // Subdivision: position of the splitting plane
+      uint32_t triangles_offset; // Leaf: index of its first triangle in `triangle_indices`
     };
+    // The two lower bits hold the split axis (AXIS_MAX for leaves).
+    // The upper bits hold the index of the `le` child (`ge` is right after it) or the leaf's triangle count.
+    uint32_t flags;
 
-    struct Subdivision {
-      std::unique_ptr<Node> le;
-      std::unique_ptr<Node> ge;
-
-      float value;
-
-      enum class Axis : int {
-        X = 0, Y = 1, Z = 2, AXIS_MAX = 3
-      } axis;
-    };
+  public:
+    inline bool is_leaf() const { return (flags & AXIS_MASK) == static_cast<uint32_t>(Axis::AXIS_MAX); }
+    inline Axis get_axis() const { return static_cast<Axis>(flags & AXIS_MASK); }
+    inline uint32_t get_children_index() const { return flags >> AXIS_BITS; }
+    inline uint32_t get_triangle_count() const { return flags >> AXIS_BITS; }
 
+    static inline Node subdivision(const Axis p_axis, const float p_split, const uint32_t p_children_index) {
+      Node node;
+      node.split = p_split;
+      node.flags = (p_children_index << AXIS_BITS) | static_cast<uint32_t>(p_axis);
+      return node;
+    }
 
+    static inline Node leaf(const uint32_t p_triangles_offset, const uint32_t p_triangle_count) {
+      Node node;
+      node.triangles_offset = p_triangles_offset;
+      node.flags = (p_triangle_count << AXIS_BITS) | static_cast<uint32_t>(Axis::AXIS_MAX);
+      return node;
+    }
 
-  public:
-    std::variant<Leaf, Subdivision> data;
+  private:
+    constexpr static uint32_t AXIS_BITS = 2;
+    constexpr static uint32_t AXIS_MASK = (1 << AXIS_BITS) - 1;
   };
+  static_assert(sizeof(Node) == 8);
+
+  // Deep enough for any tree respecting the depth limit of the builder.
+  constexpr static size_t MAX_TRAVERSAL_DEPTH = 64;
 
 
 private:
-  static std::pair<tputils::AABB, tputils::AABB> _cut_aabb(const tputils::AABB &p_parent, const float p_value, const Node::Subdivision::Axis p_axis);
-  static inline float _get_component(const kmath::Vec3 &p_vector, const Node::Subdivision::Axis p_axis) {
-    switch (p_axis) {
-    break;case Node::Subdivision::Axis::X: return p_vector.x;
-    break;case Node::Subdivision::Axis::Y: return p_vector.y;
-    break;case Node::Subdivision::Axis::Z: return p_vector.z;
-    break;case Node::Subdivision::Axis::AXIS_MAX: break;
-    }
-    return 0.0f;
+  static std::pair<tputils::AABB, tputils::AABB> _cut_aabb(const tputils::AABB &p_parent, const float p_value, const Axis p_axis);
+  static inline float _get_component(const kmath::Vec3 &p_vector, const Axis p_axis) {
+    return p_vector[static_cast<uint32_t>(p_axis)];
   };
 
+  // Leaves are intersected one packet of triangles at a time
+  static inline float _get_leaf_cost(const size_t p_triangle_count) {
+    return INTERSECTION_COST * ((p_triangle_count + TRIANGLE_PACKET_WIDTH - 1) / TRIANGLE_PACKET_WIDTH);
+  }
+
+  inline std::span<const TrianglePacket> _get_leaf_packets(const Node &p_leaf) const {
+    const size_t packet_count = (p_leaf.get_triangle_count() + TRIANGLE_PACKET_WIDTH - 1) / TRIANGLE_PACKET_WIDTH;
+    return std::span<const TrianglePacket>(leaf_packets.data() + p_leaf.triangles_offset / TRIANGLE_PACKET_WIDTH, packet_count);
+  }
+
+
+
+  // Single ray traversal of the subtree of p_node_index, on the [p_t_min, p_t_max] part of the ray.
+  // Returns true when the closest hit is known to be in the subtree, the traversal of the ray is then over.
+  bool _intersect_subtree(const Ray &p_ray, const uint32_t p_node_index, const float p_t_min, const float p_t_max, TriangleHit &r_hit) const;
+
+  void _compute_statistics();
+
+  class Builder;
 
 
 private:
-  Node root;
+  // Either built or stored in a mesh cache
+  MappedArray<Node> nodes; // The root is the first node
+  MappedArray<uint32_t> triangle_indices; // Every leaf is padded to a whole number of packets
+  MappedArray<TrianglePacket> leaf_packets; // Triangles referenced by `triangle_indices`, in the same order
+  tputils::AABB aabb;
+  Statistics statistics;
+  std::span<const kmath::Vec3i> triangle_elements;
+  std::span<const kmath::Vec3> vertex_positions;
+  std::span<const kmath::Vec3> vertex_normals;
+  std::span<const kmath::Vec2> vertex_uvs;
+};
+
+
+// Node of the bounding volume hierarchies, the children of a node are stored next to each other.
+struct BVHNode {
   tputils::AABB aabb;
+  uint32_t offset; // Index of the first child, or of the first primitive of the leaf in the index array
+  uint32_t count;  // Number of primitives of the leaf, 0 for interior nodes
+
+public:
+  inline bool is_leaf() const { return count != 0; }
+};
+static_assert(sizeof(BVHNode) == 32);
+
+
+// Bounding volume hierarchy, built with a binned Surface Area Heuristic.
+// Unlike the KDTree, every triangle is referenced by exactly one leaf.
+class BVH {
+public:
+  typedef AccelerationStructureStatistics Statistics;
+
+public:
+
+  RayMeshIntersection intersect(const Ray &p_ray) const;
+  // Finds the closest triangle hit closer than r_hit.distance, r_hit is updated and true is returned when there is one.
+  bool intersect(const Ray &p_ray, TriangleHit &r_hit) const;
+  // Returns true as soon as a triangle is hit closer than p_max_distance, without computing the hit attributes.
+  bool occluded(const Ray &p_ray, const float p_max_distance) const;
+  void draw() const;
+
+  inline const Statistics &get_statistics() const { return statistics; }
+
+  // The lifetime of the BVH should exced that of the data pointed by p_triangles and p_positions.
+  static BVH build_bvh(std::span<const kmath::Vec3i> p_triangles, std::span<const kmath::Vec3> p_vertex_positions, std::span<const kmath::Vec3> p_normals, std::span<const kmath::Vec2> p_uvs);
+
+
+private:
+  BVH() = default;
+
+private:
+  constexpr static float TRAVERSAL_COST = 1.0f;
+  constexpr static float INTERSECTION_COST = 1.5f;
+  constexpr static size_t MAX_DEPTH = 64;
+
+
+private:
+  std::vector<BVHNode> nodes; // The root is the first node
+  std::vector<uint32_t> triangle_indices;
+  std::vector<PrecomputedTriangle> leaf_triangles; // Triangles referenced by `triangle_indices`, in the same order
+  Statistics statistics;
   std::span<const kmath::Vec3i> triangle_elements;
   std::span<const kmath::Vec3> vertex_positions;
   std::span<const kmath::Vec3> vertex_normals;
   std::span<const kmath::Vec2> vertex_uvs;
 };
+
+
+// Bounding volume hierarchy over arbitrary objects, only knowing their bounding boxes.
+// Used as the top level structure of the scene, the objects themselves are intersected by the caller.
+class ObjectBVH {
+public:
+  // Calls `p_intersect(object_index)` for the objects whose bounding box is hit by the ray, closest nodes first.
+  // `p_intersect` returns the distance to its hit (FLT_MAX when missed), nodes farther than the closest hit are skipped.
+  // Returns the distance of the closest hit.
+  template<typename F>
+  float traverse(const Ray &p_ray, F &&p_intersect) const;
+
+  // Calls `p_occluded(object_index)` for the objects whose bounding box is hit closer than p_max_distance, until one
+  // of them returns true. Returns whether an object was found.
+  template<typename F>
+  bool any_hit(const Ray &p_ray, const float p_max_distance, F &&p_occluded) const;
+
+  // Packet version of `traverse`, for the rays of p_mask. Calls `p_intersect(object_index, active_mask)` with the rays
+  // of the packet whose closest hit can still be in the object. `p_intersect` lowers p_closest_distances (FLT_MAX when
+  // nothing was hit) for the rays it hits, the traversal reads them to skip farther nodes.
+  template<typename F>
+  void traverse_packet(std::span<const Ray> p_rays, const RayMask p_mask, std::span<const float> p_closest_distances, F &&p_intersect) const;
+
+  // Packet version of `any_hit`. `p_occluded(object_index, active_mask)` returns the mask of the rays it found occluded,
+  // it is only called with rays that are not occluded yet. Returns the mask of the occluded rays.
+  template<typename F>
+  RayMask any_hit_packet(std::span<const Ray> p_rays, const RayMask p_mask, std::span<const float> p_max_distances, F &&p_occluded) const;
+
+  inline size_t get_object_count() const { return object_indices.size(); }
+  inline const AccelerationStructureStatistics &get_statistics() const { return statistics; }
+
+  static ObjectBVH build_object_bvh(std::span<const tputils::AABB> p_objects_aabb);
+
+  ObjectBVH() = default;
+
+private:
+  constexpr static float TRAVERSAL_COST = 1.0f;
+  constexpr static float INTERSECTION_COST = 2.0f;
+  constexpr static size_t MAX_DEPTH = 64;
+
+private:
+  std::vector<BVHNode> nodes; // The root is the first node
+  std::vector<uint32_t> object_indices;
+  AccelerationStructureStatistics statistics;
+};
+
+
+template<typename F>
+float ObjectBVH::traverse(const Ray &p_ray, F &&p_intersect) const {
+  float closest_distance = FLT_MAX;
+  if (nodes.empty()) {
+    return closest_distance;
+  }
+
+  const kmath::Vec3 inv_direction = kmath::Vec3::ONE / p_ray.direction;
+
+  // Returns the distance at which the ray enters the box, or FLT_MAX if it misses it
+  auto get_entry_distance = [&](const tputils::AABB &p_aabb) -> float {
+    const auto [t_near, t_far] = get_aabb_intersection(p_ray.origin, inv_direction, p_aabb);
+    return (t_near <= t_far && t_far >= 0.0f)? t_near : FLT_MAX;
+  };
+
+  struct ToExplore {
+    uint32_t node_index;
+    float t_near;
+  };
+  tputils::StackVector<ToExplore, MAX_DEPTH + 1> to_explore;
+
+  const float root_distance = get_entry_distance(nodes[0].aabb);
+  if (root_distance != FLT_MAX) {
+    to_explore.push_back({0, root_distance});
+  }
+
+  while (!to_explore.empty()) {
+    const auto [node_index, t_near] = to_explore.back();
+    to_explore.pop_back();
+
+    if (t_near >= closest_distance) continue;
+
+    const BVHNode &node = nodes[node_index];
+
+    if (node.is_leaf()) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+        closest_distance = std::min(closest_distance, static_cast<float>(p_intersect(object_indices[i])));
+      }
+      continue;
+    }
+
+    // Visit the closest child first
+    uint32_t first = node.offset + 0;
+    uint32_t second = node.offset + 1;
+    float first_distance = get_entry_distance(nodes[first].aabb);
+    float second_distance = get_entry_distance(nodes[second].aabb);
+    if (second_distance < first_distance) {
+      std::swap(first, second);
+      std::swap(first_distance, second_distance);
+    }
+
+    if (second_distance < closest_distance) {
+      to_explore.push_back({second, second_distance});
+    }
+    if (first_distance < closest_distance) {
+      to_explore.push_back({first, first_distance});
+    }
+  }
+
+  return closest_distance;
+}
+
+
+template<typename F>
+bool ObjectBVH::any_hit(const Ray &p_ray, const float p_max_distance, F &&p_occluded) const {
+  if (nodes.empty()) {
+    return false;
+  }
+
+  const kmath::Vec3 inv_direction = kmath::Vec3::ONE / p_ray.direction;
+
+  // The order of the visit does not matter, any hit stops the traversal
+  auto is_hit = [&](const tputils::AABB &p_aabb) -> bool {
+    const auto [t_near, t_far] = get_aabb_intersection(p_ray.origin, inv_direction, p_aabb);
+    return t_near <= t_far && t_far >= 0.0f && t_near < p_max_distance;
+  };
+
+  tputils::StackVector<uint32_t, MAX_DEPTH + 1> to_explore;
+  if (is_hit(nodes[0].aabb)) {
+    to_explore.push_back(0);
+  }
+
+  while (!to_explore.empty()) {
+    const BVHNode &node = nodes[to_explore.back()];
+    to_explore.pop_back();
+
+    if (node.is_leaf()) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+        if (p_occluded(object_indices[i])) {
+          return true;
+        }
+      }
+      continue;
+    }
+
+    if (is_hit(nodes[node.offset + 1].aabb)) {
+      to_explore.push_back(node.offset + 1);
+    }
+    if (is_hit(nodes[node.offset + 0].aabb)) {
+      to_explore.push_back(node.offset + 0);
+    }
+  }
+
+  return false;
+}
+
+
+
+template<typename F>
+void ObjectBVH::traverse_packet(std::span<const Ray> p_rays, const RayMask p_mask, std::span<const float> p_closest_distances, F &&p_intersect) const {
+  if (nodes.empty() || p_mask == 0) {
+    return;
+  }
+
+  kmath::Vec3 inv_directions[MAX_RAY_PACKET_SIZE];
+  for_each_ray(p_mask, [&](const size_t p_ray_index) {
+    inv_directions[p_ray_index] = kmath::Vec3::ONE / p_rays[p_ray_index].direction;
+  });
+
+  // Returns the distance at which a ray enters the box, or FLT_MAX if it misses it
+  auto get_entry_distance = [&](const size_t p_ray_index, const tputils::AABB &p_aabb) -> float {
+    const auto [t_near, t_far] = get_aabb_intersection(p_rays[p_ray_index].origin, inv_directions[p_ray_index], p_aabb);
+    return (t_near <= t_far && t_far >= 0.0f)? t_near : FLT_MAX;
+  };
+
+  struct ToExplore {
+    uint32_t node_index;
+    RayMask mask;
+  };
+  tputils::StackVector<ToExplore, MAX_DEPTH + 1> to_explore;
+  to_explore.push_back({0, p_mask});
+
+  while (!to_explore.empty()) {
+    const auto [node_index, mask] = to_explore.back();
+    to_explore.pop_back();
+
+    const BVHNode &node = nodes[node_index];
+
+    // The boxes are tested when the node is visited, as the closest hits may have changed since it was pushed
+    RayMask active_mask = 0;
+    for_each_ray(mask, [&](const size_t p_ray_index) {
+      if (get_entry_distance(p_ray_index, node.aabb) < p_closest_distances[p_ray_index]) {
+        active_mask |= RayMask(1) << p_ray_index;
+      }
+    });
+    if (active_mask == 0) continue;
+
+    if (node.is_leaf()) {
+      for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+        p_intersect(object_indices[i], active_mask);
+      }
+      continue;
+    }
+
+    // Visit first the child closest to the first active ray, the rays of a coherent packet mostly agree on it
+    const size_t leading_ray = static_cast<size_t>(std::countr_zero(active_mask));
+    uint32_t first = node.offset + 0;
+    uint32_t second = node.offset + 1;
+    if (get_entry_distance(leading_ray, nodes[second].aabb) < get_entry_distance(leading_ray, nodes[first].aabb)) {
+      std::swap(first, second);
+    }
+
+    to_explore.push_back({second, active_mask});
+    to_explore.push_back({first, active_mask});
+  }
+}
+
+
+template<typename F>
+RayMask ObjectBVH::any_hit_packet(std::span<const Ray> p_rays, const RayMask p_mask, std::span<const float> p_max_distances, F &&p_occluded) const {
+  RayMask occluded_mask = 0;
+  if (nodes.empty() || p_mask == 0) {
+    return occluded_mask;
+  }
+
+  kmath::Vec3 inv_directions[MAX_RAY_PACKET_SIZE];
+  for_each_ray(p_mask, [&](const size_t p_ray_index) {
+    inv_directions[p_ray_index] = kmath::Vec3::ONE / p_rays[p_ray_index].direction;
+  });
+
+  // The order of the visit does not matter, rays leave the traversal as soon as they are occluded
+  struct ToExplore {
+    uint32_t node_index;
+    RayMask mask;
+  };
+  tputils::StackVector<ToExplore, MAX_DEPTH + 1> to_explore;
+  to_explore.push_back({0, p_mask});
+
+  while (!to_explore.empty() && occluded_mask != p_mask) {
+    const RayMask mask = to_explore.back().mask & ~occluded_mask;
+    const BVHNode &node = nodes[to_explore.back().node_index];
+    to_explore.pop_back();
+
+    RayMask active_mask = 0;
+    for_each_ray(mask, [&](const size_t p_ray_index) {
+      const auto [t_near, t_far] = get_aabb_intersection(p_rays[p_ray_index].origin, inv_directions[p_ray_index], node.aabb);
+      if (t_near <= t_far && t_far >= 0.0f && t_near < p_max_distances[p_ray_index]) {
+        active_mask |= RayMask(1) << p_ray_index;
+      }
+    });
+    if (active_mask == 0) continue;
+
+    if (node.is_leaf()) {
+      for (uint32_t i = node.offset; i < node.offset + node.count && (active_mask & ~occluded_mask) != 0; i++) {
+        occluded_mask |= p_occluded(object_indices[i], active_mask & ~occluded_mask);
+      }
+      continue;
+    }
+
+    to_explore.push_back({node.offset + 1, active_mask});
+    to_explore.push_back({node.offset + 0, active_mask});
+  }
+
+  return occluded_mask;
+}
+
+
+std::ostream &operator<<(std::ostream &p_stream, const AccelerationStructureStatistics &p_statistics);
@@ -44,7 +44,7 @@
 #include <variant>
 
 
-typedef std::variant<PointDistribution, UniformBallDistribution, UniformRectangleDistribution> LightDistribution;
+typedef std::variant<PointDistribution, UniformBallDistribution, UniformSphereDistribution, UniformDiskDistribution, UniformRectangleDistribution> LightDistribution;
 
 
 struct LightData {
@@ -37,112 +37,269 @@
 
 #include "mesh.hpp"
 #include "geometry/acceleration_structures.hpp"
+#include "geometry/mesh_cache.hpp"
 #include "geometry/ray.hpp"
 #include "geometry/triangle.hpp"
 #include "thirdparty/kmath/matrix.hpp"
 #include "thirdparty/kmath/vector.hpp"
 #include "tp_utils/src/model_loaders/wavefront_object.hpp"
-#include "tp_utils/src/rendering/immediate_geometry.hpp"
-#include "utils/renderer.hpp"
+#include "utils/thread_pool.hpp"
 
 
 #include <cfloat>
 #include <filesystem>
-
-#include <GL/gl.h>
+#include <functional>
+#include <iostream>
+#include <algorithm>
+#include <bit>
+#include <span>
 #include <unordered_map>
+#include <variant>
 
 
-void Mesh::load_obj(const std::filesystem::path &p_path) {
-  tputils::WavefrontMesh wavefront = tputils::WavefrontMesh::load(p_path);
+// Open addressing map from the (position, normal, uv) indices of a corner of an OBJ face to the index of its vertex,
+// with linear probing. The whole 96 bit key is compared.
+class CornerIndexMap {
+public:
+  // Returns the vertex of the corner, p_new_vertex and true when the corner was not in the map yet
+  std::pair<uint32_t, bool> insert(const uint32_t p_position, const uint32_t p_normal, const uint32_t p_uv, const uint32_t p_new_vertex) {
+    if (2 * (size + 1) > slots.size()) {
+      _rehash(2 * slots.size());
+    }
 
-  // Create vertex data suited for single index buffer for positions, normals and uvs
-  vertex_positions.reserve(sizeof(wavefront.positions[0]) * wavefront.positions.size() / sizeof(float));
-  vertex_normals.reserve(sizeof(wavefront.normals[0]) * wavefront.positions.size() / sizeof(float));
-  vertex_uvs.reserve(sizeof(wavefront.uvs[0]) * wavefront.positions.size() / sizeof(float));
-  uint32_t vertex_count = 0;
+    size_t slot_index = _get_slot_index(p_position, p_normal, p_uv);
+    while (slots[slot_index].vertex != EMPTY) {
+      const Slot &slot = slots[slot_index];
+      if (slot.position == p_position && slot.normal == p_normal && slot.uv == p_uv) {
+        return {slot.vertex, false};
+      }
+      slot_index = (slot_index + 1) & (slots.size() - 1);
+    }
+
+    slots[slot_index] = Slot{p_position, p_normal, p_uv, p_new_vertex};
+    size += 1;
+    return {p_new_vertex, true};
+  }
+
+  // Room for p_expected_size corners without rehashing
+  CornerIndexMap(const size_t p_expected_size) {
+    slots.resize(std::bit_ceil(std::max<size_t>(2 * p_expected_size, 16)), Slot{0, 0, 0, EMPTY});
+  }
+
+private:
+  struct Slot {
+    uint32_t position;
+    uint32_t normal;
+    uint32_t uv;
+    uint32_t vertex;
+  };
+  constexpr static uint32_t EMPTY = UINT32_MAX;
+
+private:
+  inline size_t _get_slot_index(const uint32_t p_position, const uint32_t p_normal, const uint32_t p_uv) const {
+    uint64_t hash = (static_cast<uint64_t>(p_normal) << 32 | p_uv) * 0x9e3779b97f4a7c15;
+    hash = (hash ^ p_position ^ (hash >> 29)) * 0xbf58476d1ce4e5b9;
+    return (hash ^ (hash >> 32)) & (slots.size() - 1);
+  }
+
+  void _rehash(const size_t p_slot_count) {
+    std::vector<Slot> old_slots(p_slot_count, Slot{0, 0, 0, EMPTY});
+    std::swap(slots, old_slots);
+    for (const Slot &slot : old_slots) {
+      if (slot.vertex == EMPTY) continue;
+      size_t slot_index = _get_slot_index(slot.position, slot.normal, slot.uv);
+      while (slots[slot_index].vertex != EMPTY) {
+        slot_index = (slot_index + 1) & (slots.size() - 1);
+      }
+      slots[slot_index] = slot;
+    }
+  }
+
+private:
+  std::vector<Slot> slots; // The slot count is a power of two, at most half of the slots are used
+  size_t size = 0;
+};
+
+
+void Mesh::load_obj(const std::filesystem::path &p_path, const bool p_use_cache) {
+  cache_source_path = (p_use_cache)? p_path : std::filesystem::path();
 
-  std::unordered_map<uint64_t, uint32_t> index_map;
+  const MeshCache cache = (p_use_cache)? MeshCache::open(p_path) : MeshCache();
+  if (cache.is_valid()) {
+    // The vertex arrays are copied, meshes are usually transformed right after being loaded
+    const MeshCache::Geometry geometry = cache.get_geometry();
+    auto copy_floats = [](std::vector<float> &r_floats, const auto &p_elements) -> void {
+      const float *begin = reinterpret_cast<const float*>(p_elements.data());
+      r_floats.assign(begin, begin + p_elements.size_bytes() / sizeof(float));
+    };
+    copy_floats(vertex_positions, geometry.positions);
+    copy_floats(vertex_normals, geometry.normals);
+    copy_floats(vertex_uvs, geometry.uvs);
+    const unsigned int *triangles_begin = reinterpret_cast<const unsigned int*>(geometry.triangles.data());
+    triangle_elements.assign(triangles_begin, triangles_begin + 3 * geometry.triangles.size());
+    std::cout << "Loaded " << p_path << " from " << MeshCache::get_cache_path(p_path) << std::endl;
+    return;
+  }
+
+  // The chunks of large files are parsed on the threads of the pool
+  ThreadPool *pool = ThreadPool::get_singleton();
+  tputils::WavefrontMesh wavefront = tputils::WavefrontMesh::load(p_path, pool->get_thread_count(), [pool](const size_t p_count, const std::function<void(size_t)> &p_function) {
+    parallel_for(0, p_count, [&](const size_t, const size_t p_index) { p_function(p_index); }, 1, pool);
+  });
 
-  size_t object_index_buffer_size = 0;
-  std::vector<uint32_t> object_indices;
+  size_t corner_count = 0;
+  for (const auto &[name, object] : wavefront.objects) {
+    corner_count += object.position_indices.size();
+  }
 
-  for (auto element : wavefront.objects) {
-    tputils::WavefrontObject object = element.second;
+  // Create vertex data suited for single index buffer for positions, normals and uvs.
+  // Most corners share their vertex with others, there are usually about as many vertices as positions.
+  const size_t expected_vertex_count = std::max({wavefront.positions.size(), wavefront.normals.size(), wavefront.uvs.size()});
+  vertex_positions.reserve(3 * expected_vertex_count);
+  vertex_normals.reserve(3 * expected_vertex_count);
+  vertex_uvs.reserve(2 * expected_vertex_count);
+  triangle_elements.reserve(corner_count);
 
-    object_indices.reserve(object.position_indices.size());
-    object_index_buffer_size = 0;
+  CornerIndexMap index_map(expected_vertex_count);
+  uint32_t vertex_count = 0;
 
-    // Build index buffer
+  for (const auto &[name, object] : wavefront.objects) {
     for (size_t i = 0; i < object.position_indices.size(); i++) {
-      uint64_t position_index = object.position_indices[i];
-      uint64_t normal_index = object.normal_indices[i];
-      uint64_t uv_index = object.uv_indices[i];
-
-      // Assume that indices fit in a 16 bit number
-      uint64_t index_id = position_index + (normal_index << 0x10) + (uv_index << 0x20);
-
-      auto mapped_index = index_map.find(index_id);
-      if (mapped_index == index_map.end()) {
-        // Add the new vertex
-        kmath::Vec3 position = wavefront.positions[position_index];
-        kmath::Vec3 normal = wavefront.normals[normal_index];
-        kmath::Vec2 uv = wavefront.uvs[uv_index];
-        vertex_positions.push_back(position.x);
-        vertex_positions.push_back(position.y);
-        vertex_positions.push_back(position.z);
-        vertex_normals.push_back(normal.x);
-        vertex_normals.push_back(normal.y);
-        vertex_normals.push_back(normal.z);
-        vertex_uvs.push_back(uv.x);
-        vertex_uvs.push_back(uv.y);
-
-        if (object_indices.size() > object_index_buffer_size) {
-          object_indices[object_index_buffer_size] = vertex_count;
-        } else {
-          object_indices.push_back(vertex_count);
-        }
-        object_index_buffer_size += 1;
-
-        index_map[index_id] = vertex_count;
+      const uint32_t position_index = object.position_indices[i];
+      const uint32_t normal_index = object.normal_indices[i];
+      const uint32_t uv_index = object.uv_indices[i];
+
+      const auto [vertex_index, inserted] = index_map.insert(position_index, normal_index, uv_index, vertex_count);
+      if (inserted) {
+        const kmath::Vec3 &position = wavefront.positions[position_index];
+        const kmath::Vec3 &normal = wavefront.normals[normal_index];
+        const kmath::Vec2 &uv = wavefront.uvs[uv_index];
+        vertex_positions.insert(vertex_positions.end(), {position.x, position.y, position.z});
+        vertex_normals.insert(vertex_normals.end(), {normal.x, normal.y, normal.z});
+        vertex_uvs.insert(vertex_uvs.end(), {uv.x, uv.y});
         vertex_count += 1;
-      } else {
-        if (object_indices.size() > object_index_buffer_size) {
-          object_indices[object_index_buffer_size] = mapped_index->second;
-        } else {
-          object_indices.push_back(mapped_index->second);
-        }
-        object_index_buffer_size += 1;
       }
+      triangle_elements.push_back(vertex_index);
     }
+  }
 
-    // Create surfaces
-    for (size_t i = 0; i < object_index_buffer_size; i++) {
-      triangle_elements.push_back(object_indices[i]);
+  if (p_use_cache) {
+    MeshCache::write(p_path, MeshCache::Geometry{_get_positions(), _get_normals(), _get_uvs(), _get_triangles()});
+  }
+}
+
+
+void Mesh::build_acceleration_structure(const AccelerationStructureType p_type) {
+  const std::span<const kmath::Vec3i> triangles = _get_triangles();
+  const std::span<const kmath::Vec3> positions = _get_positions();
+  const std::span<const kmath::Vec3> normals = _get_normals();
+  const std::span<const kmath::Vec2> uvs = _get_uvs();
+
+  switch (p_type) {
+  case AccelerationStructureType::KD_TREE: {
+    if (cache_source_path.empty()) {
+      acceleration_structure = KDTree::build_kdtree(triangles, positions, normals, uvs);
+      std::cout << "Built KDTree";
+      break;
+    }
+
+    const uint64_t geometry_hash = MeshCache::hash_geometry(triangles, positions);
+    const MeshCache cache = MeshCache::open(cache_source_path);
+    if (cache.has_kdtree(geometry_hash)) {
+      acceleration_structure = cache.get_kdtree(triangles, positions, normals, uvs);
+      std::cout << "Loaded KDTree from " << MeshCache::get_cache_path(cache_source_path);
+      break;
+    }
+
+    acceleration_structure = KDTree::build_kdtree(triangles, positions, normals, uvs);
+    std::cout << "Built KDTree";
+    // The cache holds the geometry as loaded, which may have been transformed since
+    if (cache.is_valid()) {
+      MeshCache::write(cache_source_path, cache.get_geometry(), &std::get<KDTree>(acceleration_structure.value()), geometry_hash);
     }
+    break;
   }
+  case AccelerationStructureType::BVH:
+    acceleration_structure = BVH::build_bvh(triangles, positions, normals, uvs);
+    std::cout << "Built BVH";
+    break;
+  }
+
+  std::visit([&](const auto &p_structure) -> void {
+    std::cout << p_structure.get_statistics() << " over " << get_triangle_count() << " triangles" << std::endl;
+  }, acceleration_structure.value());
 }
 
 
-void Mesh::build_acceleration_structure() {
-  acceleration_structure = KDTree::build_kdtree(
-    std::span<const kmath::Vec3i>(
-      reinterpret_cast<const kmath::Vec3i*>(triangle_elements.data()),
-      reinterpret_cast<const kmath::Vec3i*>(triangle_elements.data() + triangle_elements.size())
-    ),
-    std::span<const kmath::Vec3>(
-      reinterpret_cast<const kmath::Vec3*>(vertex_positions.data()),
-      reinterpret_cast<const kmath::Vec3*>(vertex_positions.data() + vertex_positions.size())
-    ),
-    std::span<const kmath::Vec3>(
-      reinterpret_cast<const kmath::Vec3*>(vertex_normals.data()),
-      reinterpret_cast<const kmath::Vec3*>(vertex_normals.data() + vertex_normals.size())
-    ),
-    std::span<const kmath::Vec2>(
-      reinterpret_cast<const kmath::Vec2*>(vertex_uvs.data()),
-      reinterpret_cast<const kmath::Vec2*>(vertex_uvs.data() + vertex_uvs.size())
-    )
-  );
+std::optional<AccelerationStructureStatistics> Mesh::get_acceleration_structure_statistics() const {
+  if (!acceleration_structure.has_value()) {
+    return std::optional<AccelerationStructureStatistics>();
+  }
+  return std::visit([](const auto &p_structure) -> AccelerationStructureStatistics {
+    return p_structure.get_statistics();
+  }, acceleration_structure.value());
+}
+
+
+tputils::AABB Mesh::get_aabb() const {
+  if (vertex_positions.empty()) {
+    return tputils::AABB(kmath::Vec3::ZERO, kmath::Vec3::ZERO);
+  }
+
+  tputils::AABB aabb = tputils::AABB(get_position(0), get_position(0));
+  for (size_t i = 1; i < vertex_positions.size() / 3; i++) {
+    aabb.begin = kmath::min(aabb.begin, get_position(i));
+    aabb.end = kmath::max(aabb.end, get_position(i));
+  }
+  return aabb;
+}
+
+
+void Mesh::subdivide() {
+  // The acceleration structure points to the vertex arrays that are about to be reallocated
+  acceleration_structure.reset();
+
+  std::unordered_map<uint64_t, uint32_t> edge_middles;
+  auto get_middle = [&](const uint32_t p_a, const uint32_t p_b) -> uint32_t {
+    const uint64_t edge_id = (static_cast<uint64_t>(std::min(p_a, p_b)) << 32) | std::max(p_a, p_b);
+
+    auto mapped_index = edge_middles.find(edge_id);
+    if (mapped_index != edge_middles.end()) {
+      return mapped_index->second;
+    }
+
+    const uint32_t index = get_vertex_count();
+    const kmath::Vec3 position = 0.5f * (get_position(p_a) + get_position(p_b));
+    const kmath::Vec3 normal = kmath::normalized(get_normal(p_a) + get_normal(p_b));
+    const kmath::Vec2 uv = 0.5f * (get_uv(p_a) + get_uv(p_b));
+    vertex_positions.insert(vertex_positions.end(), {position.x, position.y, position.z});
+    vertex_normals.insert(vertex_normals.end(), {normal.x, normal.y, normal.z});
+    vertex_uvs.insert(vertex_uvs.end(), {uv.x, uv.y});
+
+    edge_middles[edge_id] = index;
+    return index;
+  };
+
+  std::vector<unsigned int> subdivided_elements;
+  subdivided_elements.reserve(4 * triangle_elements.size());
+
+  for (size_t i = 0; i < triangle_elements.size(); i += 3) {
+    const uint32_t a = triangle_elements[i + 0];
+    const uint32_t b = triangle_elements[i + 1];
+    const uint32_t c = triangle_elements[i + 2];
+    const uint32_t ab = get_middle(a, b);
+    const uint32_t bc = get_middle(b, c);
+    const uint32_t ca = get_middle(c, a);
+
+    subdivided_elements.insert(subdivided_elements.end(), {
+      a, ab, ca,
+      ab, b, bc,
+      ca, bc, c,
+      ab, bc, ca,
+    });
+  }
+
+  triangle_elements = std::move(subdivided_elements);
 }
 
 
@@ -225,145 +382,102 @@ void Mesh::rotate_z(const float p_angle_degrees) {
 }
 
 
-void Mesh::draw() const {
-  if( triangle_elements.size() == 0 ) return;
-  // GLfloat material_color[4] = {material.diffuse_material.x,
-  //                              material.diffuse_material.y,
-  //                              material.diffuse_material.z,
-  //                              1.0};
-  // GLfloat material_specular[4] = {material.specular_material.x,
-  //                                 material.specular_material.y,
-  //                                 material.specular_material.z,
-  //                                 1.0};
-  // GLfloat material_ambient[4] = {material.diffuse_material.x,
-  //                                material.diffuse_material.y,
-  //                                material.diffuse_material.z,
-  //                                1.0};
-
-  // glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, material_specular);
-  // glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, material_color);
-  // glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, material_ambient);
-  // glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, material.shininess);
-  // glEnableClientState(GL_VERTEX_ARRAY) ;
-  // glEnableClientState (GL_NORMAL_ARRAY);
-  // glNormalPointer(GL_FLOAT, 3 * sizeof(float), (GLvoid*)(normals_array.data()));
-  // glVertexPointer(3, GL_FLOAT, 3 * sizeof(float) , (GLvoid*)(positions_array.data()));
-  // glDrawElements(GL_TRIANGLES, triangles_array.size(), GL_UNSIGNED_INT, (GLvoid*)(triangles_array.data()));
-
-  Renderer *rd = Renderer::get_singleton();
-  rd->set_model_matrix(kmath::Mat4::IDENTITY);
-  rd->set_color(material.albedo);
-  
-  tputils::ImmediateGeometry &imgeo = rd->immediate_geometry();
-
-  imgeo.begin(tputils::ImmediateGeometry::Mode::TRIANGLES, rd->get_default_buffer_layout());
-  for (const uint32_t &index : triangle_elements) {
-    const kmath::Vec3 position{
-      vertex_positions[3 * index + 0],
-      vertex_positions[3 * index + 1],
-      vertex_positions[3 * index + 2],
-    };
-    imgeo.push_vec3(position);
-    const kmath::Vec3 normal{
-      vertex_normals[3 * index + 0],
-      vertex_normals[3 * index + 1],
-      vertex_normals[3 * index + 2],
-    };
-    imgeo.push_vec3(normal);
-    const kmath::Vec2 uv{
-      vertex_uvs[2 * index + 0],
-      vertex_uvs[2 * index + 1],
-    };
-    imgeo.push_vec2(uv);
-  }
-  imgeo.end();
-
-  if (acceleration_structure.has_value()) {
-    acceleration_structure->draw();
-  }
+RayMeshIntersection Mesh::intersect(const Ray &p_ray) const {
+  TriangleHit closest_hit;
+  _intersect(p_ray, closest_hit);
+  return fetch_shading_data(closest_hit, _get_triangles(), _get_positions(), _get_normals(), _get_uvs());
 }
 
 
-RayMeshIntersection Mesh::intersect(const Ray &p_ray) const {
+bool Mesh::_intersect(const Ray &p_ray, TriangleHit &r_hit) const {
   if (acceleration_structure.has_value()) {
-    return acceleration_structure.value().intersect(p_ray);
+    return std::visit([&](const auto &p_structure) -> bool {
+      return p_structure.intersect(p_ray, r_hit);
+    }, acceleration_structure.value());
   }
-  
-  RayMeshIntersection closest_intersection;
-  closest_intersection.distance = FLT_MAX;
-
-  for (size_t triangle_index = 0; triangle_index < triangle_elements.size(); triangle_index += 3) {
-    const uint32_t index_a = triangle_elements[triangle_index + 0];
-    const kmath::Vec3 point_a{
-      vertex_positions[3 * index_a + 0],
-      vertex_positions[3 * index_a + 1],
-      vertex_positions[3 * index_a + 2],
-    };
-    const uint32_t index_b = triangle_elements[triangle_index + 1];
-    const kmath::Vec3 point_b{
-      vertex_positions[3 * index_b + 0],
-      vertex_positions[3 * index_b + 1],
-      vertex_positions[3 * index_b + 2],
-    };
-    const uint32_t index_c = triangle_elements[triangle_index + 2];
-    const kmath::Vec3 point_c{
-      vertex_positions[3 * index_c + 0],
-      vertex_positions[3 * index_c + 1],
-      vertex_positions[3 * index_c + 2],
-    };
+
+  const std::span<const kmath::Vec3i> triangles = _get_triangles();
+  bool hit = false;
+
+  for (uint32_t triangle_index = 0; triangle_index < triangles.size(); triangle_index++) {
+    const kmath::Vec3i element = triangles[triangle_index];
     const Triangle tri{{
-      point_a, point_b, point_c
+      get_position(element.x),
+      get_position(element.y),
+      get_position(element.z),
     }};
     const auto intersection_opt = get_intersection(p_ray, tri);
     if (!intersection_opt.has_value()) continue;
     const RayTriangleIntersection intersection = intersection_opt.value();
     
-    if (intersection.distance >= closest_intersection.distance) continue;
+    if (intersection.distance >= r_hit.distance) continue;
 
-    const kmath::Vec3 normal_a{
-      vertex_normals[3 * index_a + 0],
-      vertex_normals[3 * index_a + 1],
-      vertex_normals[3 * index_a + 2],
-    };
-    const kmath::Vec3 normal_b{
-      vertex_normals[3 * index_b + 0],
-      vertex_normals[3 * index_b + 1],
-      vertex_normals[3 * index_b + 2],
-    };
-    const kmath::Vec3 normal_c{
-      vertex_normals[3 * index_c + 0],
-      vertex_normals[3 * index_c + 1],
-      vertex_normals[3 * index_c + 2],
-    };
+    r_hit = TriangleHit{triangle_index, intersection.distance, intersection.barycentric};
+    hit = true;
+  }
 
-    const kmath::Vec2 uv_a{
-      vertex_uvs[2 * index_a + 0],
-      vertex_uvs[2 * index_a + 1],
-    };
-    const kmath::Vec2 uv_b{
-      vertex_uvs[2 * index_b + 0],
-      vertex_uvs[2 * index_b + 1],
-    };
-    const kmath::Vec2 uv_c{
-      vertex_uvs[2 * index_c + 0],
-      vertex_uvs[2 * index_c + 1],
-    };
+  return hit;
+}
+
+
+bool Mesh::occluded(const Ray &p_ray, const float p_max_distance) const {
+  if (acceleration_structure.has_value()) {
+    return std::visit([&](const auto &p_structure) -> bool {
+      return p_structure.occluded(p_ray, p_max_distance);
+    }, acceleration_structure.value());
+  }
 
-    closest_intersection.position = intersection.position;
-    closest_intersection.distance = intersection.distance;
-    closest_intersection.normal = kmath::normalized(
-      intersection.barycentric.x * normal_a
-      + intersection.barycentric.y * normal_b
-      + intersection.barycentric.z * normal_c
-    );
-    closest_intersection.uv = (
-      intersection.barycentric.x * uv_a
-      + intersection.barycentric.y * uv_b
-      + intersection.barycentric.z * uv_c
-    );
-    closest_intersection.barycentric = intersection.barycentric;
+  for (const kmath::Vec3i &element : _get_triangles()) {
+    const Triangle tri{{
+      get_position(element.x),
+      get_position(element.y),
+      get_position(element.z),
+    }};
+    const auto intersection_opt = get_intersection(p_ray, tri);
+    if (intersection_opt.has_value() && intersection_opt.value().distance < p_max_distance) {
+      return true;
+    }
   }
 
-  closest_intersection.exists = (closest_intersection.distance != FLT_MAX);
-  return closest_intersection;
+  return false;
+}
+
+
+RayMask Mesh::intersect_packet(std::span<const Ray> p_rays, const RayMask p_mask, std::span<const float> p_max_distances, std::span<RayMeshIntersection> r_intersections) const {
+  TriangleHit hits[MAX_RAY_PACKET_SIZE];
+  for_each_ray(p_mask, [&](const size_t p_ray_index) {
+    hits[p_ray_index].distance = p_max_distances[p_ray_index];
+  });
+
+  RayMask hit_mask = 0;
+  if (acceleration_structure.has_value() && std::holds_alternative<KDTree>(acceleration_structure.value())) {
+    hit_mask = std::get<KDTree>(acceleration_structure.value()).intersect_packet(p_rays, p_mask, hits);
+  } else {
+    for_each_ray(p_mask, [&](const size_t p_ray_index) {
+      if (_intersect(p_rays[p_ray_index], hits[p_ray_index])) {
+        hit_mask |= RayMask(1) << p_ray_index;
+      }
+    });
+  }
+
+  // Shading data is only fetched for the rays that hit
+  for_each_ray(hit_mask, [&](const size_t p_ray_index) {
+    r_intersections[p_ray_index] = fetch_shading_data(hits[p_ray_index], _get_triangles(), _get_positions(), _get_normals(), _get_uvs());
+  });
+  return hit_mask;
+}
+
+
+RayMask Mesh::occluded_packet(std::span<const Ray> p_rays, const RayMask p_mask, std::span<const float> p_max_distances) const {
+  if (acceleration_structure.has_value() && std::holds_alternative<KDTree>(acceleration_structure.value())) {
+    return std::get<KDTree>(acceleration_structure.value()).occluded_packet(p_rays, p_mask, p_max_distances);
+  }
+
+  RayMask occluded_mask = 0;
+  for_each_ray(p_mask, [&](const size_t p_ray_index) {
+    if (occluded(p_rays[p_ray_index], p_max_distances[p_ray_index])) {
+      occluded_mask |= RayMask(1) << p_ray_index;
+    }
+  });
+  return occluded_mask;
 }
@@ -39,10 +39,12 @@
 
 
 #include <filesystem>
+#include <optional>
+#include <span>
+#include <variant>
 #include <vector>
 
 #include "geometry/acceleration_structures.hpp"
-#include "thirdparty/glad/include/glad/glad.h"
 
 #include "thirdparty/kmath/matrix.hpp"
 #include "thirdparty/kmath/vector.hpp"
@@ -69,10 +71,19 @@ public:
   Material material;
 
   // void load_off(const std::string & filename);
-  void load_obj(const std::filesystem::path &p_path);
+  // Loads the mesh from its cache next to p_path when it is up to date, the cache is created otherwise.
+  // Without p_use_cache, the mesh and its acceleration structures are neither read from nor written to the cache.
+  void load_obj(const std::filesystem::path &p_path, const bool p_use_cache = true);
   void recompute_normals();
 
-  void build_acceleration_structure();
+  // Splits every triangle in four, through the middle of its edges.
+  void subdivide();
+
+  // KDTrees of meshes loaded from a file are cached along with the mesh, for the geometry they were built over.
+  void build_acceleration_structure(const AccelerationStructureType p_type = AccelerationStructureType::KD_TREE);
+  std::optional<AccelerationStructureStatistics> get_acceleration_structure_statistics() const;
+
+  tputils::AABB get_aabb() const;
 
   void build_arrays();
 
@@ -121,6 +132,12 @@ public:
   void draw() const;
 
   RayMeshIntersection intersect(const Ray &p_ray) const;
+  bool occluded(const Ray &p_ray, const float p_max_distance) const;
+
+  // Packet versions of `intersect` and `occluded` for the rays of p_mask, only the meshes with a KDTree traverse it
+  // with the whole packet. Hits are only reported for the rays hitting closer than p_max_distances, whose mask is returned.
+  RayMask intersect_packet(std::span<const Ray> p_rays, const RayMask p_mask, std::span<const float> p_max_distances, std::span<RayMeshIntersection> r_intersections) const;
+  RayMask occluded_packet(std::span<const Ray> p_rays, const RayMask p_mask, std::span<const float> p_max_distances) const;
 
   Mesh() = default;
   Mesh(Mesh&&) = default;
@@ -130,12 +147,34 @@ public:
   ~Mesh() = default;
 
 
+private:
+  // Finds the closest triangle hit closer than r_hit.distance, returns whether r_hit was updated
+  bool _intersect(const Ray &p_ray, TriangleHit &r_hit) const;
+
+  inline std::span<const kmath::Vec3i> _get_triangles() const {
+    return std::span<const kmath::Vec3i>(reinterpret_cast<const kmath::Vec3i*>(triangle_elements.data()), triangle_elements.size() / 3);
+  }
+
+  inline std::span<const kmath::Vec3> _get_positions() const {
+    return std::span<const kmath::Vec3>(reinterpret_cast<const kmath::Vec3*>(vertex_positions.data()), vertex_positions.size() / 3);
+  }
+
+  inline std::span<const kmath::Vec3> _get_normals() const {
+    return std::span<const kmath::Vec3>(reinterpret_cast<const kmath::Vec3*>(vertex_normals.data()), vertex_normals.size() / 3);
+  }
+
+  inline std::span<const kmath::Vec2> _get_uvs() const {
+    return std::span<const kmath::Vec2>(reinterpret_cast<const kmath::Vec2*>(vertex_uvs.data()), vertex_uvs.size() / 2);
+  }
+
+
 private:
   std::vector<float> vertex_positions;
   std::vector<float> vertex_normals;
   std::vector<float> vertex_uvs;
   std::vector<unsigned int> triangle_elements;
 
-  std::optional<KDTree> acceleration_structure;
+  std::optional<std::variant<KDTree, BVH>> acceleration_structure;
+  std::filesystem::path cache_source_path; // File the mesh was loaded from, empty when it has no cache
 };
 
@@ -0,0 +1,306 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+#include "mesh_cache.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+#include <type_traits>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// Bump when the layout of the file or of the KDTree data changes, or when meshes are loaded differently
+constexpr uint32_t MESH_CACHE_VERSION = 2;
+constexpr char MESH_CACHE_MAGIC[8] = {'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H'};
+// Sections start on a cache line, which also satisfies the alignment of every stored type
+constexpr size_t SECTION_ALIGNMENT = 64;
+
+
+struct MeshCache::Section {
+  uint64_t offset; // From the start of the file
+  uint64_t size;   // In bytes
+};
+
+
+struct MeshCache::Header {
+  char magic[8];
+  uint32_t version;
+  // Layout of the KDTree data, so that builds with another packet width discard the cache
+  uint32_t kdtree_node_size;
+  uint32_t kdtree_packet_size;
+  uint32_t kdtree_packet_width;
+
+  // Source the cache was created from
+  uint64_t source_size;
+  int64_t source_modification_time;
+  uint64_t source_hash;
+
+  Section positions;
+  Section normals;
+  Section uvs;
+  Section triangles;
+
+  uint64_t has_kdtree;
+  uint64_t kdtree_geometry_hash;
+  Section kdtree_nodes;
+  Section kdtree_triangle_indices;
+  Section kdtree_leaf_packets;
+  tputils::AABB kdtree_aabb;
+  AccelerationStructureStatistics kdtree_statistics;
+};
+static_assert(std::is_trivially_copyable_v<AccelerationStructureStatistics>);
+
+
+static bool get_source_identity(const std::filesystem::path &p_source_path, uint64_t &r_size, int64_t &r_modification_time) {
+  std::error_code error;
+  r_size = std::filesystem::file_size(p_source_path, error);
+  if (error) return false;
+  r_modification_time = static_cast<int64_t>(std::filesystem::last_write_time(p_source_path, error).time_since_epoch().count());
+  return !error;
+}
+
+
+static uint64_t hash_source(const std::filesystem::path &p_source_path) {
+  const tputils::MappedFile source(p_source_path, tputils::MappedFile::Access::SEQUENTIAL);
+  return tputils::hash_bytes(source.data(), source.size());
+}
+
+
+template<typename T>
+std::span<const T> MeshCache::_get_section(const Section &p_section) const {
+  return std::span<const T>(reinterpret_cast<const T*>(file->data() + p_section.offset), p_section.size / sizeof(T));
+}
+
+
+MeshCache::Geometry MeshCache::get_geometry() const {
+  return Geometry{
+    .positions = _get_section<kmath::Vec3>(header->positions),
+    .normals = _get_section<kmath::Vec3>(header->normals),
+    .uvs = _get_section<kmath::Vec2>(header->uvs),
+    .triangles = _get_section<kmath::Vec3i>(header->triangles),
+  };
+}
+
+
+bool MeshCache::has_kdtree(const uint64_t p_geometry_hash) const {
+  return is_valid() && header->has_kdtree && header->kdtree_geometry_hash == p_geometry_hash;
+}
+
+
+KDTree MeshCache::get_kdtree(std::span<const kmath::Vec3i> p_triangles, std::span<const kmath::Vec3> p_positions, std::span<const kmath::Vec3> p_normals, std::span<const kmath::Vec2> p_uvs) const {
+  KDTree tree;
+  tree.triangle_elements = p_triangles;
+  tree.vertex_positions = p_positions;
+  tree.vertex_normals = p_normals;
+  tree.vertex_uvs = p_uvs;
+  tree.nodes = MappedArray<KDTree::Node>(file, _get_section<KDTree::Node>(header->kdtree_nodes));
+  tree.triangle_indices = MappedArray<uint32_t>(file, _get_section<uint32_t>(header->kdtree_triangle_indices));
+  tree.leaf_packets = MappedArray<TrianglePacket>(file, _get_section<TrianglePacket>(header->kdtree_leaf_packets));
+  tree.aabb = header->kdtree_aabb;
+  tree.statistics = header->kdtree_statistics;
+  return tree;
+}
+
+
+uint64_t MeshCache::hash_geometry(std::span<const kmath::Vec3i> p_triangles, std::span<const kmath::Vec3> p_positions) {
+  const uint64_t triangles_hash = tputils::hash_bytes(p_triangles.data(), p_triangles.size_bytes());
+  return tputils::hash_bytes(p_positions.data(), p_positions.size_bytes(), triangles_hash);
+}
+
+
+std::filesystem::path MeshCache::get_cache_path(const std::filesystem::path &p_source_path) {
+  std::filesystem::path cache_path = p_source_path;
+  cache_path += ".meshcache";
+  return cache_path;
+}
+
+
+MeshCache MeshCache::open(const std::filesystem::path &p_source_path) {
+  MeshCache cache;
+
+  uint64_t source_size;
+  int64_t source_modification_time;
+  if (!get_source_identity(p_source_path, source_size, source_modification_time)) {
+    return cache;
+  }
+
+  // No access hint: the geometry is copied in order, but the KDTree is read in place in any order for the whole render
+  std::shared_ptr<const tputils::MappedFile> file = std::make_shared<const tputils::MappedFile>(get_cache_path(p_source_path), tputils::MappedFile::Access::NORMAL);
+  if (!file->is_valid() || file->size() < sizeof(Header)) {
+    return cache;
+  }
+
+  const Header *header = reinterpret_cast<const Header*>(file->data());
+  const bool same_layout = std::memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) == 0
+    && header->version == MESH_CACHE_VERSION
+    && header->kdtree_node_size == sizeof(KDTree::Node)
+    && header->kdtree_packet_size == sizeof(TrianglePacket)
+    && header->kdtree_packet_width == TRIANGLE_PACKET_WIDTH;
+  if (!same_layout || header->source_size != source_size) {
+    return cache;
+  }
+
+  // Copying or checking out a file changes its modification time, not its content
+  if (header->source_modification_time != source_modification_time && header->source_hash != hash_source(p_source_path)) {
+    return cache;
+  }
+
+  // Guard against truncated files
+  auto is_in_file = [&](const Section &p_section, const size_t p_element_size) -> bool {
+    return p_section.offset % SECTION_ALIGNMENT == 0
+      && p_section.size % p_element_size == 0
+      && p_section.offset <= file->size()
+      && p_section.size <= file->size() - p_section.offset;
+  };
+  bool sections_valid = is_in_file(header->positions, sizeof(kmath::Vec3))
+    && is_in_file(header->normals, sizeof(kmath::Vec3))
+    && is_in_file(header->uvs, sizeof(kmath::Vec2))
+    && is_in_file(header->triangles, sizeof(kmath::Vec3i));
+  if (header->has_kdtree) {
+    sections_valid = sections_valid
+      && is_in_file(header->kdtree_nodes, sizeof(KDTree::Node))
+      && is_in_file(header->kdtree_triangle_indices, sizeof(uint32_t))
+      && is_in_file(header->kdtree_leaf_packets, sizeof(TrianglePacket));
+  }
+  if (!sections_valid) {
+    return cache;
+  }
+
+  cache.file = std::move(file);
+  cache.header = header;
+  return cache;
+}
+
+
+bool MeshCache::write(const std::filesystem::path &p_source_path, const Geometry &p_geometry, const KDTree *p_kdtree, const uint64_t p_geometry_hash) {
+  Header header;
+  std::memset(static_cast<void*>(&header), 0, sizeof(Header)); // Deterministic padding bytes
+  std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+  header.version = MESH_CACHE_VERSION;
+  header.kdtree_node_size = sizeof(KDTree::Node);
+  header.kdtree_packet_size = sizeof(TrianglePacket);
+  header.kdtree_packet_width = TRIANGLE_PACKET_WIDTH;
+
+  if (!get_source_identity(p_source_path, header.source_size, header.source_modification_time)) {
+    return false;
+  }
+  header.source_hash = hash_source(p_source_path);
+
+  // Lay out the sections one after the other
+  struct SectionData {
+    Section &section;
+    const void *data;
+    size_t size;
+  };
+  std::vector<SectionData> sections = {
+    {header.positions, p_geometry.positions.data(), p_geometry.positions.size_bytes()},
+    {header.normals, p_geometry.normals.data(), p_geometry.normals.size_bytes()},
+    {header.uvs, p_geometry.uvs.data(), p_geometry.uvs.size_bytes()},
+    {header.triangles, p_geometry.triangles.data(), p_geometry.triangles.size_bytes()},
+  };
+  if (p_kdtree) {
+    header.has_kdtree = 1;
+    header.kdtree_geometry_hash = p_geometry_hash;
+    header.kdtree_aabb = p_kdtree->aabb;
+    header.kdtree_statistics = p_kdtree->statistics;
+    sections.push_back({header.kdtree_nodes, p_kdtree->nodes.data(), p_kdtree->nodes.size() * sizeof(KDTree::Node)});
+    sections.push_back({header.kdtree_triangle_indices, p_kdtree->triangle_indices.data(), p_kdtree->triangle_indices.size() * sizeof(uint32_t)});
+    sections.push_back({header.kdtree_leaf_packets, p_kdtree->leaf_packets.data(), p_kdtree->leaf_packets.size() * sizeof(TrianglePacket)});
+  }
+
+  auto align = [](const size_t p_offset) -> size_t {
+    return (p_offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+  };
+  size_t offset = align(sizeof(Header));
+  for (SectionData &section_data : sections) {
+    section_data.section = Section{offset, section_data.size};
+    offset = align(offset + section_data.size);
+  }
+
+  // Write a temporary file and move it over the cache, the previous cache stays readable through its existing mappings.
+  // Each writer gets its own temporary file, processes writing the cache of the same mesh do not clobber each other.
+  const std::filesystem::path cache_path = get_cache_path(p_source_path);
+  std::string temporary_name = cache_path.string() + ".tmp.XXXXXX";
+  const int temporary_file = mkstemp(temporary_name.data());
+  if (temporary_file == -1) {
+    std::cout << "Could not write mesh cache " << cache_path << std::endl;
+    return false;
+  }
+  fchmod(temporary_file, 0644); // mkstemp only lets the owner read, other users share the cache
+  close(temporary_file);
+  const std::filesystem::path temporary_path = temporary_name;
+
+  {
+    std::ofstream stream(temporary_path, std::ios::binary | std::ios::trunc);
+    if (!stream.is_open()) {
+      std::filesystem::remove(temporary_path);
+      std::cout << "Could not write mesh cache " << cache_path << std::endl;
+      return false;
+    }
+
+    const char padding[SECTION_ALIGNMENT] = {};
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    size_t position = sizeof(Header);
+    for (const SectionData &section_data : sections) {
+      stream.write(padding, section_data.section.offset - position);
+      stream.write(static_cast<const char*>(section_data.data), section_data.size);
+      position = section_data.section.offset + section_data.size;
+    }
+
+    if (!stream.good()) {
+      std::cout << "Could not write mesh cache " << cache_path << std::endl;
+      stream.close();
+      std::filesystem::remove(temporary_path);
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporary_path, cache_path, error);
+  if (error) {
+    std::cout << "Could not write mesh cache " << cache_path << ": " << error.message() << std::endl;
+    std::filesystem::remove(temporary_path, error);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,99 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+#pragma once
+
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+
+#include "geometry/acceleration_structures.hpp"
+#include "thirdparty/kmath/vector.hpp"
+#include "tp_utils/src/utils.hpp"
+
+
+// Binary cache of a mesh loaded from a source file, stored next to it. It holds the deduplicated vertex arrays and the
+// KDTree last built over the mesh, so that large assets do not need to be parsed and partitioned again at startup.
+// The file is mapped in memory, the cached KDTree points straight into it.
+// The cache is out of date when the size of the source changes, or when its modification time and content hash both
+// do. It uses the byte order and struct layouts of the machine that wrote it, other machines discard it.
+class MeshCache {
+public:
+  struct Geometry {
+    std::span<const kmath::Vec3> positions;
+    std::span<const kmath::Vec3> normals;
+    std::span<const kmath::Vec2> uvs;
+    std::span<const kmath::Vec3i> triangles;
+  };
+
+public:
+  inline bool is_valid() const { return header != nullptr; }
+
+  Geometry get_geometry() const;
+
+  // Whether the cache holds a KDTree built over the geometry whose hash is p_geometry_hash.
+  bool has_kdtree(const uint64_t p_geometry_hash) const;
+  // The cached KDTree, whose nodes and leaves stay in the cache file. The geometry should be the one it was built over.
+  KDTree get_kdtree(std::span<const kmath::Vec3i> p_triangles, std::span<const kmath::Vec3> p_positions, std::span<const kmath::Vec3> p_normals, std::span<const kmath::Vec2> p_uvs) const;
+
+  // Identifies the geometry a KDTree is built over
+  static uint64_t hash_geometry(std::span<const kmath::Vec3i> p_triangles, std::span<const kmath::Vec3> p_positions);
+
+  static std::filesystem::path get_cache_path(const std::filesystem::path &p_source_path);
+
+  // Opens the cache of p_source_path, the result is invalid when there is none or when it is out of date.
+  static MeshCache open(const std::filesystem::path &p_source_path);
+
+  // Writes the cache of p_source_path, with an optional KDTree built over the geometry whose hash is p_geometry_hash.
+  // The geometry may point into an opened cache of the same source, it is replaced without disturbing its mapping.
+  // Returns false when the cache could not be written.
+  static bool write(const std::filesystem::path &p_source_path, const Geometry &p_geometry, const KDTree *p_kdtree = nullptr, const uint64_t p_geometry_hash = 0);
+
+private:
+  struct Section;
+  struct Header;
+
+  template<typename T>
+  std::span<const T> _get_section(const Section &p_section) const;
+
+private:
+  std::shared_ptr<const tputils::MappedFile> file;
+  const Header *header = nullptr;
+};
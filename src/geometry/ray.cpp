@@ -39,6 +39,8 @@
 
 #include "thirdparty/kmath/print.hpp"
 #include "thirdparty/kmath/vector.hpp"
+#include <algorithm>
+#include <cmath>
 #include <limits>
 
 
@@ -73,6 +75,27 @@ kmath::Vec3 reflect(const kmath::Vec3 &p_direction, const kmath::Vec3 &p_normal)
 }
 
 
+bool refract(const kmath::Vec3 &p_direction, const kmath::Vec3 &p_normal, const float p_eta, kmath::Vec3 &r_direction) {
+  const float cos_incident = -kmath::dot(p_direction, p_normal);
+  const float sin2_transmitted = p_eta * p_eta * (1.0f - cos_incident * cos_incident);
+  if (sin2_transmitted > 1.0f) {
+    return false;
+  }
+  const float cos_transmitted = std::sqrt(1.0f - sin2_transmitted);
+  r_direction = p_eta * p_direction + (p_eta * cos_incident - cos_transmitted) * p_normal;
+  return true;
+}
+
+
+float get_schlick_reflectance(const float p_cos_angle, const float p_incident_index, const float p_transmitted_index) {
+  const float r0_sqrt = (p_incident_index - p_transmitted_index) / (p_incident_index + p_transmitted_index);
+  const float r0 = r0_sqrt * r0_sqrt;
+  const float x = 1.0f - std::clamp(p_cos_angle, 0.0f, 1.0f);
+  const float x2 = x * x;
+  return r0 + (1.0f - r0) * x2 * x2 * x;
+}
+
+
 std::ostream &operator<<(std::ostream &p_stream, const Ray &p_ray) {
   p_stream << "Line(" << p_ray.origin << ", " << p_ray.direction << ")";
   return p_stream;
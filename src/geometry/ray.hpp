@@ -38,7 +38,10 @@
 #pragma once
 
 
+#include <bit>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <ostream>
 
 #include "thirdparty/kmath/vector.hpp"
@@ -123,10 +126,37 @@ public:
 };
 
 
+// Rays traced together are identified by their index in the packet, masks hold one bit per ray.
+constexpr size_t MAX_RAY_PACKET_SIZE = 64;
+typedef uint64_t RayMask;
+
+
+inline RayMask get_ray_mask(const size_t p_ray_count) {
+  return (p_ray_count >= MAX_RAY_PACKET_SIZE)? ~RayMask(0) : (RayMask(1) << p_ray_count) - 1;
+}
+
+
+// Calls p_function with the index of every ray of p_mask, in increasing order
+template<typename F>
+inline void for_each_ray(RayMask p_mask, F &&p_function) {
+  while (p_mask != 0) {
+    p_function(static_cast<size_t>(std::countr_zero(p_mask)));
+    p_mask &= p_mask - 1;
+  }
+}
+
+
 // Project p_point onto p_line
 kmath::Vec3 project(const kmath::Vec3 &p_point, const Ray &p_ray); // TODO: implement
 // Reflect p_direction given the normal p_normal
 kmath::Vec3 reflect(const kmath::Vec3 &p_direction, const kmath::Vec3 &p_normal);
+// Refract the unit vector p_direction through a surface of unit normal p_normal facing it, following Snell's law.
+// p_eta is the refractive index of the incident medium over the one of the transmitted medium. Returns false on total
+// internal reflection, r_direction being left untouched.
+bool refract(const kmath::Vec3 &p_direction, const kmath::Vec3 &p_normal, const float p_eta, kmath::Vec3 &r_direction);
+// Schlick's approximation of the Fresnel reflectance, p_cos_angle being the cosine of the angle with the normal on the
+// side of the less refractive medium
+float get_schlick_reflectance(const float p_cos_angle, const float p_incident_index, const float p_transmitted_index);
 
 // Returns the orthogonal distance between p_point and p_line
 float distance_squared(const kmath::Vec3 &p_point, const Ray &p_ray); // TODO: implement
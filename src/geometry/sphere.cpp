@@ -37,34 +37,43 @@
 
 #include "sphere.hpp"
 
+#include <cmath>
+#include <optional>
 
-RaySphereIntersection Sphere::intersect(const Ray &p_ray) const {
-  RaySphereIntersection intersection;
-  const kmath::Vec3 alpha = center - p_ray.origin;
+
+// Returns the distance to the first hit of the ray with the sphere
+static std::optional<float> get_hit_distance(const Ray &p_ray, const kmath::Vec3 &p_center, const float p_radius) {
+  const kmath::Vec3 alpha = p_center - p_ray.origin;
   const float a = kmath::length_squared(p_ray.direction);
   const float b = 2.0f * kmath::dot(alpha, p_ray.direction);
-  const float c = kmath::length_squared(alpha) - radius * radius;
+  const float c = kmath::length_squared(alpha) - p_radius * p_radius;
   const float delta = b * b - 4.0f * a * c;
 
   if (delta < 0) { // The sphere is not hit
-    return intersection;
+    return std::optional<float>();
   }
 
   const float sqrt_delta = std::sqrt(delta);
   const float x1a = b - sqrt_delta;
 
-  float dist = 0.0f;
-
   if (x1a < 0.0) { // The collision is behind the ray, either we're in the sphere, or the sphere's behind us
     const float x2a = b + sqrt_delta;
-    if (x2a < 0.0) return intersection; // The sphere is behind the ray, no hit
-    dist = 0.5f * x2a / a;
-  } else {
-    dist = 0.5f * x1a / a;
+    if (x2a < 0.0) return std::optional<float>(); // The sphere is behind the ray, no hit
+    return 0.5f * x2a / a;
+  }
+  return 0.5f * x1a / a;
+}
+
+
+RaySphereIntersection Sphere::intersect(const Ray &p_ray) const {
+  RaySphereIntersection intersection;
+  const std::optional<float> dist = get_hit_distance(p_ray, center, radius);
+  if (!dist.has_value()) {
+    return intersection;
   }
 
-  kmath::Vec3 pos = p_ray.origin + dist * p_ray.direction;
-  intersection.distance = dist;
+  kmath::Vec3 pos = p_ray.origin + dist.value() * p_ray.direction;
+  intersection.distance = dist.value();
   intersection.position = pos;
   intersection.normal = kmath::normalized(pos - center);
   // TODO: calculate uv component
@@ -74,3 +83,14 @@ RaySphereIntersection Sphere::intersect(const Ray &p_ray) const {
 }
 
 
+bool Sphere::occluded(const Ray &p_ray, const float p_max_distance) const {
+  const std::optional<float> dist = get_hit_distance(p_ray, center, radius);
+  return dist.has_value() && dist.value() < p_max_distance;
+}
+
+
+tputils::AABB Sphere::get_aabb() const {
+  return tputils::AABB(center - radius * kmath::Vec3::ONE, center + radius * kmath::Vec3::ONE);
+}
+
+
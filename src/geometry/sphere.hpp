@@ -39,6 +39,7 @@
 
 #include "material.hpp"
 #include "thirdparty/kmath/vector.hpp"
+#include "tp_utils/src/data_structures/aabb.hpp"
 
 #include "ray.hpp"
 
@@ -50,6 +51,8 @@ struct Sphere {
 
 public:
   RaySphereIntersection intersect(const Ray &p_ray) const;
+  bool occluded(const Ray &p_ray, const float p_max_distance) const;
+  tputils::AABB get_aabb() const;
 
   Sphere() = default;
   Sphere(const kmath::Vec3 &p_center, const float r);
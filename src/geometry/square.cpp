@@ -86,6 +86,32 @@ RaySquareIntersection Square::intersect(const Ray &p_ray) const {
 }
 
 
+bool Square::occluded(const Ray &p_ray, const float p_max_distance) const {
+  const Plane3 plane = Plane3::plane(normal, dot(normal, bottom_left));
+  const std::optional<Vec3> intersection_point_opt = get_intersection(p_ray, plane);
+  if (!intersection_point_opt.has_value()) return false;
+
+  const Vec3 local_intersection = intersection_point_opt.value() - bottom_left;
+  const float right = dot(right_vector, local_intersection);
+  const float up = dot(up_vector, local_intersection);
+  if (right < 0.0f || right > size.x || up < 0.0f || up > size.y) return false;
+
+  return distance_squared(p_ray.origin, intersection_point_opt.value()) < p_max_distance * p_max_distance;
+}
+
+
+tputils::AABB Square::get_aabb() const {
+  const Vec3 right = size.x * right_vector;
+  const Vec3 up = size.y * up_vector;
+  const Vec3 begin = min(min(bottom_left, bottom_left + right), min(bottom_left + up, bottom_left + right + up));
+  const Vec3 end = max(max(bottom_left, bottom_left + right), max(bottom_left + up, bottom_left + right + up));
+
+  // Squares are flat, pad the box so that it keeps a volume when they are axis aligned
+  constexpr float PADDING = 1e-4f;
+  return tputils::AABB(begin - PADDING * Vec3::ONE, end + PADDING * Vec3::ONE);
+}
+
+
 void Square::translate(const Vec3 &p_translation) {
   bottom_left += p_translation;
 }
@@ -41,6 +41,7 @@
 #include "material.hpp"
 #include "thirdparty/kmath/matrix.hpp"
 #include "thirdparty/kmath/vector.hpp"
+#include "tp_utils/src/data_structures/aabb.hpp"
 
 #include <cmath>
 
@@ -58,6 +59,8 @@ struct Square {
 public:
   void set_quad(const kmath::Vec3 &p_bottom_left, const kmath::Vec3 &p_right_vector, const kmath::Vec3 &p_up_vector, const kmath::Vec2 &p_size = kmath::Vec2::ONE, const kmath::Vec2 &p_uv_min = kmath::Vec2::ZERO, const kmath::Vec2 &p_uv_max = kmath::Vec2::ZERO);
   RaySquareIntersection intersect(const Ray &p_ray) const;
+  bool occluded(const Ray &p_ray, const float p_max_distance) const;
+  tputils::AABB get_aabb() const;
 
   void translate(const kmath::Vec3 &p_translation);
   void scale(const kmath::Vec3 &p_scale);
@@ -2,9 +2,7 @@
 
 #include <optional>
 
-#include "geometry/plane.hpp"
 #include "geometry/ray.hpp"
-#include "thirdparty/kmath/euclidian_flat_3d.hpp"
 #include "thirdparty/kmath/vector.hpp"
 
 
@@ -25,32 +23,5 @@ Vec2 get_coordinates(const kmath::Vec3 &p_point, const kmath::Vec3 &p_a, const k
 
 
 std::optional<RayTriangleIntersection> get_intersection(const Ray &p_ray, const Triangle &p_triangle) {
-  const Vec3 a = p_triangle.points[1] - p_triangle.points[0];
-  const Vec3 b = p_triangle.points[2] - p_triangle.points[0];
-  const Vec3 normal = cross(a, b);
-
-  const Plane3 plane = Plane3::plane(normal, 0.0);
-  const Ray ray = Ray(p_ray.origin - p_triangle.points[0], p_ray.direction);
-
-  const std::optional<Vec3> plane_intersection = get_intersection(ray, plane);
-  if (!plane_intersection.has_value()) return std::optional<RayTriangleIntersection>();
-
-  const Vec3 local_intersection = plane_intersection.value();
-
-  const Vec2 tri_coord = get_coordinates(local_intersection, a, b);
-  const float coord_sum = tri_coord.x + tri_coord.y;
-
-  if (tri_coord.x < 0.0 || tri_coord.y < 0.0 || coord_sum > 1.0) return std::optional<RayTriangleIntersection>();
-
-  RayTriangleIntersection intersection;
-
-  intersection.position = local_intersection + p_triangle.points[0];
-  intersection.barycentric = Vec3(
-    1.0f - coord_sum,
-    tri_coord.x,
-    tri_coord.y
-  );
-  intersection.distance = distance(local_intersection, ray.origin);
-
-  return intersection;
+  return get_intersection(p_ray, PrecomputedTriangle(p_triangle.points[0], p_triangle.points[1], p_triangle.points[2]));
 }
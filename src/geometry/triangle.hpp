@@ -40,27 +40,91 @@
 
 #include "geometry/ray.hpp"
 #include "thirdparty/kmath/vector.hpp"
+#include <cfloat>
+#include <cstdint>
 #include <optional>
 
 
 struct RayTriangleIntersection {
-  kmath::Vec3 position;
   kmath::Vec3 barycentric;
   float distance;
 };
 
 
+// Closest triangle hit found while traversing a mesh. The vertex attributes are only interpolated for the final hit,
+// by `fetch_shading_data`.
+struct TriangleHit {
+  uint32_t triangle_index = UINT32_MAX;
+  float distance = FLT_MAX;
+  kmath::Vec3 barycentric;
+
+public:
+  inline bool exists() const { return triangle_index != UINT32_MAX; }
+};
+
+
 struct Triangle {
   kmath::Vec3 points[3];
 };
 
 
+// Triangle stored as one vertex and the two edges leaving it, the form the intersection kernel works on.
+// Acceleration structures keep their triangles in this form to avoid gathering the vertices at every test.
+struct PrecomputedTriangle {
+  kmath::Vec3 origin;
+  kmath::Vec3 edge_1;
+  kmath::Vec3 edge_2;
+
+public:
+  PrecomputedTriangle() = default;
+  inline PrecomputedTriangle(const kmath::Vec3 &p_a, const kmath::Vec3 &p_b, const kmath::Vec3 &p_c): origin(p_a), edge_1(p_b - p_a), edge_2(p_c - p_a) {}
+};
+
+
 // Returns (lambda_1, lambda_2) such that p_point = lambda_1 * p_a + lambda_2 * p_b
 kmath::Vec2 get_coordinates(const kmath::Vec3 &p_point, const kmath::Vec3 &p_a, const kmath::Vec3 &p_b);
 
 std::optional<RayTriangleIntersection> get_intersection(const Ray &p_ray, const Triangle &p_triangle);
 
 
+// Möller–Trumbore intersection, only front faces (counter-clockwise seen from the ray origin) are hit.
+// The edge tests are done before the division by the determinant and include the edges, and there is no threshold
+// depending on the size of the triangle.
+inline std::optional<RayTriangleIntersection> get_intersection(const Ray &p_ray, const PrecomputedTriangle &p_triangle) {
+  const kmath::Vec3 p = kmath::cross(p_ray.direction, p_triangle.edge_2);
+  const float determinant = kmath::dot(p_triangle.edge_1, p);
+  if (!(determinant > 0.0f)) { // Back face, parallel ray, or degenerate triangle
+    return std::optional<RayTriangleIntersection>();
+  }
+
+  const kmath::Vec3 origin_offset = p_ray.origin - p_triangle.origin;
+  const float u = kmath::dot(origin_offset, p);
+  if (u < 0.0f || u > determinant) {
+    return std::optional<RayTriangleIntersection>();
+  }
+
+  const kmath::Vec3 q = kmath::cross(origin_offset, p_triangle.edge_1);
+  const float v = kmath::dot(p_ray.direction, q);
+  if (v < 0.0f || u + v > determinant) {
+    return std::optional<RayTriangleIntersection>();
+  }
+
+  const float t = kmath::dot(p_triangle.edge_2, q);
+  if (t < 0.0f) { // The triangle is behind the ray
+    return std::optional<RayTriangleIntersection>();
+  }
+
+  const float inv_determinant = 1.0f / determinant;
+  const float b1 = u * inv_determinant;
+  const float b2 = v * inv_determinant;
+
+  RayTriangleIntersection intersection;
+  intersection.barycentric = kmath::Vec3(1.0f - b1 - b2, b1, b2);
+  intersection.distance = t * inv_determinant; // Rays have a normalized direction
+  return intersection;
+}
+
+
 // class Triangle {
 // private:
 //     Vec3 m_c[3] , m_normal;
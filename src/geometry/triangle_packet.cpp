@@ -0,0 +1,451 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+#include "triangle_packet.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#include "thirdparty/kmath/vector.hpp"
+
+#if defined(__x86_64__)
+#define TRIANGLE_PACKET_X86
+#include <immintrin.h>
+#endif
+
+
+using namespace kmath;
+
+
+TrianglePacket::TrianglePacket() {
+  std::memset(this, 0, sizeof(TrianglePacket));
+}
+
+
+void TrianglePacket::set(const size_t p_lane, const PrecomputedTriangle &p_triangle) {
+  for (size_t axis = 0; axis < 3; axis++) {
+    origin[axis][p_lane] = p_triangle.origin[axis];
+    edge_1[axis][p_lane] = p_triangle.edge_1[axis];
+    edge_2[axis][p_lane] = p_triangle.edge_2[axis];
+  }
+}
+
+
+// =================
+// = Hit selection =
+// =================
+
+// Results of the test of up to two packets, every kernel fills them with the same values. The hit selection is shared
+// so that it does not depend on the kernel.
+struct LaneResults {
+  float distance[2 * TRIANGLE_PACKET_WIDTH];
+  float u[2 * TRIANGLE_PACKET_WIDTH];
+  float v[2 * TRIANGLE_PACKET_WIDTH];
+  float determinant[2 * TRIANGLE_PACKET_WIDTH];
+};
+
+
+// p_mask has a bit set for every lane whose triangle is hit. Lanes are visited in order and only a strictly closer
+// hit replaces the current one, as when testing the triangles one by one.
+static bool select_closest(uint32_t p_mask, const LaneResults &p_lanes, const uint32_t p_first_index, TriangleHit &r_hit) {
+  bool found = false;
+  for (uint32_t lane = 0; p_mask != 0; lane++, p_mask >>= 1) {
+    if (!(p_mask & 1) || !(p_lanes.distance[lane] < r_hit.distance)) continue;
+
+    const float inv_determinant = 1.0f / p_lanes.determinant[lane];
+    const float b1 = p_lanes.u[lane] * inv_determinant;
+    const float b2 = p_lanes.v[lane] * inv_determinant;
+    r_hit = TriangleHit{p_first_index + lane, p_lanes.distance[lane], Vec3(1.0f - b1 - b2, b1, b2)};
+    found = true;
+  }
+  return found;
+}
+
+
+static bool select_any(uint32_t p_mask, const LaneResults &p_lanes, const float p_max_distance) {
+  for (uint32_t lane = 0; p_mask != 0; lane++, p_mask >>= 1) {
+    if ((p_mask & 1) && p_lanes.distance[lane] < p_max_distance) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+// ==========
+// = Scalar =
+// ==========
+
+// Same operations, in the same order, as the vector kernels.
+static uint32_t test_packet_scalar(const Ray &p_ray, const TrianglePacket &p_packet, LaneResults &r_lanes) {
+  const Vec3 &d = p_ray.direction;
+  uint32_t mask = 0;
+
+  for (size_t lane = 0; lane < TRIANGLE_PACKET_WIDTH; lane++) {
+    const float e1x = p_packet.edge_1[0][lane], e1y = p_packet.edge_1[1][lane], e1z = p_packet.edge_1[2][lane];
+    const float e2x = p_packet.edge_2[0][lane], e2y = p_packet.edge_2[1][lane], e2z = p_packet.edge_2[2][lane];
+
+    const float px = d.y * e2z - d.z * e2y;
+    const float py = d.z * e2x - d.x * e2z;
+    const float pz = d.x * e2y - d.y * e2x;
+    const float determinant = e1x * px + e1y * py + e1z * pz;
+
+    const float ox = p_ray.origin.x - p_packet.origin[0][lane];
+    const float oy = p_ray.origin.y - p_packet.origin[1][lane];
+    const float oz = p_ray.origin.z - p_packet.origin[2][lane];
+    const float u = ox * px + oy * py + oz * pz;
+
+    const float qx = oy * e1z - oz * e1y;
+    const float qy = oz * e1x - ox * e1z;
+    const float qz = ox * e1y - oy * e1x;
+    const float v = d.x * qx + d.y * qy + d.z * qz;
+    const float t = e2x * qx + e2y * qy + e2z * qz;
+
+    const bool hit = (determinant > 0.0f) && (u >= 0.0f) && (u <= determinant) && (v >= 0.0f) && (u + v <= determinant) && (t >= 0.0f);
+
+    r_lanes.distance[lane] = t * (1.0f / determinant);
+    r_lanes.u[lane] = u;
+    r_lanes.v[lane] = v;
+    r_lanes.determinant[lane] = determinant;
+    mask |= static_cast<uint32_t>(hit) << lane;
+  }
+
+  return mask;
+}
+
+
+static bool intersect_scalar(const Ray &p_ray, std::span<const TrianglePacket> p_packets, TriangleHit &r_hit) {
+  LaneResults lanes = {};
+  bool found = false;
+  for (size_t i = 0; i < p_packets.size(); i++) {
+    const uint32_t mask = test_packet_scalar(p_ray, p_packets[i], lanes);
+    found |= select_closest(mask, lanes, i * TRIANGLE_PACKET_WIDTH, r_hit);
+  }
+  return found;
+}
+
+
+static bool occluded_scalar(const Ray &p_ray, std::span<const TrianglePacket> p_packets, const float p_max_distance) {
+  LaneResults lanes = {};
+  for (const TrianglePacket &packet : p_packets) {
+    const uint32_t mask = test_packet_scalar(p_ray, packet, lanes);
+    if (select_any(mask, lanes, p_max_distance)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+#ifdef TRIANGLE_PACKET_X86
+
+// =======
+// = SSE =
+// =======
+
+struct RaySSE {
+  __m128 origin[3];
+  __m128 direction[3];
+};
+
+
+static inline RaySSE broadcast_sse(const Ray &p_ray) {
+  RaySSE ray;
+  for (size_t axis = 0; axis < 3; axis++) {
+    ray.origin[axis] = _mm_set1_ps(p_ray.origin[axis]);
+    ray.direction[axis] = _mm_set1_ps(p_ray.direction[axis]);
+  }
+  return ray;
+}
+
+
+// Writes the results of the packet to the lanes starting at p_first_lane
+static inline uint32_t test_packet_sse(const RaySSE &p_ray, const TrianglePacket &p_packet, LaneResults &r_lanes, const size_t p_first_lane) {
+  const __m128 *d = p_ray.direction;
+  const __m128 e1x = _mm_load_ps(p_packet.edge_1[0]), e1y = _mm_load_ps(p_packet.edge_1[1]), e1z = _mm_load_ps(p_packet.edge_1[2]);
+  const __m128 e2x = _mm_load_ps(p_packet.edge_2[0]), e2y = _mm_load_ps(p_packet.edge_2[1]), e2z = _mm_load_ps(p_packet.edge_2[2]);
+
+  const __m128 px = _mm_sub_ps(_mm_mul_ps(d[1], e2z), _mm_mul_ps(d[2], e2y));
+  const __m128 py = _mm_sub_ps(_mm_mul_ps(d[2], e2x), _mm_mul_ps(d[0], e2z));
+  const __m128 pz = _mm_sub_ps(_mm_mul_ps(d[0], e2y), _mm_mul_ps(d[1], e2x));
+  const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+
+  const __m128 ox = _mm_sub_ps(p_ray.origin[0], _mm_load_ps(p_packet.origin[0]));
+  const __m128 oy = _mm_sub_ps(p_ray.origin[1], _mm_load_ps(p_packet.origin[1]));
+  const __m128 oz = _mm_sub_ps(p_ray.origin[2], _mm_load_ps(p_packet.origin[2]));
+  const __m128 u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, px), _mm_mul_ps(oy, py)), _mm_mul_ps(oz, pz));
+
+  const __m128 qx = _mm_sub_ps(_mm_mul_ps(oy, e1z), _mm_mul_ps(oz, e1y));
+  const __m128 qy = _mm_sub_ps(_mm_mul_ps(oz, e1x), _mm_mul_ps(ox, e1z));
+  const __m128 qz = _mm_sub_ps(_mm_mul_ps(ox, e1y), _mm_mul_ps(oy, e1x));
+  const __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], qx), _mm_mul_ps(d[1], qy)), _mm_mul_ps(d[2], qz));
+  const __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz));
+
+  const __m128 zero = _mm_setzero_ps();
+  __m128 hit = _mm_cmpgt_ps(determinant, zero);
+  hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+  hit = _mm_and_ps(hit, _mm_cmple_ps(u, determinant));
+  hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+  hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), determinant));
+  hit = _mm_and_ps(hit, _mm_cmpge_ps(t, zero));
+
+  _mm_storeu_ps(r_lanes.distance + p_first_lane, _mm_mul_ps(t, _mm_div_ps(_mm_set1_ps(1.0f), determinant)));
+  _mm_storeu_ps(r_lanes.u + p_first_lane, u);
+  _mm_storeu_ps(r_lanes.v + p_first_lane, v);
+  _mm_storeu_ps(r_lanes.determinant + p_first_lane, determinant);
+  return _mm_movemask_ps(hit);
+}
+
+
+static bool intersect_sse(const Ray &p_ray, std::span<const TrianglePacket> p_packets, TriangleHit &r_hit) {
+  const RaySSE ray = broadcast_sse(p_ray);
+  LaneResults lanes = {};
+  bool found = false;
+  for (size_t i = 0; i < p_packets.size(); i++) {
+    const uint32_t mask = test_packet_sse(ray, p_packets[i], lanes, 0);
+    if (mask) {
+      found |= select_closest(mask, lanes, i * TRIANGLE_PACKET_WIDTH, r_hit);
+    }
+  }
+  return found;
+}
+
+
+static bool occluded_sse(const Ray &p_ray, std::span<const TrianglePacket> p_packets, const float p_max_distance) {
+  const RaySSE ray = broadcast_sse(p_ray);
+  LaneResults lanes = {};
+  for (const TrianglePacket &packet : p_packets) {
+    const uint32_t mask = test_packet_sse(ray, packet, lanes, 0);
+    if (mask && select_any(mask, lanes, p_max_distance)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+// ========
+// = AVX2 =
+// ========
+
+struct RayAVX {
+  __m256 origin[3];
+  __m256 direction[3];
+};
+
+
+__attribute__((target("avx2")))
+static inline __m256 load_packets_avx(const float *p_first, const float *p_second) {
+  return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(p_first)), _mm_load_ps(p_second), 1);
+}
+
+
+// Tests two consecutive packets, the lanes of p_second come after the ones of p_first
+__attribute__((target("avx2")))
+static inline uint32_t test_packets_avx(const RayAVX &p_ray, const TrianglePacket &p_first, const TrianglePacket &p_second, LaneResults &r_lanes) {
+  const __m256 *d = p_ray.direction;
+  const __m256 e1x = load_packets_avx(p_first.edge_1[0], p_second.edge_1[0]);
+  const __m256 e1y = load_packets_avx(p_first.edge_1[1], p_second.edge_1[1]);
+  const __m256 e1z = load_packets_avx(p_first.edge_1[2], p_second.edge_1[2]);
+  const __m256 e2x = load_packets_avx(p_first.edge_2[0], p_second.edge_2[0]);
+  const __m256 e2y = load_packets_avx(p_first.edge_2[1], p_second.edge_2[1]);
+  const __m256 e2z = load_packets_avx(p_first.edge_2[2], p_second.edge_2[2]);
+
+  const __m256 px = _mm256_sub_ps(_mm256_mul_ps(d[1], e2z), _mm256_mul_ps(d[2], e2y));
+  const __m256 py = _mm256_sub_ps(_mm256_mul_ps(d[2], e2x), _mm256_mul_ps(d[0], e2z));
+  const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(d[0], e2y), _mm256_mul_ps(d[1], e2x));
+  const __m256 determinant = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+
+  const __m256 ox = _mm256_sub_ps(p_ray.origin[0], load_packets_avx(p_first.origin[0], p_second.origin[0]));
+  const __m256 oy = _mm256_sub_ps(p_ray.origin[1], load_packets_avx(p_first.origin[1], p_second.origin[1]));
+  const __m256 oz = _mm256_sub_ps(p_ray.origin[2], load_packets_avx(p_first.origin[2], p_second.origin[2]));
+  const __m256 u = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, px), _mm256_mul_ps(oy, py)), _mm256_mul_ps(oz, pz));
+
+  const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(oy, e1z), _mm256_mul_ps(oz, e1y));
+  const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(oz, e1x), _mm256_mul_ps(ox, e1z));
+  const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(ox, e1y), _mm256_mul_ps(oy, e1x));
+  const __m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d[0], qx), _mm256_mul_ps(d[1], qy)), _mm256_mul_ps(d[2], qz));
+  const __m256 t = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz));
+
+  const __m256 zero = _mm256_setzero_ps();
+  __m256 hit = _mm256_cmp_ps(determinant, zero, _CMP_GT_OQ);
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, determinant, _CMP_LE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(u, v), determinant, _CMP_LE_OQ));
+  hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, zero, _CMP_GE_OQ));
+
+  _mm256_storeu_ps(r_lanes.distance, _mm256_mul_ps(t, _mm256_div_ps(_mm256_set1_ps(1.0f), determinant)));
+  _mm256_storeu_ps(r_lanes.u, u);
+  _mm256_storeu_ps(r_lanes.v, v);
+  _mm256_storeu_ps(r_lanes.determinant, determinant);
+  return _mm256_movemask_ps(hit);
+}
+
+
+__attribute__((target("avx2")))
+static inline RayAVX broadcast_avx(const Ray &p_ray) {
+  RayAVX ray;
+  for (size_t axis = 0; axis < 3; axis++) {
+    ray.origin[axis] = _mm256_set1_ps(p_ray.origin[axis]);
+    ray.direction[axis] = _mm256_set1_ps(p_ray.direction[axis]);
+  }
+  return ray;
+}
+
+
+__attribute__((target("avx2")))
+static bool intersect_avx(const Ray &p_ray, std::span<const TrianglePacket> p_packets, TriangleHit &r_hit) {
+  const RayAVX ray = broadcast_avx(p_ray);
+  LaneResults lanes = {};
+  bool found = false;
+
+  size_t i = 0;
+  for (; i + 1 < p_packets.size(); i += 2) {
+    const uint32_t mask = test_packets_avx(ray, p_packets[i], p_packets[i + 1], lanes);
+    if (mask) {
+      found |= select_closest(mask, lanes, i * TRIANGLE_PACKET_WIDTH, r_hit);
+    }
+  }
+
+  // Odd packet count
+  if (i < p_packets.size()) {
+    const uint32_t mask = test_packet_sse(broadcast_sse(p_ray), p_packets[i], lanes, 0);
+    if (mask) {
+      found |= select_closest(mask, lanes, i * TRIANGLE_PACKET_WIDTH, r_hit);
+    }
+  }
+  return found;
+}
+
+
+__attribute__((target("avx2")))
+static bool occluded_avx(const Ray &p_ray, std::span<const TrianglePacket> p_packets, const float p_max_distance) {
+  const RayAVX ray = broadcast_avx(p_ray);
+  LaneResults lanes = {};
+
+  size_t i = 0;
+  for (; i + 1 < p_packets.size(); i += 2) {
+    const uint32_t mask = test_packets_avx(ray, p_packets[i], p_packets[i + 1], lanes);
+    if (mask && select_any(mask, lanes, p_max_distance)) {
+      return true;
+    }
+  }
+
+  if (i < p_packets.size()) {
+    const uint32_t mask = test_packet_sse(broadcast_sse(p_ray), p_packets[i], lanes, 0);
+    return mask && select_any(mask, lanes, p_max_distance);
+  }
+  return false;
+}
+
+#endif // TRIANGLE_PACKET_X86
+
+
+// ============
+// = Dispatch =
+// ============
+
+bool is_triangle_packet_kernel_supported(const TrianglePacketKernel p_kernel) {
+  switch (p_kernel) {
+  case TrianglePacketKernel::SCALAR:
+    return true;
+#ifdef TRIANGLE_PACKET_X86
+  case TrianglePacketKernel::SSE:
+    return true; // Part of x86_64
+  case TrianglePacketKernel::AVX2:
+    return __builtin_cpu_supports("avx2");
+#else
+  case TrianglePacketKernel::SSE:
+  case TrianglePacketKernel::AVX2:
+    return false;
+#endif
+  }
+  return false;
+}
+
+
+static TrianglePacketKernel get_fastest_kernel() {
+  for (const TrianglePacketKernel kernel : {TrianglePacketKernel::AVX2, TrianglePacketKernel::SSE}) {
+    if (is_triangle_packet_kernel_supported(kernel)) {
+      return kernel;
+    }
+  }
+  return TrianglePacketKernel::SCALAR;
+}
+
+
+static TrianglePacketKernel current_kernel = get_fastest_kernel();
+
+
+void set_triangle_packet_kernel(const TrianglePacketKernel p_kernel) {
+  current_kernel = is_triangle_packet_kernel_supported(p_kernel)? p_kernel : TrianglePacketKernel::SCALAR;
+}
+
+
+TrianglePacketKernel get_triangle_packet_kernel() {
+  return current_kernel;
+}
+
+
+bool intersect_triangle_packets(const Ray &p_ray, std::span<const TrianglePacket> p_packets, TriangleHit &r_hit) {
+  switch (current_kernel) {
+#ifdef TRIANGLE_PACKET_X86
+  case TrianglePacketKernel::AVX2:
+    return intersect_avx(p_ray, p_packets, r_hit);
+  case TrianglePacketKernel::SSE:
+    return intersect_sse(p_ray, p_packets, r_hit);
+#endif
+  default:
+    return intersect_scalar(p_ray, p_packets, r_hit);
+  }
+}
+
+
+bool occluded_by_triangle_packets(const Ray &p_ray, std::span<const TrianglePacket> p_packets, const float p_max_distance) {
+  switch (current_kernel) {
+#ifdef TRIANGLE_PACKET_X86
+  case TrianglePacketKernel::AVX2:
+    return occluded_avx(p_ray, p_packets, p_max_distance);
+  case TrianglePacketKernel::SSE:
+    return occluded_sse(p_ray, p_packets, p_max_distance);
+#endif
+  default:
+    return occluded_scalar(p_ray, p_packets, p_max_distance);
+  }
+}
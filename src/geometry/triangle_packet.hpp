@@ -0,0 +1,83 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+#pragma once
+
+
+#include <cstddef>
+#include <span>
+
+#include "geometry/ray.hpp"
+#include "geometry/triangle.hpp"
+
+
+constexpr size_t TRIANGLE_PACKET_WIDTH = 4;
+
+
+// Group of triangles stored component by component so that one ray can be tested against all of them at once.
+// Unused lanes are left degenerate (all zeros), they are never hit.
+struct alignas(16) TrianglePacket {
+  float origin[3][TRIANGLE_PACKET_WIDTH];
+  float edge_1[3][TRIANGLE_PACKET_WIDTH];
+  float edge_2[3][TRIANGLE_PACKET_WIDTH];
+
+public:
+  void set(const size_t p_lane, const PrecomputedTriangle &p_triangle);
+
+  TrianglePacket();
+};
+
+
+// Implementations of the packet tests, every one of them selects exactly the same hits as the scalar one.
+enum class TrianglePacketKernel {
+  SCALAR,
+  SSE,  // One packet at a time
+  AVX2, // Two packets at a time
+};
+
+bool is_triangle_packet_kernel_supported(const TrianglePacketKernel p_kernel);
+// The fastest kernel supported by the CPU is selected at startup, changing it is not thread safe.
+void set_triangle_packet_kernel(const TrianglePacketKernel p_kernel);
+TrianglePacketKernel get_triangle_packet_kernel();
+
+
+// Finds the closest triangle of p_packets hit closer than r_hit.distance. When there is one, r_hit is updated with its
+// index being the position of the triangle in the packets (packet index * TRIANGLE_PACKET_WIDTH + lane), and true is returned.
+bool intersect_triangle_packets(const Ray &p_ray, std::span<const TrianglePacket> p_packets, TriangleHit &r_hit);
+// Returns whether a triangle of p_packets is hit closer than p_max_distance.
+bool occluded_by_triangle_packets(const Ray &p_ray, std::span<const TrianglePacket> p_packets, const float p_max_distance);
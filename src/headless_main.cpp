@@ -0,0 +1,260 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+// Renders a single image without any window, for machines without a display or a GPU: neither GLFW nor OpenGL is
+// initialized.
+
+
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <string_view>
+
+#include "thirdparty/kmath/constants.hpp"
+#include "thirdparty/kmath/euclidian_flat_3d.hpp"
+#include "thirdparty/kmath/vector.hpp"
+#include "tp_utils/src/rendering/camera.hpp"
+
+#include "utils/thread_pool.hpp"
+#include "render.hpp"
+#include "scene.hpp"
+
+
+struct Options {
+  std::string_view scene_name = "cornell_box";
+  kmath::Vec3 camera_position = kmath::Vec3(0.0f, 0.0f, 3.1f);
+  bool look_at = false;
+  kmath::Vec3 camera_target;
+  float vfov = 75.0f;
+  size_t image_width = 480;
+  size_t image_height = 480;
+  size_t thread_count = 0;
+  std::filesystem::path output_path = "./render.ppm";
+  bool write_heat_maps = false;
+  RenderSettings render_settings;
+};
+
+
+void print_usage(const char *p_program_name) {
+  std::cout
+    << "Usage: " << p_program_name << " [options]\n"
+    << "\n"
+    << "Options\n"
+    << "-------\n"
+    << " --scene <name>          cornell_box, simple_mesh, single_sphere or single_square (default: cornell_box)\n"
+    << " --position <x> <y> <z>  position of the camera (default: 0 0 3.1)\n"
+    << " --look-at <x> <y> <z>   point the camera looks at (default: the camera looks along -z)\n"
+    << " --vfov <degrees>        vertical field of view (default: 75)\n"
+    << " --resolution <w> <h>    size of the image (default: 480 480)\n"
+    << " --spp <n>               samples per pixel, disables adaptive sampling\n"
+    << " --min-spp <n>           minimum samples per pixel of adaptive sampling, at least 2 (default: 16)\n"
+    << " --max-spp <n>           maximum samples per pixel of adaptive sampling (default: 256)\n"
+    << " --max-error <e>         relative error at which adaptive sampling stops (default: 0.1)\n"
+    << " --bounces <n>           maximum number of bounces of the rays (default: 8)\n"
+    << " --seed <n>              seed of the random number generators (default: 47)\n"
+    << " --sampler <name>        random, sobol, halton or blue_noise (default: sobol)\n"
+    << " --threads <n>           number of render threads (default: one per hardware thread)\n"
+    << " --output <path>         image file to write, as ppm, png, or pfm and hdr before tone mapping (default: ./render.ppm)\n"
+    << " --heat-maps             also write the performance and sample count heat maps next to the image\n"
+    << " --help                  print this help\n"
+    << std::endl; // Put std::endl only once, as it flushes the buffer
+}
+
+
+template<typename T>
+bool parse_value(const char *p_text, T &r_value) {
+  const char *end = p_text + std::strlen(p_text);
+  const std::from_chars_result result = std::from_chars(p_text, end, r_value);
+  return result.ec == std::errc() && result.ptr == end;
+}
+
+
+// Returns false if the arguments are invalid, the error being printed
+bool parse_options(const int p_argc, char **p_argv, Options &r_options) {
+  for (int i = 1; i < p_argc; i++) {
+    const std::string_view option = p_argv[i];
+
+    // Checks that the option has p_count values, and points values to them
+    char **values = nullptr;
+    auto get_values = [&](const int p_count) -> bool {
+      if (i + p_count >= p_argc) {
+        std::cout << "Missing value for option " << option << std::endl;
+        return false;
+      }
+      values = p_argv + i + 1;
+      i += p_count;
+      return true;
+    };
+
+    bool valid = true;
+    if (option == "--help") {
+      print_usage(p_argv[0]);
+      std::exit(EXIT_SUCCESS);
+    } else if (option == "--scene") {
+      valid = get_values(1);
+      if (valid) r_options.scene_name = values[0];
+    } else if (option == "--position") {
+      valid = get_values(3)
+        && parse_value(values[0], r_options.camera_position.x)
+        && parse_value(values[1], r_options.camera_position.y)
+        && parse_value(values[2], r_options.camera_position.z);
+    } else if (option == "--look-at") {
+      r_options.look_at = true;
+      valid = get_values(3)
+        && parse_value(values[0], r_options.camera_target.x)
+        && parse_value(values[1], r_options.camera_target.y)
+        && parse_value(values[2], r_options.camera_target.z);
+    } else if (option == "--vfov") {
+      valid = get_values(1) && parse_value(values[0], r_options.vfov);
+    } else if (option == "--resolution") {
+      valid = get_values(2)
+        && parse_value(values[0], r_options.image_width)
+        && parse_value(values[1], r_options.image_height)
+        && r_options.image_width > 0 && r_options.image_height > 0;
+    } else if (option == "--spp") {
+      unsigned int sample_count = 0;
+      valid = get_values(1) && parse_value(values[0], sample_count) && sample_count > 0;
+      r_options.render_settings.min_sample_count = sample_count;
+      r_options.render_settings.max_sample_count = sample_count;
+    } else if (option == "--min-spp") {
+      valid = get_values(1) && parse_value(values[0], r_options.render_settings.min_sample_count) && r_options.render_settings.min_sample_count >= MIN_ADAPTIVE_SAMPLE_COUNT;
+    } else if (option == "--max-spp") {
+      valid = get_values(1) && parse_value(values[0], r_options.render_settings.max_sample_count) && r_options.render_settings.max_sample_count > 0;
+    } else if (option == "--max-error") {
+      valid = get_values(1) && parse_value(values[0], r_options.render_settings.max_relative_error);
+    } else if (option == "--bounces") {
+      valid = get_values(1) && parse_value(values[0], r_options.render_settings.bounce_count);
+    } else if (option == "--seed") {
+      valid = get_values(1) && parse_value(values[0], r_options.render_settings.random_seed);
+    } else if (option == "--sampler") {
+      const std::optional<SamplerType> sampler_type = (get_values(1))? get_sampler_type(values[0]) : std::optional<SamplerType>();
+      valid = sampler_type.has_value();
+      if (valid) r_options.render_settings.sampler_type = sampler_type.value();
+    } else if (option == "--threads") {
+      valid = get_values(1) && parse_value(values[0], r_options.thread_count);
+    } else if (option == "--output") {
+      valid = get_values(1);
+      if (valid) r_options.output_path = values[0];
+    } else if (option == "--heat-maps") {
+      r_options.write_heat_maps = true;
+    } else {
+      std::cout << "Unknown option: " << option << std::endl;
+      return false;
+    }
+
+    if (!valid) {
+      std::cout << "Invalid value for option " << option << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// Returns false if there is no scene named p_name
+bool setup_scene(Scene &r_scene, const std::string_view p_name) {
+  if (p_name == "cornell_box") {
+    r_scene.setup_cornell_box();
+  } else if (p_name == "simple_mesh") {
+    r_scene.setup_simple_mesh();
+  } else if (p_name == "single_sphere") {
+    r_scene.setup_single_sphere();
+  } else if (p_name == "single_square") {
+    r_scene.setup_single_square();
+  } else {
+    return false;
+  }
+  return true;
+}
+
+
+// p_path with p_suffix added to its file name, before the extension
+std::filesystem::path add_file_name_suffix(const std::filesystem::path &p_path, const std::string_view p_suffix) {
+  std::filesystem::path result = p_path;
+  result.replace_filename(p_path.stem().string() + std::string(p_suffix) + p_path.extension().string());
+  return result;
+}
+
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse_options(argc, argv, options)) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const std::optional<Image::FileFormat> output_format = Image::get_file_format(options.output_path);
+  if (!output_format) {
+    std::cout << "Unsupported image format: " << options.output_path.string() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Before the scene, whose acceleration structures are built on the pool
+  ThreadPool::set_singleton_thread_count(options.thread_count);
+
+  Scene scene;
+  if (!setup_scene(scene, options.scene_name)) {
+    std::cout << "Unknown scene: " << options.scene_name << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  tputils::Camera3D camera;
+  camera.set_position(options.camera_position);
+  camera.set_vfov(options.vfov * kmath::PI / 180.0f);
+  if (options.look_at) {
+    camera.look_at(options.camera_position, kmath::Point3::point(options.camera_target), kmath::Point3::Y_DIR);
+  }
+
+  const CameraRays camera_rays = CameraRays::from_camera(camera, options.image_width, options.image_height);
+  const RenderResult result = render_scene(scene, camera_rays, options.image_width, options.image_height, options.render_settings);
+
+  // The floating point formats keep the radiance before tone mapping, for compositing
+  const Image &output_image = (Image::is_high_dynamic_range(*output_format))? result.hdr_image : result.image;
+  if (!write_image(output_image, options.output_path)) return EXIT_FAILURE;
+  if (options.write_heat_maps) {
+    if (!write_image(result.performance_heat_map, add_file_name_suffix(options.output_path, "_performance_heat_map"))) return EXIT_FAILURE;
+    if (!write_image(result.sample_count_heat_map, add_file_name_suffix(options.output_path, "_sample_count_heat_map"))) return EXIT_FAILURE;
+  }
+
+  std::cout << "Image saved to " << options.output_path.string() << std::endl;
+  return EXIT_SUCCESS;
+}
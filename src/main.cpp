@@ -38,12 +38,10 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
-#include <iomanip>
 #include <iostream>
-#include <fstream>
 #include <ostream>
 #include <random>
-#include <thread>
+#include <span>
 #include <vector>
 #include <string>
 
@@ -51,7 +49,6 @@
 #include "thirdparty/kmath/print.hpp"
 
 
-#include "tp_utils/src/data_structures/gradient.hpp"
 #include "tp_utils/src/rendering/camera.hpp"
 
 #include "tp_utils/src/rendering/primitives/shader.hpp"
@@ -60,13 +57,14 @@
 #include "tp_utils/src/windowing.hpp"
 #include "utils/gl_utils.hpp"
 #include "utils/image.hpp"
-#include "utils/profiler.hpp"
 #include "utils/renderer.hpp"
 #include "utils/thread_group.hpp"
+#include "utils/thread_pool.hpp"
 
 #include "tp_utils/src/rendering/immediate_geometry.hpp"
 #include "thirdparty/glfw/include/GLFW/glfw3.h"
 
+#include "render.hpp"
 #include "scene.hpp"
 
 // ====================
@@ -109,6 +107,24 @@ static unsigned int selected_scene;
 static std::vector<std::pair<Ray, kmath::Vec2>> rays;
 
 
+// Path tracing settings
+
+static RenderSettings render_settings;
+
+
+// Progressive rendering
+
+static bool progressive_rendering = false;
+static bool progressive_view_changed = true; // The accumulated samples must be discarded
+
+static TaskGraph progressive_pass; // Adds one sample per pixel to the accumulation, submitted again for every pass
+static bool progressive_pass_running = false;
+static size_t progressive_sample_count = 0; // Samples per pixel of the finished passes
+
+static Image progressive_accumulation(0, 0); // Sum of the samples of every pixel
+static Image progressive_preview(0, 0); // Tone mapped mean of the samples
+
+
 // =========================
 // = Some helper functions =
 // =========================
@@ -146,6 +162,13 @@ void center_mouse() {
 
 void draw() {
   Renderer *rd = Renderer::get_singleton();
+
+  // The progressive render replaces the scene once its first pass is done
+  if (progressive_rendering && progressive_sample_count > 0) {
+    rd->draw_preview();
+    return;
+  }
+
   rd->begin_frame();
 
   const double aspect_ratio = (double)window_width / window_height;
@@ -174,266 +197,132 @@ void draw() {
   rd->end_frame();
 }
 
-// Polynomial approximation of EaryChow's AgX sigmoid curve.
-// x must be within the range [0.0, 1.0]
-kmath::Vec3 agx_contrast_approx(kmath::Vec3 x) {
-	// Generated with Excel trendline
-	// Input data: Generated using python sigmoid with EaryChow's configuration and 57 steps
-	// Additional padding values were added to give correct intersections at 0.0 and 1.0
-	// 6th order, intercept of 0.0 to remove an operation and ensure intersection at 0.0
-	kmath::Vec3 x2 = x * x;
-	kmath::Vec3 x4 = x2 * x2;
-	return 0.021f * x + 4.0111f * x2 - 25.682f * x2 * x + 70.359f * x4 - 74.778f * x4 * x + 27.069f * x4 * x2;
-}
-
-// This code is adapted from the Godot game engine
-// This is an approximation and simplification of EaryChow's AgX implementation that is used by Blender.
-// This code is based off of the script that generates the AgX_Base_sRGB.cube LUT that Blender uses.
-// Source: https://github.com/EaryChow/AgX_LUT_Gen/blob/main/AgXBasesRGB.py
-kmath::Vec3 tonemap_agx(kmath::Vec3 color) {
-	// Combined linear sRGB to linear Rec 2020 and Blender AgX inset matrices:
-	const kmath::Mat3 srgb_to_rec2020_agx_inset_matrix = kmath::Mat3(
-    kmath::Vec3(0.54490813676363087053, 0.14044005884001287035, 0.088827411851915368603),
-    kmath::Vec3(0.37377945959812267119, 0.75410959864013760045, 0.17887712465043811023),
-    kmath::Vec3(0.081384976686407536266, 0.10543358536857773485, 0.73224999956948382528)
-	);
-
-	// Combined inverse AgX outset matrix and linear Rec 2020 to linear sRGB matrices.
-	const kmath::Mat3 agx_outset_rec2020_to_srgb_matrix = kmath::Mat3(
-    kmath::Vec3(1.9645509602733325934, -0.29932243390911083839, -0.16436833806080403409),
-    kmath::Vec3(-0.85585845117807513559, 1.3264510741502356555, -0.23822464068860595117),
-    kmath::Vec3(-0.10886710826831608324, -0.027084020983874825605, 1.402665347143271889)
-  );
-
-	// LOG2_MIN      = -10.0
-	// LOG2_MAX      =  +6.5
-	// MIDDLE_GRAY   =  0.18
-	const float min_ev = -12.4739311883324;
-	const float max_ev = 4.02606881166759;
-
-	// Large negative values in one channel and large positive values in other
-	// channels can result in a colour that appears darker and more saturated than
-	// desired after passing it through the inset matrix. For this reason, it is
-	// best to prevent negative input values.
-	// This is done before the Rec. 2020 transform to allow the Rec. 2020
-	// transform to be combined with the AgX inset matrix. This results in a loss
-	// of color information that could be correctly interpreted within the
-	// Rec. 2020 color space as positive RGB values, but it is less common for Godot
-	// to provide this function with negative sRGB values and therefore not worth
-	// the performance cost of an additional matrix multiplication.
-	// A value of 2e-10 intentionally introduces insignificant error to prevent
-	// log2(0.0) after the inset matrix is applied; color will be >= 1e-10 after
-	// the matrix transform.
-	color = kmath::max(color, 2e-10f * kmath::Vec3::ONE);
-
-	// Do AGX in rec2020 to match Blender and then apply inset matrix.
-	color = srgb_to_rec2020_agx_inset_matrix * color;
-
-	// Log2 space encoding.
-	// Must be clamped because agx_contrast_approx may not work
-	// well with values outside of the range [0.0, 1.0]
-	color = kmath::apply(color, [](const float x) -> float { return std::log2(x); });
-	color = kmath::apply(color, [&](const float x) -> float { return std::clamp(x, min_ev, max_ev); });
-	color = (color - min_ev * kmath::Vec3::ONE) / (max_ev - min_ev);
-
-	// Apply sigmoid function approximation.
-	color = agx_contrast_approx(color);
-
-	// Convert back to linear before applying outset matrix.
-	color = kmath::apply(color, [](const float x) -> float { return pow(x, 2.4f); });
-
-	// Apply outset to make the result more chroma-laden and then go back to linear sRGB.
-	color = agx_outset_rec2020_to_srgb_matrix * color;
-
-	return color;
-}
-
-
 void ray_trace_from_camera() {
-  using namespace kmath;
-  
   const size_t image_width = window_width;
   const size_t image_height = window_height;
-  const float inv_image_width = 1.0f / static_cast<float>(image_width);
-  const float inv_image_height = 1.0f / static_cast<float>(image_height);
-  const float aspect_ratio = static_cast<float>(image_width) / static_cast<float>(image_height);
-
-  const unsigned int sample_count = 50;
-  const float sample_division = 1.0f / static_cast<float>(sample_count);
-  Image image(image_width, image_height);
-
-  std::vector<uint64_t> pixel_time(image_width * image_height);
-  Image performance_heat_map(image_width, image_height);
-  tputils::Gradient performance_gradient;
-  performance_gradient.set_outside_color(Lrgb(1.0f, 1.0f, 1.0f));
-  performance_gradient.add_point(Lrgb(0.012f, 0.035f, 0.057f), 0.0f);
-  performance_gradient.add_point(Lrgb(0.031f, 0.205f, 0.011f), 0.25f);
-  performance_gradient.add_point(Lrgb(0.759f, 0.483f, 0.045f), 0.5f);
-  performance_gradient.add_point(Lrgb(0.504f, 0.169f, 0.039f), 0.75f);
-  performance_gradient.add_point(Lrgb(0.950f, 0.011f, 0.005f), 1.0f);
-
-  const Mat4 inv_proj = inverse(camera.get_projection_matrix(aspect_ratio));
-  const Mat4 inv_view = camera.get_inverse_view_matrix();
-  const Mat4 inv_mvp = inv_view * inv_proj;
-
-  const Vec3 camera_position = homogeneous_projection(inv_view * Vec4(Vec3::ZERO, 1.0));
-  const float near_plane = get_depth_range().x;
-
-  const uint32_t random_seed = 47;
+  const CameraRays camera_rays = CameraRays::from_camera(camera, image_width, image_height, get_depth_range().x);
 
   // Reset debug rays
   rays.clear();
 
-  Profiler full_render_profile;
-  full_render_profile.start();
-  {
-    Profiler specific_profiler;
-
-    // Create thread work group to do work
-    const size_t available_thread_count = std::thread::hardware_concurrency();
-    const size_t thread_count = (available_thread_count)? available_thread_count : 8;
-    std::cout << "Ray tracing a " << image_width << " x " << image_height << " image on " << thread_count << " threads" << std::endl;
-    ThreadWorkGroup work_group(thread_count);
-    // ThreadWorkGroup work_group(1);
-
-    // Lambda to declare a rendering pass
-    auto exec_phase = [&](const char *p_phase_name, const ParallelFunction &p_func) -> void {
-      specific_profiler.start();
-
-      // Start work
-      work_group.execute(p_func, 0, image.get_size());
-
-      // Report progress
-      while (!work_group.is_work_done()) {
-        const double progress = work_group.get_progress();
-        const size_t ticks = progress * 40;
-        std::cout << "\r" << p_phase_name << ": <";
-        for (size_t i = 0; i < ticks; i++) {
-          std::cout << "=";
-        }
-        for (size_t i = ticks; i < 40; i++) {
-          std::cout << "-";
-        }
-        std::cout << "> " << std::setprecision(4) << progress * 100.0 << "%   ";
-        std::flush(std::cout);
-      
-        using namespace std::chrono_literals;
-        std::this_thread::sleep_for(1ms);
-      }
+  const RenderResult result = render_scene(scenes[selected_scene], camera_rays, image_width, image_height, render_settings);
 
-      work_group.join();
-      specific_profiler.end();
-
-      std::cout << "\e[1M\r"; // Clear the line giving progress
-      std::cout << "\t" << p_phase_name << " finished in " << specific_profiler.get_exec_time() << std::endl;
-    };
-
-    // Instantiate a random number generators for each thread
-    std::vector<std::mt19937> rngs(thread_count);
-    {
-      std::mt19937 master_rng(random_seed);
-      std::uniform_int_distribution<uint32_t> master_gen;
-      
-      for (size_t i = 0; i < thread_count; i++) {
-        rngs[i] = std::mt19937(master_gen(master_rng));
-      }
-    }
-    std::uniform_real_distribution<float> randf; // TODO: use blue noise
+  // Write the raytraced image to a file
+  if (!write_image(result.image, "./render.ppm")) return;
+  if (!write_image(result.performance_heat_map, "./performance_heat_map.ppm")) return;
+  if (!write_image(result.sample_count_heat_map, "./sample_count_heat_map.ppm")) return;
 
-    // Get the maximum execution time per thread
-    std::vector<size_t> exec_times(thread_count);
+  std::cout << "Image saved." << std::endl;
+}
 
-    // Execute render phases
-    exec_phase(
-      "Scene render",
-      [&](const size_t p_thread_id, const size_t p_exec_index) -> void {
-        Profiler pixel_profiler;
-        pixel_profiler.start();
 
-        std::mt19937 &rng = rngs[p_thread_id];
-        const size_t x = p_exec_index % image_width;
-        const size_t y = p_exec_index / image_width;
+// =========================
+// = Progressive rendering =
+// =========================
 
-        for (unsigned int s = 0; s < sample_count; s++) {
-          const float u = ((float)x + randf(rng)) * inv_image_width;
-          const float v = ((float)y + randf(rng)) * inv_image_height;
-          const Vec3 ray_direction = homogeneous_projection(inv_mvp * Vec4(2.0f * u - 1.0f, -2.0f * v + 1.0f, -near_plane, 1.0)) - camera_position;
-          const Ray ray = Ray(camera_position, ray_direction);
 
-          // const Vec3 color = scenes[selected_scene].ray_trace(rng, ray);
-          const Vec3 color = scenes[selected_scene].ray_trace_recursive(rng, ray, 4);
+// Cancels the pass being rendered, and waits for the tasks that already started
+void stop_progressive_pass() {
+  if (!progressive_pass_running) return;
 
-          image(p_exec_index) += color;
-        }
+  progressive_pass.cancel();
+  ThreadPool::get_singleton()->wait(progressive_pass);
+  progressive_pass_running = false;
+}
 
-        image(p_exec_index) *= sample_division;
 
-        pixel_profiler.end();
+// Discards the accumulated samples, and builds the pass rendering the view of the camera
+void restart_progressive_render() {
+  stop_progressive_pass();
 
-        // Write execution time
-        const size_t exec_time = pixel_profiler.get_exec_time_nanoseconds();
-        pixel_time[p_exec_index] = exec_time;
-        if (exec_time > exec_times[p_thread_id]) {
-          exec_times[p_thread_id] = exec_time;
+  const size_t image_width = window_width;
+  const size_t image_height = window_height;
+  progressive_accumulation = Image(image_width, image_height);
+  progressive_preview = Image(image_width, image_height);
+  progressive_sample_count = 0;
+
+  TileSettings tile_settings;
+  tile_settings.row_length = image_width;
+  tile_settings.tile_width = 16;
+  tile_settings.tile_height = 16;
+  tile_settings.order = TileSettings::Order::CENTER_OUT;
+  const std::vector<Tile> tiles = build_tiles(0, progressive_accumulation.get_size(), tile_settings);
+
+  const CameraRays camera_rays = CameraRays::from_camera(camera, image_width, image_height, get_depth_range().x);
+  const Scene *scene = &scenes[selected_scene];
+
+  // A tile is tone mapped as soon as its sample is added, the preview shows the mean of the samples of the pass
+  progressive_pass.clear();
+  for (const Tile &tile : tiles) {
+    const TaskID render_task = progressive_pass.add_task([=]([[maybe_unused]] const size_t p_thread_id) -> void {
+      std::uniform_real_distribution<float> randf;
+
+      // Neighbouring pixels of a tile are traced together, their rays are coherent enough for packets
+      size_t packet_indices[MAX_RAY_PACKET_SIZE];
+      Ray packet_rays[MAX_RAY_PACKET_SIZE];
+      kmath::Lrgb packet_colors[MAX_RAY_PACKET_SIZE];
+      Sampler packet_samplers[MAX_RAY_PACKET_SIZE];
+      size_t packet_size = 0;
+
+      auto trace_packet = [&]() -> void {
+        scene->ray_trace_packet(std::span<Sampler>(packet_samplers, packet_size), std::span<const Ray>(packet_rays, packet_size), packet_colors, render_settings.bounce_count);
+        for (size_t s = 0; s < packet_size; s++) {
+          progressive_accumulation(packet_indices[s]) += packet_colors[s];
         }
-      }
-    );
+        packet_size = 0;
+      };
 
-    exec_phase(
-      "Tone mapping",
-      [&]([[maybe_unused]] const size_t p_thread_id, const size_t p_exec_index) -> void {
-        image(p_exec_index) = tonemap_agx(image(p_exec_index));
-      }
-    );
+      for_each_tile_index(tile, image_width, progressive_accumulation.get_size(), [&](const size_t p_exec_index) {
+        const size_t x = p_exec_index % image_width;
+        const size_t y = p_exec_index / image_width;
+        Sampler &sampler = packet_samplers[packet_size];
+        sampler = Sampler(render_settings.sampler_type, render_settings.random_seed, x, y, progressive_sample_count);
+        packet_indices[packet_size] = p_exec_index;
+        packet_rays[packet_size] = camera_rays.get_ray((float)x + randf(sampler), (float)y + randf(sampler));
+        packet_size++;
+
+        if (packet_size == MAX_RAY_PACKET_SIZE) {
+          trace_packet();
+        }
+      });
 
-    // Get the max execution time
-    size_t max_exec_time_l = exec_times[0];
-    for (size_t i = 1; i < thread_count; i++) {
-      if (max_exec_time_l < exec_times[i]) {
-        max_exec_time_l = exec_times[i];
-      }
-    }
-    auto time_scale_function = [&](const double p_time) -> double {
-      return std::sqrt(p_time * 1e-6);
-    };
-    const double max_exec_time = time_scale_function(static_cast<double>(max_exec_time_l));
-
-    exec_phase(
-      "Write performance heat map",
-      [&]([[maybe_unused]] const size_t p_thread_id, const size_t p_exec_index) -> void {
-        const double pixel_exec_time = time_scale_function(static_cast<double>(pixel_time[p_exec_index]));
-        const double time_prop = pixel_exec_time / max_exec_time;
-        performance_heat_map(p_exec_index) = performance_gradient.sample(time_prop);
+      if (packet_size > 0) {
+        trace_packet();
       }
-    );
+    });
+
+    progressive_pass.add_task([=]([[maybe_unused]] const size_t p_thread_id) -> void {
+      const float sample_division = 1.0f / static_cast<float>(progressive_sample_count + 1);
+      for_each_tile_index(tile, image_width, progressive_accumulation.get_size(), [&](const size_t p_exec_index) {
+        progressive_preview(p_exec_index) = tonemap_agx(sample_division * progressive_accumulation(p_exec_index));
+      });
+    }, {render_task});
   }
-  full_render_profile.end();
-  std::cout << "\tRender done in " << full_render_profile.get_exec_time() << std::endl;
 
-  // Write the raytraced image to a file
-  {
-    const char *filename = "./render.ppm";
-    std::ofstream f(filename, std::ios::binary);
-    if (f.fail()) {
-      std::cout << "Could not open file: " << filename << std::endl;
-      return;
-    }
-    image.write_ppm(f);
-    f.close();
+  progressive_view_changed = false;
+}
+
+
+// Shows the passes that are done, and starts the next one. Called every frame, the passes render in the background.
+void update_progressive_render() {
+  if (!progressive_rendering) return;
+
+  if (progressive_view_changed) {
+    restart_progressive_render();
   }
 
-  {
-    const char *filename = "./performance_heat_map.ppm";
-    std::ofstream f(filename, std::ios::binary);
-    if (f.fail()) {
-      std::cout << "Could not open file: " << filename << std::endl;
-      return;
-    }
-    performance_heat_map.write_ppm(f);
-    f.close();
+  ThreadPool *pool = ThreadPool::get_singleton();
+  if (progressive_pass_running) {
+    if (!progressive_pass.is_done()) return;
+
+    pool->wait(progressive_pass);
+    progressive_pass_running = false;
+    progressive_sample_count++;
+    Renderer::get_singleton()->set_preview_image(progressive_preview);
   }
 
-  std::cout << "Image saved." << std::endl;
+  pool->submit(progressive_pass);
+  progressive_pass_running = true;
 }
 
 
@@ -456,7 +345,11 @@ void update() {
     frame_rate = fps_delta / frame_count_delta;
 
     static char title[64];
-    sprintf(title, "Raytracer - FPS: %d", frame_rate);
+    if (progressive_rendering) {
+      sprintf(title, "Raytracer - FPS: %d - %zu samples", frame_rate, progressive_sample_count);
+    } else {
+      sprintf(title, "Raytracer - FPS: %d", frame_rate);
+    }
     glfwSetWindowTitle(window, title);
 
     fps_prev_measure_frame_count = frame_count;
@@ -490,6 +383,9 @@ void update() {
   }
 
   camera.update_position(movement_dir * frame_delta);
+  if (kmath::dot(movement_dir, movement_dir) > 0.0f) {
+    progressive_view_changed = true;
+  }
 }
 
 
@@ -520,6 +416,10 @@ void key_callback([[maybe_unused]] GLFWwindow *p_window, int p_key, [[maybe_unus
     break;
 
   case GLFW_KEY_R:
+    // Leave the whole thread pool to the render
+    stop_progressive_pass();
+    progressive_view_changed = true;
+
     rays.clear();
     ray_trace_from_camera();
     break;
@@ -527,6 +427,16 @@ void key_callback([[maybe_unused]] GLFWwindow *p_window, int p_key, [[maybe_unus
   case GLFW_KEY_N:
     selected_scene++;
     if (selected_scene >= scenes.size()) selected_scene = 0;
+    progressive_view_changed = true;
+    break;
+
+  case GLFW_KEY_P:
+    progressive_rendering = !progressive_rendering;
+    if (progressive_rendering) {
+      progressive_view_changed = true;
+    } else {
+      stop_progressive_pass();
+    }
     break;
 
   default:
@@ -563,6 +473,7 @@ void mouse_motion([[maybe_unused]] GLFWwindow *p_window, double p_xpos, double p
   const kmath::Vec2 rotation_delta = 0.5f * frame_delta * mouse_delta;
 
   camera.update_rotation(rotation_delta);
+  progressive_view_changed = true;
 
   center_mouse();
 }
@@ -572,6 +483,7 @@ void resized([[maybe_unused]] GLFWwindow *p_window, int width, int height) {
   window_width = width;
   window_height = height;
   glViewport(0, 0, window_width, window_height);
+  progressive_view_changed = true;
 }
 
 
@@ -602,6 +514,7 @@ void print_help() {
     << " right click: rotate the camera\n"
     << " z q s d: move the camera around\n"
     << " r: render image using path tracing\n"
+    << " p: toggle progressive path tracing of the view\n"
     << " q, <esc>: Quit\n"
     << std::endl; // Put std::endl only once, as it flushes the buffer
 }
@@ -657,6 +570,7 @@ int main() {
     tputils::begin_frame(window, window_width, window_height);
 
     update();
+    update_progressive_render();
     draw();
 
     tputils::end_frame(window);
@@ -664,6 +578,9 @@ int main() {
 
     frame_count += 1;
   }
+
+  // The passes use the scenes, they must end before the scenes are destroyed
+  stop_progressive_pass();
   
   return EXIT_SUCCESS;
 }
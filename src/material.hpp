@@ -93,56 +93,46 @@ public:
 
     const float total_weight = diffuse + mirror + transparancy;
 
+    // The diffuse direction is drawn whichever ray is selected, so that every bounce reads its numbers in the same order
+    const CosineHemisphereDistribution diffuse_distribution(p_normal);
+    const Vec3 diffuse_direction = diffuse_distribution(p_rng);
+
     std::uniform_real_distribution<float> selector(0.0f, total_weight);
     const float selection = selector(p_rng);
 
     if (selection < diffuse_cutoff) {
-      // This ray is to be bounced as a diffuse ray.
-      const UniformHemishereDistribution bounce_distribution(p_normal);
-      const kmath::Vec3 new_direction = bounce_distribution(p_rng);
-      return std::pair(new_direction, diffuse);
+      // This ray is to be bounced as a diffuse ray. The diffuse lobe is lambertian, its cosine cancels out with the
+      // density of the directions.
+      const float pdf = diffuse_distribution.get_pdf(diffuse_direction);
+      const float lambert = std::max(0.0f, dot(diffuse_direction, p_normal)) / static_cast<float>(kmath::PI);
+      return std::pair(diffuse_direction, (pdf > 0.0f)? diffuse * lambert / pdf : 0.0f);
     } else if (selection < mirror_cutoff) {
       // This ray is to be bounced as a reflected ray
       const Vec3 reflected_direction = reflect(p_ray_direction, p_normal);
       return std::pair(reflected_direction, mirror);
     } else {
-      // This ray is to be bounced as a mirrored ray
+      // This ray is to be refracted, or reflected as often as the Fresnel reflectance says. The selection past the
+      // mirror cutoff is uniform, it decides between both.
       constexpr float AIR_REFRACTIVE_INDEX = 1.000293f;
 
-      float incident_refractive_index;
-      float medium_refractive_index;
-      Vec3 refraction_normal;
-
-      if (kmath::dot(p_ray_direction, p_normal) <= 0.0f) {
-        incident_refractive_index = AIR_REFRACTIVE_INDEX;
-        medium_refractive_index = refractive_index;
-        refraction_normal = -p_normal;
-      } else {
-        incident_refractive_index = refractive_index;
-        medium_refractive_index = AIR_REFRACTIVE_INDEX;
-        refraction_normal = p_normal;
-      }
-
-      const kmath::Line3 axis = kmath::meet(
-        Plane3::plane(refraction_normal, 0.0f),
-        Plane3::plane(p_ray_direction, 0.0f)
-      );;
+      const float cos_incident = -dot(p_ray_direction, p_normal);
+      const bool entering = cos_incident >= 0.0f;
+      const float incident_refractive_index = (entering)? AIR_REFRACTIVE_INDEX : refractive_index;
+      const float medium_refractive_index = (entering)? refractive_index : AIR_REFRACTIVE_INDEX;
+      const Vec3 facing_normal = (entering)? p_normal : -p_normal;
 
-      const float sin_incident_angle = kmath::magnitude(axis);
-      const float sin_refracted_angle = incident_refractive_index * sin_incident_angle / medium_refractive_index;
-
-      if (sin_refracted_angle > 1.0f) {
-        // The ray cannot be bounced, it is reflected
-        const Vec3 reflected_direction = reflect(p_ray_direction, p_normal);
-        return std::pair(reflected_direction, transparancy);
+      Vec3 refracted_direction;
+      if (!refract(p_ray_direction, facing_normal, incident_refractive_index / medium_refractive_index, refracted_direction)) {
+        // Total internal reflection
+        return std::pair(reflect(p_ray_direction, p_normal), transparancy);
       }
 
-      const kmath::Rotor3 rotation = kmath::get_real_part(kmath::exp(sin_refracted_angle * kmath::normalized(axis)));
-
-      return std::pair(
-        kmath::transform(refraction_normal, rotation),
-        transparancy
-      );
+      const float fresnel_cos = (incident_refractive_index <= medium_refractive_index)? std::abs(cos_incident) : -dot(refracted_direction, facing_normal);
+      const float reflectance = get_schlick_reflectance(fresnel_cos, incident_refractive_index, medium_refractive_index);
+      if (selection - mirror_cutoff < reflectance * transparancy) {
+        return std::pair(reflect(p_ray_direction, p_normal), transparancy);
+      }
+      return std::pair(refracted_direction, transparancy);
     }
   }
 };
@@ -0,0 +1,377 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+#include "render.hpp"
+
+#include "tp_utils/src/data_structures/gradient.hpp"
+#include "utils/profiler.hpp"
+#include "utils/statistics.hpp"
+#include "utils/thread_group.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
+
+
+// ===========
+// = Cameras =
+// ===========
+
+
+CameraRays CameraRays::from_camera(const tputils::Camera3D &p_camera, const size_t p_image_width, const size_t p_image_height, const float p_near_plane) {
+  using namespace kmath;
+  const float aspect_ratio = static_cast<float>(p_image_width) / static_cast<float>(p_image_height);
+
+  const Mat4 inv_proj = inverse(p_camera.get_projection_matrix(aspect_ratio));
+  const Mat4 inv_view = p_camera.get_inverse_view_matrix();
+
+  CameraRays camera_rays;
+  camera_rays.inv_projection_view = inv_view * inv_proj;
+  camera_rays.position = homogeneous_projection(inv_view * Vec4(Vec3::ZERO, 1.0));
+  camera_rays.near_plane = p_near_plane;
+  camera_rays.inv_image_width = 1.0f / static_cast<float>(p_image_width);
+  camera_rays.inv_image_height = 1.0f / static_cast<float>(p_image_height);
+  return camera_rays;
+}
+
+
+// ===============
+// = Tonemapping =
+// ===============
+
+
+float get_luminance(const kmath::Lrgb &p_color) {
+  return 0.2126f * p_color.x + 0.7152f * p_color.y + 0.0722f * p_color.z;
+}
+
+
+// Polynomial approximation of EaryChow's AgX sigmoid curve.
+// x must be within the range [0.0, 1.0]
+kmath::Vec3 agx_contrast_approx(kmath::Vec3 x) {
+	// Generated with Excel trendline
+	// Input data: Generated using python sigmoid with EaryChow's configuration and 57 steps
+	// Additional padding values were added to give correct intersections at 0.0 and 1.0
+	// 6th order, intercept of 0.0 to remove an operation and ensure intersection at 0.0
+	kmath::Vec3 x2 = x * x;
+	kmath::Vec3 x4 = x2 * x2;
+	return 0.021f * x + 4.0111f * x2 - 25.682f * x2 * x + 70.359f * x4 - 74.778f * x4 * x + 27.069f * x4 * x2;
+}
+
+// This code is adapted from the Godot game engine
+// This is an approximation and simplification of EaryChow's AgX implementation that is used by Blender.
+// This code is based off of the script that generates the AgX_Base_sRGB.cube LUT that Blender uses.
+// Source: https://github.com/EaryChow/AgX_LUT_Gen/blob/main/AgXBasesRGB.py
+kmath::Vec3 tonemap_agx(kmath::Vec3 color) {
+	// Combined linear sRGB to linear Rec 2020 and Blender AgX inset matrices:
+	const kmath::Mat3 srgb_to_rec2020_agx_inset_matrix = kmath::Mat3(
+    kmath::Vec3(0.54490813676363087053, 0.14044005884001287035, 0.088827411851915368603),
+    kmath::Vec3(0.37377945959812267119, 0.75410959864013760045, 0.17887712465043811023),
+    kmath::Vec3(0.081384976686407536266, 0.10543358536857773485, 0.73224999956948382528)
+	);
+
+	// Combined inverse AgX outset matrix and linear Rec 2020 to linear sRGB matrices.
+	const kmath::Mat3 agx_outset_rec2020_to_srgb_matrix = kmath::Mat3(
+    kmath::Vec3(1.9645509602733325934, -0.29932243390911083839, -0.16436833806080403409),
+    kmath::Vec3(-0.85585845117807513559, 1.3264510741502356555, -0.23822464068860595117),
+    kmath::Vec3(-0.10886710826831608324, -0.027084020983874825605, 1.402665347143271889)
+  );
+
+	// LOG2_MIN      = -10.0
+	// LOG2_MAX      =  +6.5
+	// MIDDLE_GRAY   =  0.18
+	const float min_ev = -12.4739311883324;
+	const float max_ev = 4.02606881166759;
+
+	// Large negative values in one channel and large positive values in other
+	// channels can result in a colour that appears darker and more saturated than
+	// desired after passing it through the inset matrix. For this reason, it is
+	// best to prevent negative input values.
+	// This is done before the Rec. 2020 transform to allow the Rec. 2020
+	// transform to be combined with the AgX inset matrix. This results in a loss
+	// of color information that could be correctly interpreted within the
+	// Rec. 2020 color space as positive RGB values, but it is less common for Godot
+	// to provide this function with negative sRGB values and therefore not worth
+	// the performance cost of an additional matrix multiplication.
+	// A value of 2e-10 intentionally introduces insignificant error to prevent
+	// log2(0.0) after the inset matrix is applied; color will be >= 1e-10 after
+	// the matrix transform.
+	color = kmath::max(color, 2e-10f * kmath::Vec3::ONE);
+
+	// Do AGX in rec2020 to match Blender and then apply inset matrix.
+	color = srgb_to_rec2020_agx_inset_matrix * color;
+
+	// Log2 space encoding.
+	// Must be clamped because agx_contrast_approx may not work
+	// well with values outside of the range [0.0, 1.0]
+	color = kmath::apply(color, [](const float x) -> float { return std::log2(x); });
+	color = kmath::apply(color, [&](const float x) -> float { return std::clamp(x, min_ev, max_ev); });
+	color = (color - min_ev * kmath::Vec3::ONE) / (max_ev - min_ev);
+
+	// Apply sigmoid function approximation.
+	color = agx_contrast_approx(color);
+
+	// Convert back to linear before applying outset matrix.
+	color = kmath::apply(color, [](const float x) -> float { return pow(x, 2.4f); });
+
+	// Apply outset to make the result more chroma-laden and then go back to linear sRGB.
+	color = agx_outset_rec2020_to_srgb_matrix * color;
+
+	return color;
+}
+
+
+// =============
+// = Rendering =
+// =============
+
+
+RenderResult render_scene(const Scene &p_scene, const CameraRays &p_camera_rays, const size_t p_image_width, const size_t p_image_height, const RenderSettings &p_settings, ThreadPool *p_pool) {
+  using namespace kmath;
+
+  const size_t image_width = p_image_width;
+  const size_t image_height = p_image_height;
+
+  RenderResult result{
+    .hdr_image = Image(image_width, image_height),
+    .image = Image(image_width, image_height),
+    .performance_heat_map = Image(image_width, image_height),
+    .sample_count_heat_map = Image(image_width, image_height),
+  };
+  Image &image = result.hdr_image;
+  std::vector<unsigned int> pixel_sample_count(image_width * image_height);
+
+  std::vector<uint64_t> pixel_time(image_width * image_height);
+  tputils::Gradient performance_gradient;
+  performance_gradient.set_outside_color(Lrgb(1.0f, 1.0f, 1.0f));
+  performance_gradient.add_point(Lrgb(0.012f, 0.035f, 0.057f), 0.0f);
+  performance_gradient.add_point(Lrgb(0.031f, 0.205f, 0.011f), 0.25f);
+  performance_gradient.add_point(Lrgb(0.759f, 0.483f, 0.045f), 0.5f);
+  performance_gradient.add_point(Lrgb(0.504f, 0.169f, 0.039f), 0.75f);
+  performance_gradient.add_point(Lrgb(0.950f, 0.011f, 0.005f), 1.0f);
+
+  Profiler full_render_profile;
+  full_render_profile.start();
+  {
+    Profiler specific_profiler;
+
+    ThreadPool *pool = p_pool;
+    const size_t thread_count = pool->get_thread_count();
+    std::cout << "Ray tracing a " << image_width << " x " << image_height << " image on " << thread_count << " threads" << std::endl;
+
+    // Every pass works on the pixels of the image, in tiles handed out from the center of the image
+    TileSettings tile_settings;
+    tile_settings.row_length = image_width;
+    tile_settings.tile_width = 16;
+    tile_settings.tile_height = 16;
+    tile_settings.order = TileSettings::Order::CENTER_OUT;
+    const std::vector<Tile> tiles = build_tiles(0, image.get_size(), tile_settings);
+
+    // Lambda to run a graph of rendering passes
+    auto exec_graph = [&](const char *p_graph_name, TaskGraph &p_graph) -> void {
+      specific_profiler.start();
+
+      // Start work
+      pool->submit(p_graph);
+
+      // Report progress
+      while (!p_graph.is_done()) {
+        const double progress = p_graph.get_progress();
+        const size_t ticks = progress * 40;
+        std::cout << "\r" << p_graph_name << ": <";
+        for (size_t i = 0; i < ticks; i++) {
+          std::cout << "=";
+        }
+        for (size_t i = ticks; i < 40; i++) {
+          std::cout << "-";
+        }
+        std::cout << "> " << std::setprecision(4) << progress * 100.0 << "%   ";
+        std::flush(std::cout);
+      
+        using namespace std::chrono_literals;
+        std::this_thread::sleep_for(1ms);
+      }
+
+      pool->wait(p_graph);
+      specific_profiler.end();
+
+      std::cout << "\e[1M\r"; // Clear the line giving progress
+      std::cout << "\t" << p_graph_name << " finished in " << specific_profiler.get_exec_time() << std::endl;
+    };
+
+    std::uniform_real_distribution<float> randf;
+
+    // Get the maximum execution time per thread
+    std::vector<size_t> exec_times(thread_count);
+
+    auto render_pixel = [&](const size_t p_thread_id, const size_t p_exec_index) -> void {
+      Profiler pixel_profiler;
+      pixel_profiler.start();
+
+      const size_t x = p_exec_index % image_width;
+      const size_t y = p_exec_index / image_width;
+
+      // The samples of a pixel are the most coherent rays, each batch is traced as packets
+      RunningStatistics luminance_statistics;
+      Lrgb color_sum;
+      unsigned int sample_count = 0;
+
+      while (sample_count < p_settings.max_sample_count) {
+        const unsigned int batch_size = std::min(
+          (sample_count == 0)? std::max(p_settings.min_sample_count, MIN_ADAPTIVE_SAMPLE_COUNT) : p_settings.sample_batch_size,
+          p_settings.max_sample_count - sample_count
+        );
+
+        for (unsigned int packet_start = 0; packet_start < batch_size; packet_start += MAX_RAY_PACKET_SIZE) {
+          const size_t packet_size = std::min<size_t>(batch_size - packet_start, MAX_RAY_PACKET_SIZE);
+          Ray packet_rays[MAX_RAY_PACKET_SIZE];
+          Lrgb packet_colors[MAX_RAY_PACKET_SIZE];
+          Sampler packet_samplers[MAX_RAY_PACKET_SIZE];
+
+          for (size_t s = 0; s < packet_size; s++) {
+            Sampler &sampler = packet_samplers[s];
+            sampler = Sampler(p_settings.sampler_type, p_settings.random_seed, x, y, sample_count + packet_start + s);
+            packet_rays[s] = p_camera_rays.get_ray((float)x + randf(sampler), (float)y + randf(sampler));
+          }
+
+          p_scene.ray_trace_packet(std::span<Sampler>(packet_samplers, packet_size), std::span<const Ray>(packet_rays, packet_size), packet_colors, p_settings.bounce_count);
+
+          for (size_t s = 0; s < packet_size; s++) {
+            color_sum += packet_colors[s];
+            luminance_statistics.push(get_luminance(packet_colors[s]));
+          }
+        }
+        sample_count += batch_size;
+
+        // Stop once the mean is known precisely enough, the remaining budget goes to the noisier pixels
+        const double tolerance = p_settings.max_relative_error * std::max<double>(luminance_statistics.mean, p_settings.min_luminance);
+        if (luminance_statistics.get_confidence_interval() <= tolerance) {
+          break;
+        }
+      }
+
+      image(p_exec_index) = color_sum / static_cast<float>(sample_count);
+      pixel_sample_count[p_exec_index] = sample_count;
+
+      pixel_profiler.end();
+
+      // Write execution time
+      const size_t exec_time = pixel_profiler.get_exec_time_nanoseconds();
+      pixel_time[p_exec_index] = exec_time;
+      if (exec_time > exec_times[p_thread_id]) {
+        exec_times[p_thread_id] = exec_time;
+      }
+    };
+
+    auto time_scale_function = [&](const double p_time) -> double {
+      return std::sqrt(p_time * 1e-6);
+    };
+    double max_exec_time = 0.0;
+
+    // The passes are chained per tile: a tile is tone mapped as soon as it is rendered, without waiting for the others
+    TaskGraph render_graph;
+    std::vector<TaskID> render_tasks;
+    for (const Tile &tile : tiles) {
+      const TaskID render_task = render_graph.add_task([&, tile](const size_t p_thread_id) -> void {
+        for_each_tile_index(tile, image_width, image.get_size(), [&](const size_t p_exec_index) {
+          render_pixel(p_thread_id, p_exec_index);
+        });
+      });
+      render_tasks.push_back(render_task);
+
+      render_graph.add_task([&, tile]([[maybe_unused]] const size_t p_thread_id) -> void {
+        for_each_tile_index(tile, image_width, image.get_size(), [&](const size_t p_exec_index) {
+          result.image(p_exec_index) = tonemap_agx(image(p_exec_index));
+        });
+      }, {render_task});
+    }
+
+    // The performance heat map is scaled by the slowest pixel, which is only known once every tile is rendered
+    const TaskID max_exec_time_task = render_graph.add_task([&]([[maybe_unused]] const size_t p_thread_id) -> void {
+      const size_t max_exec_time_l = *std::max_element(exec_times.begin(), exec_times.end());
+      max_exec_time = time_scale_function(static_cast<double>(max_exec_time_l));
+    }, render_tasks);
+
+    for (const Tile &tile : tiles) {
+      render_graph.add_task([&, tile]([[maybe_unused]] const size_t p_thread_id) -> void {
+        for_each_tile_index(tile, image_width, image.get_size(), [&](const size_t p_exec_index) {
+          const double pixel_exec_time = time_scale_function(static_cast<double>(pixel_time[p_exec_index]));
+          const double time_prop = pixel_exec_time / max_exec_time;
+          result.performance_heat_map(p_exec_index) = performance_gradient.sample(time_prop);
+
+          const double sample_prop = static_cast<double>(pixel_sample_count[p_exec_index]) / static_cast<double>(p_settings.max_sample_count);
+          result.sample_count_heat_map(p_exec_index) = performance_gradient.sample(sample_prop);
+        });
+      }, {max_exec_time_task});
+    }
+
+    exec_graph("Scene render", render_graph);
+  }
+  full_render_profile.end();
+  std::cout << "\tRender done in " << full_render_profile.get_exec_time() << std::endl;
+
+  for (const unsigned int count : pixel_sample_count) {
+    result.total_sample_count += count;
+  }
+  std::cout << "\t" << static_cast<double>(result.total_sample_count) / static_cast<double>(image.get_size()) << " samples per pixel on average" << std::endl;
+
+  return result;
+}
+
+
+bool write_image(const Image &p_image, const std::filesystem::path &p_path) {
+  const std::optional<Image::FileFormat> format = Image::get_file_format(p_path);
+  if (!format) {
+    std::cout << "Unsupported image format: " << p_path.string() << std::endl;
+    return false;
+  }
+
+  std::ofstream f(p_path, std::ios::binary);
+  if (f.fail()) {
+    std::cout << "Could not open file: " << p_path.string() << std::endl;
+    return false;
+  }
+  p_image.write(f, *format);
+  f.close();
+  return true;
+}
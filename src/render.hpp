@@ -0,0 +1,115 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+#pragma once
+
+
+#include "thirdparty/kmath/matrix.hpp"
+#include "thirdparty/kmath/vector.hpp"
+#include "tp_utils/src/rendering/camera.hpp"
+
+#include "geometry/ray.hpp"
+#include "utils/image.hpp"
+#include "utils/sampler.hpp"
+#include "utils/thread_pool.hpp"
+#include "scene.hpp"
+
+#include <cstdint>
+#include <filesystem>
+
+
+// Primary rays of a camera, through the pixels of an image
+struct CameraRays {
+  kmath::Mat4 inv_projection_view;
+  kmath::Vec3 position;
+  float near_plane;
+  float inv_image_width;
+  float inv_image_height;
+
+public:
+  // p_x and p_y are in pixels, from the top left corner of the image
+  inline Ray get_ray(const float p_x, const float p_y) const {
+    using namespace kmath;
+    const float u = p_x * inv_image_width;
+    const float v = p_y * inv_image_height;
+    const Vec3 ray_direction = homogeneous_projection(inv_projection_view * Vec4(2.0f * u - 1.0f, -2.0f * v + 1.0f, -near_plane, 1.0)) - position;
+    return Ray(position, ray_direction);
+  }
+
+  // p_near_plane is the near end of the depth range, 0 unless the OpenGL depth range was changed
+  static CameraRays from_camera(const tputils::Camera3D &p_camera, const size_t p_image_width, const size_t p_image_height, const float p_near_plane = 0.0f);
+};
+
+
+constexpr unsigned int MIN_ADAPTIVE_SAMPLE_COUNT = 2;
+
+
+struct RenderSettings {
+  // The pixels are sampled in batches, until the 95% confidence interval of their mean luminance is within
+  // max_relative_error of the mean (or of min_luminance for dark pixels), or until max_sample_count is reached.
+  // The first batch has at least MIN_ADAPTIVE_SAMPLE_COUNT samples, fewer do not give a variance to test.
+  unsigned int min_sample_count = 16;
+  unsigned int max_sample_count = 256;
+  unsigned int sample_batch_size = 16;
+  float max_relative_error = 0.1f;
+  float min_luminance = 0.05f;
+
+  int bounce_count = 8; // Maximum, most paths are stopped earlier by Russian roulette
+  uint32_t random_seed = 47;
+  SamplerType sampler_type = SamplerType::SOBOL;
+};
+
+
+struct RenderResult {
+  Image hdr_image; // Mean radiance of the samples
+  Image image; // Tone mapped
+  Image performance_heat_map;
+  Image sample_count_heat_map;
+  size_t total_sample_count = 0;
+};
+
+
+// Relative luminance of a linear sRGB color (Rec. 709 primaries)
+float get_luminance(const kmath::Lrgb &p_color);
+kmath::Vec3 tonemap_agx(kmath::Vec3 color);
+
+// Path traces p_scene on the threads of p_pool, reporting the progress on the standard output
+RenderResult render_scene(const Scene &p_scene, const CameraRays &p_camera_rays, const size_t p_image_width, const size_t p_image_height, const RenderSettings &p_settings, ThreadPool *p_pool = ThreadPool::get_singleton());
+
+// The format is given by the extension of p_path (ppm, pfm, hdr or png). Returns false if the file could not be written.
+bool write_image(const Image &p_image, const std::filesystem::path &p_path);
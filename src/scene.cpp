@@ -39,10 +39,12 @@
 #include "geometry/ray.hpp"
 #include "geometry/light.hpp"
 #include "material.hpp"
-#include "utils/renderer.hpp"
 
+#include <cassert>
+#include <cfloat>
 #include <optional>
 #include <random>
+#include <span>
 #include <variant>
 
 
@@ -52,41 +54,176 @@ using namespace kmath;
 RayIntersection Scene::compute_intersection(const Ray &p_ray) const {
   RayIntersection result;
 
-  // Sphere intersection
-  for (size_t i = 0; i < spheres.size(); i++) {
-    RaySphereIntersection rsph = spheres[i].intersect(p_ray);
-    if (rsph.exists && rsph.distance < result.intersection.common.distance) {
-      result.intersection.rsph = rsph;
-      result.element_id = i;
-      result.kind = RayIntersection::Kind::RAY_SPHERE;
+  object_bvh.traverse(p_ray, [&](const uint32_t p_object_index) -> float {
+    const SceneObject &object = objects[p_object_index];
+
+    switch (object.kind) {
+    case RayIntersection::Kind::RAY_SPHERE: {
+      RaySphereIntersection rsph = spheres[object.element_id].intersect(p_ray);
+      if (rsph.exists && rsph.distance < result.intersection.common.distance) {
+        result.intersection.rsph = rsph;
+        result.element_id = object.element_id;
+        result.kind = object.kind;
+      }
+      break;
+    }
+    case RayIntersection::Kind::RAY_SQUARE: {
+      RaySquareIntersection rsqu = squares[object.element_id].intersect(p_ray);
+      if (rsqu.exists && rsqu.distance < result.intersection.common.distance) {
+        result.intersection.rsqu = rsqu;
+        result.element_id = object.element_id;
+        result.kind = object.kind;
+      }
+      break;
+    }
+    case RayIntersection::Kind::RAY_MESH: {
+      RayMeshIntersection rmsh = meshes[object.element_id].intersect(p_ray);
+      if (rmsh.exists && rmsh.distance < result.intersection.common.distance) {
+        result.intersection.rmsh = rmsh;
+        result.element_id = object.element_id;
+        result.kind = object.kind;
+      }
+      break;
+    }
+    case RayIntersection::Kind::NONE:
+      break;
     }
-  }
 
-  // Square intersection
-  for (size_t i = 0; i < squares.size(); i++) {
-    RaySquareIntersection rsqu = squares[i].intersect(p_ray);
-    if (rsqu.exists && rsqu.distance < result.intersection.common.distance) {
-      result.intersection.rsqu = rsqu;
-      result.element_id = i;
-      result.kind = RayIntersection::Kind::RAY_SQUARE;
+    return result.intersection.common.distance;
+  });
+
+  return result;
+}
+
+
+bool Scene::occluded(const Ray &p_ray, const float p_max_distance) const {
+  return object_bvh.any_hit(p_ray, p_max_distance, [&](const uint32_t p_object_index) -> bool {
+    const SceneObject &object = objects[p_object_index];
+
+    switch (object.kind) {
+    case RayIntersection::Kind::RAY_SPHERE:
+      return spheres[object.element_id].occluded(p_ray, p_max_distance);
+    case RayIntersection::Kind::RAY_SQUARE:
+      return squares[object.element_id].occluded(p_ray, p_max_distance);
+    case RayIntersection::Kind::RAY_MESH:
+      return meshes[object.element_id].occluded(p_ray, p_max_distance);
+    case RayIntersection::Kind::NONE:
+      return false;
     }
-  }
+    return false;
+  });
+}
 
-  // Mesh intersection
-  for (size_t i = 0; i < meshes.size(); i++) {
-    RayMeshIntersection rmsh = meshes[i].intersect(p_ray);
-    if (rmsh.exists && rmsh.distance < result.intersection.common.distance) {
-      result.intersection.rmsh = rmsh;
-      result.element_id = i;
-      result.kind = RayIntersection::Kind::RAY_MESH;
+
+void Scene::intersect_packet(std::span<const Ray> p_rays, std::span<RayIntersection> r_intersections) const {
+  assert(p_rays.size() <= MAX_RAY_PACKET_SIZE && r_intersections.size() >= p_rays.size());
+  const RayMask packet_mask = get_ray_mask(p_rays.size());
+
+  float closest_distances[MAX_RAY_PACKET_SIZE];
+  for_each_ray(packet_mask, [&](const size_t p_ray_index) {
+    r_intersections[p_ray_index] = RayIntersection();
+    closest_distances[p_ray_index] = FLT_MAX;
+  });
+
+  auto record_hit = [&](const size_t p_ray_index, const RayIntersection &p_intersection, const SceneObject &p_object) {
+    r_intersections[p_ray_index] = p_intersection;
+    r_intersections[p_ray_index].element_id = p_object.element_id;
+    closest_distances[p_ray_index] = p_intersection.intersection.common.distance;
+  };
+
+  object_bvh.traverse_packet(p_rays, packet_mask, closest_distances, [&](const uint32_t p_object_index, const RayMask p_active_mask) {
+    const SceneObject &object = objects[p_object_index];
+
+    switch (object.kind) {
+    case RayIntersection::Kind::RAY_SPHERE: {
+      for_each_ray(p_active_mask, [&](const size_t p_ray_index) {
+        const RaySphereIntersection rsph = spheres[object.element_id].intersect(p_rays[p_ray_index]);
+        if (rsph.exists && rsph.distance < closest_distances[p_ray_index]) {
+          record_hit(p_ray_index, RayIntersection::from(rsph), object);
+        }
+      });
+      break;
     }
+    case RayIntersection::Kind::RAY_SQUARE: {
+      for_each_ray(p_active_mask, [&](const size_t p_ray_index) {
+        const RaySquareIntersection rsqu = squares[object.element_id].intersect(p_rays[p_ray_index]);
+        if (rsqu.exists && rsqu.distance < closest_distances[p_ray_index]) {
+          record_hit(p_ray_index, RayIntersection::from(rsqu), object);
+        }
+      });
+      break;
+    }
+    case RayIntersection::Kind::RAY_MESH: {
+      RayMeshIntersection rmshs[MAX_RAY_PACKET_SIZE];
+      const RayMask hit_mask = meshes[object.element_id].intersect_packet(p_rays, p_active_mask, closest_distances, rmshs);
+      for_each_ray(hit_mask, [&](const size_t p_ray_index) {
+        record_hit(p_ray_index, RayIntersection::from(rmshs[p_ray_index]), object);
+      });
+      break;
+    }
+    case RayIntersection::Kind::NONE:
+      break;
+    }
+  });
+}
+
+
+RayMask Scene::occluded_packet(std::span<const Ray> p_rays, std::span<const float> p_max_distances) const {
+  assert(p_rays.size() <= MAX_RAY_PACKET_SIZE && p_max_distances.size() >= p_rays.size());
+
+  return object_bvh.any_hit_packet(p_rays, get_ray_mask(p_rays.size()), p_max_distances, [&](const uint32_t p_object_index, const RayMask p_active_mask) -> RayMask {
+    const SceneObject &object = objects[p_object_index];
+    RayMask occluded_mask = 0;
+
+    switch (object.kind) {
+    case RayIntersection::Kind::RAY_SPHERE:
+      for_each_ray(p_active_mask, [&](const size_t p_ray_index) {
+        if (spheres[object.element_id].occluded(p_rays[p_ray_index], p_max_distances[p_ray_index])) {
+          occluded_mask |= RayMask(1) << p_ray_index;
+        }
+      });
+      break;
+    case RayIntersection::Kind::RAY_SQUARE:
+      for_each_ray(p_active_mask, [&](const size_t p_ray_index) {
+        if (squares[object.element_id].occluded(p_rays[p_ray_index], p_max_distances[p_ray_index])) {
+          occluded_mask |= RayMask(1) << p_ray_index;
+        }
+      });
+      break;
+    case RayIntersection::Kind::RAY_MESH:
+      occluded_mask = meshes[object.element_id].occluded_packet(p_rays, p_active_mask, p_max_distances);
+      break;
+    case RayIntersection::Kind::NONE:
+      break;
+    }
+
+    return occluded_mask;
+  });
+}
+
+
+void Scene::update_acceleration_structure() {
+  objects.clear();
+  std::vector<tputils::AABB> objects_aabb;
+
+  for (size_t i = 0; i < spheres.size(); i++) {
+    objects.push_back(SceneObject{RayIntersection::Kind::RAY_SPHERE, i});
+    objects_aabb.push_back(spheres[i].get_aabb());
+  }
+  for (size_t i = 0; i < squares.size(); i++) {
+    objects.push_back(SceneObject{RayIntersection::Kind::RAY_SQUARE, i});
+    objects_aabb.push_back(squares[i].get_aabb());
+  }
+  for (size_t i = 0; i < meshes.size(); i++) {
+    objects.push_back(SceneObject{RayIntersection::Kind::RAY_MESH, i});
+    objects_aabb.push_back(meshes[i].get_aabb());
   }
 
-  return result;
+  object_bvh = ObjectBVH::build_object_bvh(objects_aabb);
 }
 
 
-Vec3 Scene::_intersection_get_color(std::mt19937 &p_rng, const Ray &p_ray, const RayIntersection &p_intersection) const {
+Vec3 Scene::_intersection_get_color(Sampler &p_sampler, const Ray &p_ray, const RayIntersection &p_intersection) const {
   switch (p_intersection.kind) {
   case RayIntersection::Kind::RAY_SPHERE: {
     const Sphere &sphere = spheres[p_intersection.element_id];
@@ -97,7 +234,7 @@ Vec3 Scene::_intersection_get_color(std::mt19937 &p_rng, const Ray &p_ray, const
       -p_ray.direction,
       rsph.uv,
       0.1f * Lrgb::ONE,
-      p_rng,
+      p_sampler,
       lights
     );
   }
@@ -110,7 +247,7 @@ Vec3 Scene::_intersection_get_color(std::mt19937 &p_rng, const Ray &p_ray, const
       -p_ray.direction,
       rsqu.uv,
       0.1f * Lrgb::ONE,
-      p_rng,
+      p_sampler,
       lights
     );
   }
@@ -123,7 +260,7 @@ Vec3 Scene::_intersection_get_color(std::mt19937 &p_rng, const Ray &p_ray, const
       -p_ray.direction,
       rmsh.uv,
       0.1f * Lrgb::ONE,
-      p_rng,
+      p_sampler,
       lights
     );
   }
@@ -155,7 +292,65 @@ std::optional<const Material*> Scene::_intersection_get_material(const RayInters
 }
 
 
-Lrgb Scene::ray_trace_recursive(std::mt19937 &p_rng, const Ray &p_ray, const int p_bounce_count) const {
+Scene::SurfaceHit Scene::_get_surface_hit(const RayIntersection &p_intersection) const {
+  const Vec3 normal = p_intersection.intersection.common.normal;
+  return SurfaceHit{
+    _intersection_get_material(p_intersection).value(),
+    p_intersection.intersection.common.position + 0.0001f * normal,
+    normal,
+    p_intersection.intersection.common.uv,
+  };
+}
+
+
+Lrgb Scene::_get_direct_lighting(Sampler &p_sampler, const Ray &p_ray, const SurfaceHit &p_surface) const {
+  Lrgb color = p_surface.material->get_ambiant_contribution(p_surface.uv);
+
+  for (const Light &light : lights) {
+    const Vec3 light_position = std::visit([&](const auto &p_shape) -> Vec3 { return p_shape(p_sampler); }, light.shape);
+    const Vec3 light_direction = light_position - p_surface.position;
+    const float light_distance = length(light_direction);
+    const Ray light_ray = Ray(p_surface.position, light_direction);
+
+    if (occluded(light_ray, light_distance)) {
+      continue;
+    }
+
+    color += p_surface.material->get_light_influence(p_surface.position, p_surface.normal, p_ray.direction, p_surface.uv, light.data, light_position);
+  }
+
+  return color;
+}
+
+
+void Scene::_bounce_ray(Sampler &p_sampler, const RayIntersection &p_intersection, const SurfaceHit &p_surface, Ray &r_ray, float &r_contribution) const {
+  const auto [bounce_direction, bounce_strength] = p_surface.material->bounce(p_sampler, r_ray.direction, p_surface.normal);
+  r_contribution *= bounce_strength;
+
+  const float bounce_dir_sign = kmath::sign(kmath::dot(bounce_direction, p_surface.normal));
+  const Vec3 bounce_point = p_intersection.intersection.common.position + bounce_dir_sign * 0.0001f * p_surface.normal;
+
+  r_ray = Ray(bounce_point, bounce_direction);
+}
+
+
+bool Scene::_survive_roulette(Sampler &p_sampler, const float p_throughput, float &r_contribution) const {
+  if (r_contribution <= 0.0f) {
+    return false;
+  }
+  if (p_sampler.get_bounce() + 1 < ROULETTE_START_BOUNCE) {
+    return true;
+  }
+  const float survival_probability = std::min(1.0f, p_throughput * r_contribution / ROULETTE_THROUGHPUT);
+  if (std::uniform_real_distribution<float>()(p_sampler) >= survival_probability) {
+    return false;
+  }
+  r_contribution /= survival_probability;
+  return true;
+}
+
+
+Lrgb Scene::ray_trace_recursive(Sampler &p_sampler, const Ray &p_ray, const int p_bounce_count, const float p_throughput) const {
   Lrgb color = Lrgb::ZERO;
   Ray ray = p_ray;
   float bounce_contribution = 1.0;
@@ -168,67 +363,95 @@ Lrgb Scene::ray_trace_recursive(std::mt19937 &p_rng, const Ray &p_ray, const int
     }
 
     // Apply lights
-    const Material &intersection_material = *_intersection_get_material(scene_inter).value();
-    const Vec3 intersection_normal = scene_inter.intersection.common.normal;
-    const Vec3 intersection_point = scene_inter.intersection.common.position + 0.0001f * intersection_normal;
-    const Vec2 intersection_uv = scene_inter.intersection.common.uv;
-    Lrgb bounce_color = intersection_material.get_ambiant_contribution(intersection_uv);
-
-    for (const Light &light : lights) {
-      const Vec3 light_position = std::visit([&](const auto &p_shape) -> Vec3 { return p_shape(p_rng); }, light.shape);
-      const Vec3 light_direction = light_position - intersection_point;
-      const float light_distance = length(light_direction);
-      const Ray light_ray = Ray(intersection_point, light_direction);
-
-      const RayIntersection light_intersection = compute_intersection(light_ray);
-
-      if (light_intersection.intersection.common.exists &&
-          light_intersection.intersection.common.distance < light_distance) {
-        continue;
-      }
+    const SurfaceHit surface = _get_surface_hit(scene_inter);
+    color += bounce_contribution * _get_direct_lighting(p_sampler, ray, surface);
 
-      bounce_color += intersection_material.get_light_influence(intersection_point, intersection_normal, ray.direction, intersection_uv, light.data, light_position);
+    if (bounce == p_bounce_count) {
+      break;
     }
 
-    // Add bounce contribution
-    color += bounce_contribution * bounce_color;
-
     // Setup for the next light bounce
-    const auto [bounce_direction, bounce_strength] = intersection_material.bounce(p_rng, ray.direction, intersection_normal);
-    bounce_contribution *= bounce_strength;
-
-    const float bounce_dir_sign = kmath::sign(kmath::dot(bounce_direction, intersection_normal));
-    const Vec3 bounce_point = scene_inter.intersection.common.position + bounce_dir_sign * 0.0001f * intersection_normal;
-
-    ray = Ray(bounce_point, bounce_direction);
+    _bounce_ray(p_sampler, scene_inter, surface, ray, bounce_contribution);
+    if (!_survive_roulette(p_sampler, p_throughput, bounce_contribution)) {
+      break;
+    }
+    p_sampler.next_bounce();
   }
   
   return color;
 }
 
 
-Lrgb Scene::ray_trace(std::mt19937 &p_rng, const Ray &p_ray_start) const {
-  RayIntersection inter = compute_intersection(p_ray_start);
-  return _intersection_get_color(p_rng, p_ray_start, inter);
-}
+void Scene::ray_trace_packet(std::span<Sampler> p_samplers, std::span<const Ray> p_rays, std::span<Lrgb> r_colors, const int p_bounce_count) const {
+  const size_t ray_count = p_rays.size();
+  assert(ray_count <= MAX_RAY_PACKET_SIZE && r_colors.size() >= ray_count && p_samplers.size() >= ray_count);
 
+  RayIntersection intersections[MAX_RAY_PACKET_SIZE];
+  intersect_packet(p_rays, intersections);
 
-void Scene::draw() const {
-  for(size_t i = 0 ; i < meshes.size() ; ++i) {
-    const Mesh &mesh = meshes[i];
-    mesh.draw();
+  RayMask hit_mask = 0;
+  SurfaceHit surfaces[MAX_RAY_PACKET_SIZE];
+  for (size_t i = 0; i < ray_count; i++) {
+    r_colors[i] = Lrgb::ZERO;
+    if (intersections[i].intersection.common.exists) {
+      hit_mask |= RayMask(1) << i;
+      surfaces[i] = _get_surface_hit(intersections[i]);
+      r_colors[i] = surfaces[i].material->get_ambiant_contribution(surfaces[i].uv);
+    }
   }
-  for(size_t i = 0 ; i < spheres.size() ; ++i) {
-    const Sphere &sphere = spheres[i];
-    Renderer::get_singleton()->draw_sphere(sphere);
+
+  // Direct lighting of the first hits, the shadow rays towards a light start close to each other and are traced together
+  size_t hit_rays[MAX_RAY_PACKET_SIZE];
+  size_t hit_count = 0;
+  for_each_ray(hit_mask, [&](const size_t p_ray_index) {
+    hit_rays[hit_count++] = p_ray_index;
+  });
+
+  for (const Light &light : lights) {
+    Ray light_rays[MAX_RAY_PACKET_SIZE];
+    Vec3 light_positions[MAX_RAY_PACKET_SIZE];
+    float light_distances[MAX_RAY_PACKET_SIZE];
+
+    for (size_t i = 0; i < hit_count; i++) {
+      const SurfaceHit &surface = surfaces[hit_rays[i]];
+      Sampler &sampler = p_samplers[hit_rays[i]];
+      light_positions[i] = std::visit([&](const auto &p_shape) -> Vec3 { return p_shape(sampler); }, light.shape);
+      const Vec3 light_direction = light_positions[i] - surface.position;
+      light_distances[i] = length(light_direction);
+      light_rays[i] = Ray(surface.position, light_direction);
+    }
+
+    const RayMask lit_mask = get_ray_mask(hit_count) & ~occluded_packet(std::span<const Ray>(light_rays, hit_count), light_distances);
+    for_each_ray(lit_mask, [&](const size_t p_light_ray_index) {
+      const size_t ray_index = hit_rays[p_light_ray_index];
+      const SurfaceHit &surface = surfaces[ray_index];
+      r_colors[ray_index] += surface.material->get_light_influence(surface.position, surface.normal, p_rays[ray_index].direction, surface.uv, light.data, light_positions[p_light_ray_index]);
+    });
   }
-  for(size_t i = 0 ; i < squares.size() ; ++i) {
-    const Square &square = squares[i];
-    Renderer::get_singleton()->draw_rect(square);
+
+  // The bounces quickly lose coherence, the rest of the paths are traced one ray at a time
+  if (p_bounce_count <= 0) {
+    return;
   }
+  for_each_ray(hit_mask, [&](const size_t p_ray_index) {
+    Ray ray = p_rays[p_ray_index];
+    float bounce_contribution = 1.0f;
+    Sampler &sampler = p_samplers[p_ray_index];
+    _bounce_ray(sampler, intersections[p_ray_index], surfaces[p_ray_index], ray, bounce_contribution);
+    if (!_survive_roulette(sampler, 1.0f, bounce_contribution)) {
+      return;
+    }
+    sampler.next_bounce();
+    r_colors[p_ray_index] += bounce_contribution * ray_trace_recursive(sampler, ray, p_bounce_count - 1, bounce_contribution);
+  });
 }
 
 
+Lrgb Scene::ray_trace(Sampler &p_sampler, const Ray &p_ray_start) const {
+  RayIntersection inter = compute_intersection(p_ray_start);
+  return _intersection_get_color(p_sampler, p_ray_start, inter);
+}
+
 // ====================
 // = Scene definition =
 // ====================
@@ -257,6 +480,8 @@ void Scene::setup_single_sphere() {
     s.material.albedo = Vec3(1., 1., 1);
     s.material.shininess = 20;
   }
+
+  update_acceleration_structure();
 }
 
 
@@ -281,6 +506,8 @@ void Scene::setup_single_square() {
     s.material.albedo = Vec3(0.8, 0.8, 0.8);
     s.material.shininess = 20;
   }
+
+  update_acceleration_structure();
 }
 
 
@@ -399,6 +626,8 @@ void Scene::setup_cornell_box() {
     // mesh.load_obj("assets/models/unit_sphere.obj");
     // mesh.material.albedo_tex = Image::read("assets/textures/sphere_textures/s7.ppm");
   }
+
+  update_acceleration_structure();
 }
 
 
@@ -426,4 +655,6 @@ void Scene::setup_simple_mesh() {
     mesh.material.diffuse = 1.0;
     mesh.material.albedo_tex = Image::read("assets/textures/sphere_textures/s1.ppm");
   }
+
+  update_acceleration_structure();
 }
@@ -38,14 +38,16 @@
 #pragma once
 
 #include <optional>
-#include <random>
+#include <span>
 #include <vector>
 
+#include "geometry/acceleration_structures.hpp"
 #include "geometry/ray.hpp"
 #include "geometry/mesh.hpp"
 #include "geometry/sphere.hpp"
 #include "geometry/square.hpp"
 #include "material.hpp"
+#include "utils/sampler.hpp"
 
 
 class Scene {
@@ -54,12 +56,37 @@ class Scene {
   std::vector<Square> squares;
   std::vector<Light> lights;
 
+  // Every primitive of the scene, indexed by the leaves of `object_bvh`
+  struct SceneObject {
+    RayIntersection::Kind kind;
+    size_t element_id;
+  };
+  std::vector<SceneObject> objects;
+  ObjectBVH object_bvh;
+
 public:
   void draw() const;
 
+  // Rebuilds the top level acceleration structure, must be called after the primitives of the scene are changed.
+  void update_acceleration_structure();
+
   RayIntersection compute_intersection(const Ray &p_ray) const;
-  kmath::Lrgb ray_trace_recursive(std::mt19937 &p_rng, const Ray &p_ray, const int p_bounce_count = 4) const;
-  kmath::Lrgb ray_trace(std::mt19937 &p_rng, const Ray &p_ray_start) const;
+  // Returns whether anything is hit closer than p_max_distance along the ray, cheaper than `compute_intersection`.
+  bool occluded(const Ray &p_ray, const float p_max_distance) const;
+
+  // Packet versions of `compute_intersection` and `occluded`, for at most MAX_RAY_PACKET_SIZE rays. They give the same
+  // results, but are faster when the rays are coherent (close origins and directions).
+  void intersect_packet(std::span<const Ray> p_rays, std::span<RayIntersection> r_intersections) const;
+  // Returns the mask of the occluded rays
+  RayMask occluded_packet(std::span<const Ray> p_rays, std::span<const float> p_max_distances) const;
+
+  // p_sampler moves to the next bounce after each intersection. Paths stop after p_bounce_count bounces, or earlier by
+  // Russian roulette. p_throughput is the weight of the path before p_ray.
+  kmath::Lrgb ray_trace_recursive(Sampler &p_sampler, const Ray &p_ray, const int p_bounce_count = 8, const float p_throughput = 1.0f) const;
+  // Same as `ray_trace_recursive` for coherent rays, such as the samples of a pixel. The first intersections and their
+  // shadow rays are traced as a packet, the rest of the paths one ray at a time. Each ray uses its own sampler.
+  void ray_trace_packet(std::span<Sampler> p_samplers, std::span<const Ray> p_rays, std::span<kmath::Lrgb> r_colors, const int p_bounce_count = 8) const;
+  kmath::Lrgb ray_trace(Sampler &p_sampler, const Ray &p_ray_start) const;
   
   void setup_single_sphere();
   void setup_single_square();
@@ -67,8 +94,30 @@ public:
   void setup_simple_mesh();
 
 public:
-  kmath::Lrgb _intersection_get_color(std::mt19937 &p_rng, const Ray &p_ray, const RayIntersection &p_intersection) const;
+  kmath::Lrgb _intersection_get_color(Sampler &p_sampler, const Ray &p_ray, const RayIntersection &p_intersection) const;
   std::optional<const Material*> _intersection_get_material(const RayIntersection &p_intersection) const;
+
+private:
+  // Shading inputs of an existing intersection, the position is moved off the surface to avoid self intersections
+  struct SurfaceHit {
+    const Material *material;
+    kmath::Vec3 position;
+    kmath::Vec3 normal;
+    kmath::Vec2 uv;
+  };
+
+  SurfaceHit _get_surface_hit(const RayIntersection &p_intersection) const;
+  kmath::Lrgb _get_direct_lighting(Sampler &p_sampler, const Ray &p_ray, const SurfaceHit &p_surface) const;
+  // Replaces r_ray by the ray bouncing off the intersection, and scales r_contribution by the strength of the bounce
+  void _bounce_ray(Sampler &p_sampler, const RayIntersection &p_intersection, const SurfaceHit &p_surface, Ray &r_ray, float &r_contribution) const;
+  // Russian roulette, from bounce ROULETTE_START_BOUNCE on: a path whose throughput is below ROULETTE_THROUGHPUT
+  // continues with a probability proportional to it, r_contribution being scaled up by its inverse so that the
+  // estimate stays unbiased. Returns false if the path stops.
+  bool _survive_roulette(Sampler &p_sampler, const float p_throughput, float &r_contribution) const;
+
+private:
+  constexpr static uint32_t ROULETTE_START_BOUNCE = 2;
+  constexpr static float ROULETTE_THROUGHPUT = 0.1f;
 };
 
 
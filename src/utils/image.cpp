@@ -39,10 +39,24 @@
 
 #include "thirdparty/kmath/color.hpp"
 #include "thirdparty/stb/stb_image.h"
+#include "thirdparty/stb/stb_image_write.h"
+#include "utils/thread_pool.hpp"
+
 #include <algorithm>
+#include <bit>
 #include <iostream>
 
 
+// The pixels are written straight from the image buffer by the floating point formats
+static_assert(sizeof(kmath::Lrgb) == 3 * sizeof(float));
+
+
+// Callback of the stb writers
+static void write_to_stream(void *p_stream, void *p_data, int p_size) {
+  static_cast<std::ostream*>(p_stream)->write(static_cast<const char*>(p_data), p_size);
+}
+
+
 Image::Image(const size_t p_width, const size_t p_height, const kmath::Lrgb p_fill)
   : data(p_width * p_height, p_fill),
   width(p_width),
@@ -91,6 +105,92 @@ void Image::write_ppm(std::ostream &p_stream, const size_t p_precision) const {
 }
 
 
+void Image::write_ppm_binary(std::ostream &p_stream) const {
+  p_stream << "P6\n" << width << " " << height << "\n255\n";
+  const std::vector<uint8_t> bytes = _to_rgb8();
+  p_stream.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+
+void Image::write_pfm(std::ostream &p_stream) const {
+  // A negative scale means little endian data
+  p_stream << "PF\n" << width << " " << height << "\n" << ((std::endian::native == std::endian::little)? "-1.0" : "1.0") << "\n";
+
+  // The rows are stored from the bottom to the top of the image
+  for (size_t y = height; y > 0; y--) {
+    p_stream.write(reinterpret_cast<const char*>(&data[(y - 1) * width]), width * sizeof(kmath::Lrgb));
+  }
+}
+
+
+void Image::write_hdr(std::ostream &p_stream) const {
+  stbi_write_hdr_to_func(&write_to_stream, &p_stream, width, height, 3, reinterpret_cast<const float*>(data.data()));
+}
+
+
+void Image::write_png(std::ostream &p_stream) const {
+  const std::vector<uint8_t> bytes = _to_rgb8();
+  stbi_write_png_to_func(&write_to_stream, &p_stream, width, height, 3, bytes.data(), 3 * width);
+}
+
+
+void Image::write(std::ostream &p_stream, const FileFormat p_format) const {
+  switch (p_format) {
+  case FileFormat::PPM:
+    write_ppm_binary(p_stream);
+    break;
+  case FileFormat::PFM:
+    write_pfm(p_stream);
+    break;
+  case FileFormat::HDR:
+    write_hdr(p_stream);
+    break;
+  case FileFormat::PNG:
+    write_png(p_stream);
+    break;
+  }
+}
+
+
+std::optional<Image::FileFormat> Image::get_file_format(const std::filesystem::path &p_path) {
+  const std::filesystem::path extension = p_path.extension();
+  if (extension == ".ppm") return FileFormat::PPM;
+  if (extension == ".pfm") return FileFormat::PFM;
+  if (extension == ".hdr") return FileFormat::HDR;
+  if (extension == ".png") return FileFormat::PNG;
+  return std::nullopt;
+}
+
+
+bool Image::is_high_dynamic_range(const FileFormat p_format) {
+  return p_format == FileFormat::PFM || p_format == FileFormat::HDR;
+}
+
+
+std::vector<uint8_t> Image::_to_rgb8() const {
+  std::vector<uint8_t> result(3 * data.size());
+
+  auto quantize = [](const float p_value) -> uint8_t {
+    return static_cast<uint8_t>(255.0f * std::clamp(p_value, 0.0f, 1.0f) + 0.5f);
+  };
+
+  // The image is converted in bands of rows on the thread pool
+  const size_t band_height = 16;
+  const size_t band_count = (height + band_height - 1) / band_height;
+  parallel_for(0, band_count, [&]([[maybe_unused]] const size_t p_thread_id, const size_t p_band) {
+    const size_t begin = p_band * band_height * width;
+    const size_t end = std::min(begin + band_height * width, data.size());
+    for (size_t i = begin; i < end; i++) {
+      result[3 * i + 0] = quantize(data[i].x);
+      result[3 * i + 1] = quantize(data[i].y);
+      result[3 * i + 2] = quantize(data[i].z);
+    }
+  }, 1);
+
+  return result;
+}
+
+
 kmath::Lrgb Image::sample(const float p_u, const float p_v, const SampleMode p_sample_mode) const {
   switch (p_sample_mode) {
   break;case SampleMode::NEAREST: {
@@ -39,7 +39,9 @@
 
 
 #include "thirdparty/kmath/color.hpp"
+#include <cstdint>
 #include <filesystem>
+#include <optional>
 #include <ostream>
 #include <vector>
 
@@ -66,6 +68,13 @@ public:
     LINEAR,
   };
 
+  enum class FileFormat : int {
+    PPM, // Binary 8 bits per channel (P6)
+    PFM, // 32 bits float per channel
+    HDR, // Radiance RGBE
+    PNG,
+  };
+
 
 public:
 
@@ -125,7 +134,20 @@ public:
 
 
   static Image read(const std::filesystem::path &p_path);
+
+  // The 8 bits formats clamp the colors to [0, 1], the floating point ones keep them as they are.
+  // The 8 bits conversion runs on the thread pool.
+  void write(std::ostream &p_stream, const FileFormat p_format) const;
+  // ASCII PPM (P3), much slower to write and read than the binary formats
   void write_ppm(std::ostream &p_stream, const size_t p_precision = 255) const;
+  void write_ppm_binary(std::ostream &p_stream) const;
+  void write_pfm(std::ostream &p_stream) const;
+  void write_hdr(std::ostream &p_stream) const;
+  void write_png(std::ostream &p_stream) const;
+
+  // Guessed from the extension of p_path
+  static std::optional<FileFormat> get_file_format(const std::filesystem::path &p_path);
+  static bool is_high_dynamic_range(const FileFormat p_format);
   
 
   Image(const size_t p_width, const size_t p_height, const kmath::Lrgb p_fill = kmath::Vec3::ZERO);
@@ -137,6 +159,9 @@ public:
 
 private:
   Image() = default;
+
+  // Colors quantized to 8 bits per channel, in parallel over bands of rows
+  std::vector<uint8_t> _to_rgb8() const;
   
 private:
   std::vector<kmath::Lrgb> data;
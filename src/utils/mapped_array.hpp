@@ -0,0 +1,78 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+#pragma once
+
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "tp_utils/src/utils.hpp"
+
+
+// Read-only array whose elements are either owned, or stored in a file mapped in memory that the array keeps alive.
+// Moving the array keeps the elements in place.
+template<typename T>
+class MappedArray {
+public:
+  inline const T &operator[](const size_t p_index) const { return elements[p_index]; }
+  inline const T *data() const { return elements.data(); }
+  inline size_t size() const { return elements.size(); }
+  inline bool empty() const { return elements.empty(); }
+  inline auto begin() const { return elements.begin(); }
+  inline auto end() const { return elements.end(); }
+  inline std::span<const T> get_span() const { return elements; }
+  inline bool is_mapped() const { return file != nullptr; }
+
+  MappedArray() = default;
+  MappedArray(std::vector<T> &&p_elements): owned(std::move(p_elements)), elements(owned) {}
+  MappedArray(std::shared_ptr<const tputils::MappedFile> p_file, std::span<const T> p_elements): file(std::move(p_file)), elements(p_elements) {}
+  MappedArray(MappedArray&&) = default;
+  MappedArray &operator=(MappedArray&&) = default;
+  MappedArray(const MappedArray&) = delete;
+  MappedArray &operator=(const MappedArray&) = delete;
+  ~MappedArray() = default;
+
+private:
+  std::vector<T> owned;
+  std::shared_ptr<const tputils::MappedFile> file;
+  std::span<const T> elements;
+};
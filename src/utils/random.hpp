@@ -38,13 +38,64 @@
 #pragma once
 
 
+#include "thirdparty/kmath/constants.hpp"
 #include "thirdparty/kmath/utils.hpp"
 #include "thirdparty/kmath/vector.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <random>
 #include <type_traits>
 
 
+// Finalizer of SplitMix64, a bijection mixing every bit of the input into every bit of the output
+inline uint64_t mix_bits(uint64_t p_value) {
+  p_value = (p_value ^ (p_value >> 30)) * 0xbf58476d1ce4e5b9;
+  p_value = (p_value ^ (p_value >> 27)) * 0x94d049bb133111eb;
+  return p_value ^ (p_value >> 31);
+}
+
+
+// Counter based random number generator: every number is a hash of the key of its stream and of its index in the
+// stream, so a stream has no state to seed or to share. Each path traced gets its own stream, keyed by the seed, its
+// pixel and its sample index: renders do not depend on which thread traced which path.
+// Every bounce of a path reads its own part of the stream, so that its numbers do not depend on how many numbers the
+// previous bounces used.
+class CounterRng {
+public:
+  typedef uint32_t result_type;
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT32_MAX; }
+
+  inline result_type operator()() {
+    const uint64_t counter = (static_cast<uint64_t>(bounce) << 32) | dimension++;
+    return static_cast<result_type>(mix_bits(key + counter * GOLDEN_GAMMA) >> 32);
+  }
+
+  // Moves to the numbers of the next bounce of the path
+  inline void next_bounce() {
+    bounce++;
+    dimension = 0;
+  }
+  inline uint32_t get_bounce() const { return bounce; }
+
+  CounterRng() = default;
+  CounterRng(const uint64_t p_seed, const uint64_t p_pixel, const uint64_t p_sample)
+    : key(mix_bits(mix_bits(mix_bits(p_seed) ^ p_pixel) ^ p_sample)) {}
+
+private:
+  constexpr static uint64_t GOLDEN_GAMMA = 0x9e3779b97f4a7c15;
+
+private:
+  uint64_t key = 0;
+  uint32_t bounce = 0;
+  uint32_t dimension = 0;
+};
+static_assert(std::uniform_random_bit_generator<CounterRng>);
+
+
 struct PointDistribution {
   kmath::Vec3 position;
 
@@ -87,6 +138,66 @@ public:
 };
 
 
+// Any two unit vectors forming an orthonormal basis with p_normal, without branches.
+// See "Building an Orthonormal Basis, Revisited", Duff et al. 2017.
+inline void get_orthonormal_basis(const kmath::Vec3 &p_normal, kmath::Vec3 &r_tangent, kmath::Vec3 &r_bitangent) {
+  const float sign = std::copysign(1.0f, p_normal.z);
+  const float a = -1.0f / (sign + p_normal.z);
+  const float b = p_normal.x * p_normal.y * a;
+  r_tangent = kmath::Vec3(1.0f + sign * p_normal.x * p_normal.x * a, sign * b, -sign * p_normal.x);
+  r_bitangent = kmath::Vec3(b, sign + p_normal.y * p_normal.y * a, -p_normal.y);
+}
+
+
+// Maps the unit square onto the unit disk, keeping the strata of the square compact.
+// See "A Low Distortion Map Between Disk and Square", Shirley and Chiu 1997.
+inline kmath::Vec2 map_square_to_disk(const float p_u, const float p_v) {
+  constexpr float QUARTER_PI = static_cast<float>(0.25 * kmath::PI);
+  const float a = 2.0f * p_u - 1.0f;
+  const float b = 2.0f * p_v - 1.0f;
+  if (a == 0.0f && b == 0.0f) {
+    return kmath::Vec2(0.0f, 0.0f);
+  }
+  if (std::abs(a) > std::abs(b)) {
+    const float angle = QUARTER_PI * (b / a);
+    return a * kmath::Vec2(std::cos(angle), std::sin(angle));
+  } else {
+    const float angle = 2.0f * QUARTER_PI - QUARTER_PI * (a / b);
+    return b * kmath::Vec2(std::cos(angle), std::sin(angle));
+  }
+}
+
+
+// Maps the unit square onto the unit sphere, with a uniform density
+inline kmath::Vec3 map_square_to_sphere(const float p_u, const float p_v) {
+  const float z = 1.0f - 2.0f * p_u;
+  const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+  const float phi = static_cast<float>(kmath::TAU) * p_v;
+  return kmath::Vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+
+// The following distributions draw a fixed number of random numbers per point, and give the density of their points:
+// per unit of area for the points of a surface, per steradian for the directions.
+
+
+struct UniformSphereDistribution {
+  kmath::Vec3 position;
+  float radius;
+
+public:
+  template<std::uniform_random_bit_generator Rng>
+  kmath::Vec3 operator()(Rng &p_rng) const {
+    std::uniform_real_distribution distr(0.0f, 1.0f);
+    const float u = distr(p_rng);
+    const float v = distr(p_rng);
+    return position + radius * map_square_to_sphere(u, v);
+  }
+
+  inline float get_pdf() const { return 1.0f / (static_cast<float>(2.0 * kmath::TAU) * radius * radius); }
+};
+
+
 struct UniformBallDistribution {
   kmath::Vec3 position;
   float radius;
@@ -94,15 +205,36 @@ struct UniformBallDistribution {
 public:
   template<std::uniform_random_bit_generator Rng>
   kmath::Vec3 operator()(Rng &p_rng) const {
-    const float r2 = radius * radius;
-    UniformCubeDistribution distr(-radius, radius);
-    while (true) {
-      kmath::Vec3 vec = distr(p_rng);
-      if (kmath::length_squared(vec) < r2) {
-        return vec;
-      }
-    }
+    std::uniform_real_distribution distr(0.0f, 1.0f);
+    const float u = distr(p_rng);
+    const float v = distr(p_rng);
+    const float w = distr(p_rng);
+    return position + (radius * std::cbrt(w)) * map_square_to_sphere(u, v);
   }
+
+  // Per unit of volume
+  inline float get_pdf() const { return 3.0f / (static_cast<float>(2.0 * kmath::TAU) * radius * radius * radius); }
+};
+
+
+struct UniformDiskDistribution {
+  kmath::Vec3 position;
+  kmath::Vec3 normal;
+  float radius;
+
+public:
+  template<std::uniform_random_bit_generator Rng>
+  kmath::Vec3 operator()(Rng &p_rng) const {
+    std::uniform_real_distribution distr(0.0f, 1.0f);
+    const float u = distr(p_rng);
+    const float v = distr(p_rng);
+    const kmath::Vec2 disk = radius * map_square_to_disk(u, v);
+    kmath::Vec3 tangent, bitangent;
+    get_orthonormal_basis(normal, tangent, bitangent);
+    return position + disk.x * tangent + disk.y * bitangent;
+  }
+
+  inline float get_pdf() const { return 1.0f / (static_cast<float>(kmath::PI) * radius * radius); }
 };
 
 
@@ -117,19 +249,53 @@ public:
     std::uniform_real_distribution distr(0.0f, 1.0f);
     return position + distr(p_rng) * right_vector + distr(p_rng) * up_vector;
   }
+
+  inline float get_pdf() const { return 1.0f / kmath::length(kmath::cross(right_vector, up_vector)); }
 };
 
 
+// Unit directions on the side of normal
 struct UniformHemishereDistribution {
   kmath::Vec3 normal;
 
 public:
   template<std::uniform_random_bit_generator Rng>
   kmath::Vec3 operator()(Rng &p_rng) const {
-    const UniformBallDistribution ball(kmath::Vec3::ZERO, 1.0f);
-    const kmath::Vec3 result = ball(p_rng);
-    const float sign = kmath::possign(dot(result, normal));
-    return sign * result;
+    std::uniform_real_distribution distr(0.0f, 1.0f);
+    const float u = distr(p_rng);
+    const float v = distr(p_rng);
+    const kmath::Vec3 direction = map_square_to_sphere(u, v);
+    kmath::Vec3 tangent, bitangent;
+    get_orthonormal_basis(normal, tangent, bitangent);
+    return direction.x * tangent + direction.y * bitangent + std::abs(direction.z) * normal;
+  }
+
+  inline float get_pdf(const kmath::Vec3 &p_direction) const {
+    return (kmath::dot(p_direction, normal) >= 0.0f)? 1.0f / static_cast<float>(kmath::TAU) : 0.0f;
+  }
+};
+
+
+// Unit directions on the side of normal, with a density proportional to the cosine of their angle with it. Points of
+// the unit disk are projected up onto the hemisphere (Malley's method).
+struct CosineHemisphereDistribution {
+  kmath::Vec3 normal;
+
+public:
+  template<std::uniform_random_bit_generator Rng>
+  kmath::Vec3 operator()(Rng &p_rng) const {
+    std::uniform_real_distribution distr(0.0f, 1.0f);
+    const float u = distr(p_rng);
+    const float v = distr(p_rng);
+    const kmath::Vec2 disk = map_square_to_disk(u, v);
+    const float height = std::sqrt(std::max(0.0f, 1.0f - disk.x * disk.x - disk.y * disk.y));
+    kmath::Vec3 tangent, bitangent;
+    get_orthonormal_basis(normal, tangent, bitangent);
+    return disk.x * tangent + disk.y * bitangent + height * normal;
+  }
+
+  inline float get_pdf(const kmath::Vec3 &p_direction) const {
+    return std::max(0.0f, kmath::dot(p_direction, normal)) / static_cast<float>(kmath::PI);
   }
 };
 
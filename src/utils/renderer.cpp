@@ -45,6 +45,8 @@
 #include "tp_utils/src/rendering/primitives/shader.hpp"
 #include "tp_utils/src/source_preprocessing.hpp"
 
+#include "thirdparty/glad/include/glad/glad.h"
+
 
 using namespace tputils;
 using namespace kmath;
@@ -112,6 +114,36 @@ void Renderer::draw_rect(const Square &p_square) {
 }
 
 
+void Renderer::set_preview_image(const Image &p_image) {
+  if (p_image.get_width() != preview_width || p_image.get_height() != preview_height) {
+    preview_width = p_image.get_width();
+    preview_height = p_image.get_height();
+    preview_texture = Texture2D(preview_width, preview_height, TextureFormat::RGB32F);
+  }
+
+  // The pixels of an image are tightly packed float RGB triplets
+  preview_texture.bind();
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, preview_width, preview_height, GL_RGB, GL_FLOAT, &p_image(0));
+  preview_texture.unbind();
+}
+
+
+void Renderer::draw_preview() {
+  if (!preview_texture.is_valid()) return;
+
+  preview_shader.bind();
+  preview_texture.bind(0);
+  preview_shader.bind_uniform("u_image", 0);
+  preview_vertex_array.bind();
+
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  preview_vertex_array.unbind();
+  preview_texture.unbind(0);
+  preview_shader.unbind();
+}
+
+
 void Renderer::set_projection_view_matrix(const kmath::Mat4 &p_projection_view) {
   object_shader.bind_uniform("u_projection_view", p_projection_view);
 }
@@ -150,6 +182,19 @@ void Renderer::init_singleton() {
       singleton->object_shader.get_errors()
     );
   }
+
+  { // Load preview shader
+    tputils::SourceFile sf("assets/shaders/preview.glsl");
+    singleton->preview_shader = tputils::ShaderProgram(
+      sf.get_section_text("vertex"),
+      sf.get_section_text("fragment")
+    );
+    ASSERT_FATAL_ERROR(
+      singleton->preview_shader.is_valid(),
+      singleton->preview_shader.get_errors()
+    );
+  }
+  singleton->preview_vertex_array.initialize();
 }
 
 
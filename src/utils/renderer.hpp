@@ -47,6 +47,8 @@
 #include "geometry/mesh.hpp"
 #include "geometry/light.hpp"
 #include "tp_utils/src/rendering/primitives/vbuffer.hpp"
+#include "tp_utils/src/rendering/primitives/texture.hpp"
+#include "utils/image.hpp"
 
 #include <array>
 #include <span>
@@ -71,6 +73,10 @@ public:
   void draw_rect(const Square &p_square);
   void draw_mesh(const Mesh &p_mesh);
 
+  // The preview is an image covering the whole window, drawn instead of the scene
+  void set_preview_image(const Image &p_image);
+  void draw_preview();
+
 public:
   static void init_singleton();
   static void clean_singleton();
@@ -89,6 +95,12 @@ private:
   tputils::ShaderProgram object_shader;
 
   tputils::TriangleMesh sphere;
+
+  tputils::ShaderProgram preview_shader;
+  tputils::Texture2D preview_texture;
+  tputils::VertexBufferObject preview_vertex_array; // Empty, the vertices are generated by the shader
+  size_t preview_width = 0;
+  size_t preview_height = 0;
   
 private:
   static Renderer *singleton;
@@ -0,0 +1,315 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+#include "sampler.hpp"
+
+#include <array>
+#include <cmath>
+#include <vector>
+
+
+std::string_view get_sampler_type_name(const SamplerType p_type) {
+  switch (p_type) {
+  case SamplerType::RANDOM: return "random";
+  case SamplerType::SOBOL: return "sobol";
+  case SamplerType::HALTON: return "halton";
+  case SamplerType::BLUE_NOISE: return "blue_noise";
+  }
+  return "";
+}
+
+
+std::optional<SamplerType> get_sampler_type(const std::string_view p_name) {
+  for (const SamplerType type : {SamplerType::RANDOM, SamplerType::SOBOL, SamplerType::HALTON, SamplerType::BLUE_NOISE}) {
+    if (get_sampler_type_name(type) == p_name) {
+      return type;
+    }
+  }
+  return std::optional<SamplerType>();
+}
+
+
+// =========================
+// = Sequences and scrambling
+// =========================
+
+
+static uint32_t reverse_bits(uint32_t p_value) {
+  p_value = (p_value << 16) | (p_value >> 16);
+  p_value = ((p_value & 0x00ff00ff) << 8) | ((p_value & 0xff00ff00) >> 8);
+  p_value = ((p_value & 0x0f0f0f0f) << 4) | ((p_value & 0xf0f0f0f0) >> 4);
+  p_value = ((p_value & 0x33333333) << 2) | ((p_value & 0xcccccccc) >> 2);
+  p_value = ((p_value & 0x55555555) << 1) | ((p_value & 0xaaaaaaaa) >> 1);
+  return p_value;
+}
+
+
+// Owen scrambling: each bit is flipped depending on the bits above it, with a hash instead of a tree of random flips.
+// See "Practical Hash-based Owen Scrambling", Burley 2020.
+static uint32_t nested_uniform_scramble(uint32_t p_value, const uint32_t p_seed) {
+  p_value = reverse_bits(p_value);
+  p_value += p_seed;
+  p_value ^= p_value * 0x6c50b47c;
+  p_value ^= p_value * 0xb82f1e52;
+  p_value ^= p_value * 0xc7afe638;
+  p_value ^= p_value * 0x8d22f6e6;
+  return reverse_bits(p_value);
+}
+
+
+// The first dimension of the Sobol sequence is the bit reversal of the index, the direction numbers of the second one
+// are built on the fly.
+static uint32_t get_sobol_second_dimension(uint32_t p_index) {
+  uint32_t result = 0;
+  for (uint32_t direction = 1u << 31; p_index != 0; p_index >>= 1, direction ^= direction >> 1) {
+    if (p_index & 1) {
+      result ^= direction;
+    }
+  }
+  return result;
+}
+
+
+static double get_radical_inverse(const uint32_t p_base, uint32_t p_index) {
+  const double inv_base = 1.0 / p_base;
+  double factor = inv_base;
+  double result = 0.0;
+  while (p_index != 0) {
+    result += (p_index % p_base) * factor;
+    p_index /= p_base;
+    factor *= inv_base;
+  }
+  return result;
+}
+
+
+constexpr std::array<uint32_t, 32> HALTON_BASES = {
+  2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+  59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131,
+};
+
+
+// ==============
+// = Blue noise =
+// ==============
+
+
+constexpr size_t BLUE_NOISE_SIZE = 64;
+
+
+// Tileable blue noise mask made with the void and cluster method ("The void-and-cluster method for dither array
+// generation", Ulichney 1993). Its values are the ranks of the pixels, spread over the whole uint32 range.
+static std::vector<uint32_t> build_blue_noise_mask() {
+  constexpr size_t PIXEL_COUNT = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+  constexpr float SIGMA = 1.5f;
+
+  // Energy a point adds around it, by offset on the torus
+  std::vector<float> kernel(PIXEL_COUNT);
+  for (size_t dy = 0; dy < BLUE_NOISE_SIZE; dy++) {
+    for (size_t dx = 0; dx < BLUE_NOISE_SIZE; dx++) {
+      const float x = static_cast<float>(std::min(dx, BLUE_NOISE_SIZE - dx));
+      const float y = static_cast<float>(std::min(dy, BLUE_NOISE_SIZE - dy));
+      kernel[dy * BLUE_NOISE_SIZE + dx] = std::exp(-(x * x + y * y) / (2.0f * SIGMA * SIGMA));
+    }
+  }
+
+  std::vector<uint8_t> pattern(PIXEL_COUNT, 0);
+  std::vector<float> energy(PIXEL_COUNT, 0.0f);
+
+  auto set_point = [&](const size_t p_index, const bool p_value) -> void {
+    pattern[p_index] = p_value;
+    const float sign = (p_value)? 1.0f : -1.0f;
+    const size_t point_x = p_index % BLUE_NOISE_SIZE;
+    const size_t point_y = p_index / BLUE_NOISE_SIZE;
+    for (size_t y = 0; y < BLUE_NOISE_SIZE; y++) {
+      const size_t dy = (y + BLUE_NOISE_SIZE - point_y) % BLUE_NOISE_SIZE;
+      for (size_t x = 0; x < BLUE_NOISE_SIZE; x++) {
+        const size_t dx = (x + BLUE_NOISE_SIZE - point_x) % BLUE_NOISE_SIZE;
+        energy[y * BLUE_NOISE_SIZE + x] += sign * kernel[dy * BLUE_NOISE_SIZE + dx];
+      }
+    }
+  };
+
+  // Point with the most energy, or empty pixel with the least
+  auto find_tightest_cluster = [&]() -> size_t {
+    size_t best = 0;
+    float best_energy = -INFINITY;
+    for (size_t i = 0; i < PIXEL_COUNT; i++) {
+      if (pattern[i] && energy[i] > best_energy) {
+        best = i;
+        best_energy = energy[i];
+      }
+    }
+    return best;
+  };
+  auto find_largest_void = [&]() -> size_t {
+    size_t best = 0;
+    float best_energy = INFINITY;
+    for (size_t i = 0; i < PIXEL_COUNT; i++) {
+      if (!pattern[i] && energy[i] < best_energy) {
+        best = i;
+        best_energy = energy[i];
+      }
+    }
+    return best;
+  };
+
+  // Random initial points, moved from the tightest clusters to the largest voids until they are evenly spread
+  const size_t initial_count = PIXEL_COUNT / 10;
+  CounterRng rng(47, 0, 0);
+  for (size_t placed = 0; placed < initial_count;) {
+    const size_t index = rng() % PIXEL_COUNT;
+    if (!pattern[index]) {
+      set_point(index, true);
+      placed++;
+    }
+  }
+  for (size_t iteration = 0; iteration < PIXEL_COUNT; iteration++) {
+    const size_t cluster = find_tightest_cluster();
+    set_point(cluster, false);
+    const size_t largest_void = find_largest_void();
+    set_point(largest_void, true);
+    if (largest_void == cluster) {
+      break;
+    }
+  }
+
+  const std::vector<uint8_t> initial_pattern = pattern;
+  const std::vector<float> initial_energy = energy;
+  std::vector<uint32_t> ranks(PIXEL_COUNT);
+
+  // The initial points are ranked by removing the tightest clusters first, the others by filling the largest voids
+  for (size_t rank = initial_count; rank-- > 0;) {
+    const size_t cluster = find_tightest_cluster();
+    set_point(cluster, false);
+    ranks[cluster] = rank;
+  }
+  pattern = initial_pattern;
+  energy = initial_energy;
+  for (size_t rank = initial_count; rank < PIXEL_COUNT; rank++) {
+    const size_t largest_void = find_largest_void();
+    set_point(largest_void, true);
+    ranks[largest_void] = rank;
+  }
+
+  // Centered in the range of the rank
+  constexpr uint32_t RANK_STEP = static_cast<uint32_t>((uint64_t(1) << 32) / PIXEL_COUNT);
+  std::vector<uint32_t> mask(PIXEL_COUNT);
+  for (size_t i = 0; i < PIXEL_COUNT; i++) {
+    mask[i] = ranks[i] * RANK_STEP + RANK_STEP / 2;
+  }
+  return mask;
+}
+
+
+static const std::vector<uint32_t> &get_blue_noise_mask() {
+  static const std::vector<uint32_t> mask = build_blue_noise_mask();
+  return mask;
+}
+
+
+// ===========
+// = Sampler =
+// ===========
+
+
+Sampler::Sampler(const SamplerType p_type, const uint64_t p_seed, const uint32_t p_x, const uint32_t p_y, const uint32_t p_sample)
+  : type(p_type),
+  rng(p_seed, (static_cast<uint64_t>(p_y) << 32) | p_x, p_sample),
+  seed(p_seed),
+  pixel_key(mix_bits(mix_bits(p_seed) ^ ((static_cast<uint64_t>(p_y) << 32) | p_x))),
+  x(p_x),
+  y(p_y),
+  sample(p_sample)
+{
+  if (type == SamplerType::BLUE_NOISE) {
+    get_blue_noise_mask(); // Built by the first sampler rather than in the middle of a path
+  }
+}
+
+
+Sampler::result_type Sampler::operator()() {
+  result_type value = 0;
+  switch (type) {
+  case SamplerType::RANDOM:
+    value = rng();
+    break;
+  case SamplerType::SOBOL:
+    value = (dimension < SOBOL_DIMENSIONS)? _get_sobol(pixel_key) : rng();
+    break;
+  case SamplerType::HALTON:
+    value = (dimension < HALTON_DIMENSIONS && bounce < HALTON_MAX_BOUNCE)? _get_halton() : rng();
+    break;
+  case SamplerType::BLUE_NOISE:
+    value = (dimension < SOBOL_DIMENSIONS)? _get_blue_noise() : rng();
+    break;
+  }
+  dimension++;
+  return value;
+}
+
+
+Sampler::result_type Sampler::_get_sobol(const uint64_t p_scramble_key) const {
+  // Every pair of dimensions is a differently scrambled 2D Sobol sequence, in a differently shuffled order so that the
+  // pairs are not correlated. The shuffle is an Owen scrambling of the index: power of two sized prefixes of the
+  // samples stay stratified.
+  const uint64_t pair_key = mix_bits(p_scramble_key ^ mix_bits((static_cast<uint64_t>(bounce) << 32) | (dimension >> 1)));
+  const uint32_t index = nested_uniform_scramble(sample, static_cast<uint32_t>(pair_key));
+  const uint32_t point = (dimension & 1)? get_sobol_second_dimension(index) : reverse_bits(index);
+  return nested_uniform_scramble(point, static_cast<uint32_t>(mix_bits(pair_key + 1 + (dimension & 1))));
+}
+
+
+Sampler::result_type Sampler::_get_halton() const {
+  const uint32_t halton_dimension = bounce * HALTON_DIMENSIONS + dimension;
+  const double point = get_radical_inverse(HALTON_BASES[halton_dimension], sample);
+  // Cranley-Patterson rotation, the addition wraps around
+  const uint32_t rotation = static_cast<uint32_t>(mix_bits(pixel_key ^ halton_dimension));
+  return static_cast<uint32_t>(point * 4294967296.0) + rotation;
+}
+
+
+Sampler::result_type Sampler::_get_blue_noise() const {
+  // Every pixel uses the same points, rotated by the blue noise mask: the error of neighbouring pixels is not
+  // correlated, it looks like high frequency noise. Each dimension reads the mask with its own toroidal shift.
+  const std::vector<uint32_t> &mask = get_blue_noise_mask();
+  const uint64_t shift = mix_bits(seed ^ ((static_cast<uint64_t>(bounce) << 32) | dimension));
+  const size_t mask_x = (x + static_cast<uint32_t>(shift)) % BLUE_NOISE_SIZE;
+  const size_t mask_y = (y + static_cast<uint32_t>(shift >> 32)) % BLUE_NOISE_SIZE;
+  return _get_sobol(mix_bits(seed)) + mask[mask_y * BLUE_NOISE_SIZE + mask_x];
+}
@@ -0,0 +1,107 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+#pragma once
+
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "utils/random.hpp"
+
+
+enum class SamplerType {
+  RANDOM,     // Independent random numbers
+  SOBOL,      // Owen scrambled Sobol points, scrambled per pixel
+  HALTON,     // Halton points, rotated per pixel
+  BLUE_NOISE, // Sobol points shared by every pixel, rotated by a blue noise mask
+};
+
+std::string_view get_sampler_type_name(const SamplerType p_type);
+std::optional<SamplerType> get_sampler_type(const std::string_view p_name);
+
+
+// Numbers of one sample of a path, one dimension at a time. Unlike independent random numbers, the samples of a pixel
+// are spread evenly over each pair of dimensions: the camera jitter, the light samples and the bounce directions are
+// stratified. It is a random bit generator, and can be given to the distributions of `utils/random.hpp` and to the
+// materials. The first numbers of each bounce are stratified, the ones past them are independent random numbers.
+class Sampler {
+public:
+  typedef uint32_t result_type;
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT32_MAX; }
+
+  result_type operator()();
+
+  // Moves to the numbers of the next bounce of the path
+  inline void next_bounce() {
+    bounce++;
+    dimension = 0;
+    rng.next_bounce();
+  }
+  inline uint32_t get_bounce() const { return bounce; }
+
+  Sampler() = default;
+  // Sample p_sample of the pixel (p_x, p_y). The samples of a pixel are best stratified by powers of two.
+  Sampler(const SamplerType p_type, const uint64_t p_seed, const uint32_t p_x, const uint32_t p_y, const uint32_t p_sample);
+
+private:
+  // Stratified dimensions per bounce
+  constexpr static uint32_t SOBOL_DIMENSIONS = 16;
+  constexpr static uint32_t HALTON_DIMENSIONS = 8;
+  constexpr static uint32_t HALTON_MAX_BOUNCE = 4;
+
+private:
+  result_type _get_sobol(const uint64_t p_scramble_key) const;
+  result_type _get_halton() const;
+  result_type _get_blue_noise() const;
+
+private:
+  SamplerType type = SamplerType::RANDOM;
+  CounterRng rng; // Numbers of the unstratified dimensions
+  uint64_t seed = 0;
+  uint64_t pixel_key = 0;
+  uint32_t x = 0;
+  uint32_t y = 0;
+  uint32_t sample = 0;
+  uint32_t bounce = 0;
+  uint32_t dimension = 0;
+};
+static_assert(std::uniform_random_bit_generator<Sampler>);
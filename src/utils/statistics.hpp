@@ -0,0 +1,73 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+#pragma once
+
+
+#include <cmath>
+#include <cstddef>
+
+
+// Running mean and variance of a series of values, updated one value at a time with Welford's algorithm, which does
+// not suffer from the cancellation of the sum of squares method.
+struct RunningStatistics {
+  size_t count = 0;
+  double mean = 0.0;
+  double squared_deviation_sum = 0.0;
+
+public:
+  inline void push(const double p_value) {
+    count++;
+    const double delta = p_value - mean;
+    mean += delta / static_cast<double>(count);
+    squared_deviation_sum += delta * (p_value - mean);
+  }
+
+
+  // Unbiased sample variance
+  inline double get_variance() const {
+    return (count > 1)? squared_deviation_sum / static_cast<double>(count - 1) : 0.0;
+  }
+
+
+  // Half width of the confidence interval of the mean, p_z_score being 1.96 for 95% confidence. Infinite below two
+  // values, where the variance is unknown.
+  inline double get_confidence_interval(const double p_z_score = 1.96) const {
+    return (count > 1)? p_z_score * std::sqrt(get_variance() / static_cast<double>(count)) : INFINITY;
+  }
+};
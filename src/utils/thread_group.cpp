@@ -39,37 +39,178 @@
 
 #include <algorithm>
 #include <cassert>
-#include <thread>
 
 
-void ThreadWorkGroup::execute(const ParallelFunction p_func, const size_t p_begin_index, const size_t p_end_index, const size_t progress_report_interval) {
+static inline uint64_t pack_tile_range(const uint32_t p_front, const uint32_t p_back) {
+  return (static_cast<uint64_t>(p_back) << 32) | p_front;
+}
+
+
+static inline void unpack_tile_range(const uint64_t p_range, uint32_t &r_front, uint32_t &r_back) {
+  r_front = static_cast<uint32_t>(p_range);
+  r_back = static_cast<uint32_t>(p_range >> 32);
+}
+
+
+std::vector<Tile> build_tiles(const size_t p_begin_index, const size_t p_end_index, const TileSettings &p_tile_settings) {
+  std::vector<Tile> tiles;
+  const size_t exec_length = p_end_index - p_begin_index;
+  const size_t row_length = p_tile_settings.row_length;
+  const size_t tile_width = std::max<size_t>(p_tile_settings.tile_width, 1);
+  const size_t tile_height = std::max<size_t>(p_tile_settings.tile_height, 1);
+
+  // Position of the center of the tiles, to order them
+  std::vector<std::pair<float, float>> tile_centers;
+
+  if (row_length == 0) {
+    const size_t tile_size = tile_width * tile_height;
+    for (size_t offset = 0; offset < exec_length; offset += tile_size) {
+      const size_t size = std::min(tile_size, exec_length - offset);
+      tiles.push_back(Tile{p_begin_index + offset, static_cast<uint32_t>(size), 1});
+      tile_centers.push_back({static_cast<float>(offset) + 0.5f * static_cast<float>(size), 0.0f});
+    }
+  } else {
+    const size_t row_count = (exec_length + row_length - 1) / row_length;
+    for (size_t y = 0; y < row_count; y += tile_height) {
+      for (size_t x = 0; x < row_length; x += tile_width) {
+        const size_t width = std::min(tile_width, row_length - x);
+        const size_t height = std::min(tile_height, row_count - y);
+        tiles.push_back(Tile{p_begin_index + y * row_length + x, static_cast<uint32_t>(width), static_cast<uint32_t>(height)});
+        tile_centers.push_back({static_cast<float>(x) + 0.5f * static_cast<float>(width), static_cast<float>(y) + 0.5f * static_cast<float>(height)});
+      }
+    }
+  }
+
+  switch (p_tile_settings.order) {
+  case TileSettings::Order::SCANLINE:
+    break;
+  case TileSettings::Order::CENTER_OUT: {
+    const float center_x = (row_length == 0)? 0.5f * static_cast<float>(exec_length) : 0.5f * static_cast<float>(row_length);
+    const float center_y = (row_length == 0)? 0.0f : 0.5f * static_cast<float>((exec_length + row_length - 1) / row_length);
+
+    std::vector<std::pair<float, uint32_t>> keys(tiles.size());
+    for (size_t i = 0; i < tiles.size(); i++) {
+      const float dx = tile_centers[i].first - center_x;
+      const float dy = tile_centers[i].second - center_y;
+      keys[i] = {dx * dx + dy * dy, static_cast<uint32_t>(i)};
+    }
+    std::stable_sort(keys.begin(), keys.end(), [](const auto &p_a, const auto &p_b) { return p_a.first < p_b.first; });
+
+    std::vector<Tile> sorted_tiles(tiles.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      sorted_tiles[i] = tiles[keys[i].second];
+    }
+    tiles = std::move(sorted_tiles);
+    break;
+  }
+  }
+
+  return tiles;
+}
+
+
+void ThreadWorkGroup::_execute(TileFunction p_tile_func, const size_t p_begin_index, const size_t p_end_index, const TileSettings &p_tile_settings) {
   assert(group_state == GroupState::IDLE); // The previous job must have been joined before starting a new job.
   const size_t thread_count = get_thread_count();
 
   // Setup indices
   begin_index = p_begin_index;
   end_index = p_end_index;
-  const size_t exec_length = p_end_index - p_begin_index;
-  index_stride = (p_end_index - p_begin_index) / thread_count + ((exec_length % thread_count)? 1 : 0);
+  row_length = p_tile_settings.row_length;
+  tiles = build_tiles(p_begin_index, p_end_index, p_tile_settings);
+
+  // Deal the tiles in contiguous blocks, in the requested order
+  const size_t tiles_per_thread = (tiles.size() + thread_count - 1) / thread_count;
+  for (size_t i = 0; i < thread_count; i++) {
+    const uint32_t front = static_cast<uint32_t>(std::min(i * tiles_per_thread, tiles.size()));
+    const uint32_t back = static_cast<uint32_t>(std::min((i + 1) * tiles_per_thread, tiles.size()));
+    tile_queues[i].range = pack_tile_range(front, back);
+  }
 
-  progress_report = progress_report_interval;
-  func = p_func;
+  tile_func = std::move(p_tile_func);
 
   // Reset counters
   progress = 0;
-  done_thread_count = 0;
 
-  // Start execution
+  // Start execution, each task works on its own queue of tiles before stealing
+  graph.clear();
+  for (size_t i = 0; i < thread_count; i++) {
+    graph.add_task([this, i](const size_t p_thread_id) {
+      uint32_t tile_index;
+      while (group_state == GroupState::WORKING && (_pop_tile(i, tile_index) || _steal_tile(i, tile_index))) {
+        _run_tile(p_thread_id, tiles[tile_index]);
+      }
+    });
+  }
   group_state = GroupState::WORKING;
-  sync.arrive_and_wait();
+  pool->submit(graph);
+}
+
+
+bool ThreadWorkGroup::_pop_tile(const size_t p_queue_index, uint32_t &r_tile_index) {
+  std::atomic<uint64_t> &range = tile_queues[p_queue_index].range;
+  uint64_t current = range.load();
+  uint32_t front, back;
+
+  do {
+    unpack_tile_range(current, front, back);
+    if (front >= back) {
+      return false;
+    }
+  } while (!range.compare_exchange_weak(current, pack_tile_range(front + 1, back)));
+
+  r_tile_index = front;
+  return true;
+}
+
+
+bool ThreadWorkGroup::_steal_tile(const size_t p_queue_index, uint32_t &r_tile_index) {
+  const size_t thread_count = get_thread_count();
+
+  for (size_t i = 1; i < thread_count; i++) {
+    std::atomic<uint64_t> &range = tile_queues[(p_queue_index + i) % thread_count].range;
+    uint64_t current = range.load();
+    uint32_t front, back;
+
+    do {
+      unpack_tile_range(current, front, back);
+      if (front >= back) {
+        break;
+      }
+    } while (!range.compare_exchange_weak(current, pack_tile_range(front, back - 1)));
+
+    if (front < back) {
+      r_tile_index = back - 1;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+void ThreadWorkGroup::_run_tile(const size_t p_thread_id, const Tile &p_tile) {
+  tile_func(p_thread_id, p_tile);
+
+  // Progress is reported once per tile
+  size_t exec_count = 0;
+  for (size_t y = 0; y < p_tile.height; y++) {
+    const size_t row_begin = p_tile.begin_index + y * row_length;
+    if (row_begin >= end_index) {
+      break; // Last row of the range is incomplete
+    }
+    exec_count += std::min<size_t>(row_begin + p_tile.width, end_index) - row_begin;
+  }
+  progress += exec_count;
 }
 
 
 void ThreadWorkGroup::_reset() {
   begin_index = 0;
   end_index = 0;
-  index_stride = 0;
-  func = ParallelFunction();
+  row_length = 0;
+  tiles.clear();
+  tile_func = TileFunction();
 }
 
 
@@ -77,8 +218,9 @@ void ThreadWorkGroup::cancel() {
   assert(group_state == GroupState::WORKING);
   // Cancel the current work
   group_state = GroupState::IDLE;
+  graph.cancel();
   // Wait for every thread to stop
-  sync.arrive_and_wait();
+  pool->wait(graph);
 }
 
 
@@ -90,59 +232,19 @@ double ThreadWorkGroup::get_progress() const {
 void ThreadWorkGroup::join() {
   assert(group_state == GroupState::WORKING);
   // Wait for every thread to stop
-  sync.arrive_and_wait();
+  pool->wait(graph);
   group_state = GroupState::IDLE;
 }
 
 
-ThreadWorkGroup::ThreadWorkGroup(const size_t p_size)
-  : workers(p_size),
-  sync(p_size + 1)
-{
-  for (size_t i = 0; i < p_size; i++) {
-    workers[i] = std::thread([&, i]() {
-      const size_t thread_id = i;
-
-      while (group_state != GroupState::EXIT) {
-        sync.arrive_and_wait(); // Wait for something to happen
-
-        if (group_state == GroupState::EXIT) {
-          break;
-        }
-        
-        const size_t local_begin_index = begin_index + index_stride * thread_id;
-        const size_t local_end_index = std::min<size_t>(local_begin_index + index_stride, end_index);
-        const size_t local_exec_count = local_end_index - local_begin_index;
-
-        for (size_t i = 0; i < local_exec_count; i += 1) {
-          const size_t exec_index = local_begin_index + i;
-          func(thread_id, exec_index);
-
-          if (group_state != GroupState::WORKING) {
-            break; // Cancel execution
-          }
-
-          if (progress_report && (i + 1) % progress_report == 0) {
-            progress += progress_report;
-          }
-        }
-
-        done_thread_count += 1;
-        progress += (local_end_index - local_begin_index) % progress_report;
-
-        sync.arrive_and_wait(); // Wait for a join
-      }
-
-      sync.arrive_and_drop();
-    });
-  }
-}
+ThreadWorkGroup::ThreadWorkGroup(ThreadPool *p_pool)
+  : pool(p_pool),
+  tile_queues(p_pool->get_thread_count())
+{}
 
 
 ThreadWorkGroup::~ThreadWorkGroup() {
-  group_state = GroupState::EXIT;
-  sync.arrive_and_drop();
-  for (std::thread &worker : workers) {
-    worker.join();
+  if (group_state == GroupState::WORKING) {
+    cancel();
   }
 }
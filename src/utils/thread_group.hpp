@@ -38,54 +38,121 @@
 #pragma once
 
 
+#include <algorithm>
 #include <atomic>
-#include <barrier>
+#include <cstdint>
 #include <functional>
-#include <thread>
 #include <vector>
 
+#include "utils/thread_pool.hpp"
+
 
 typedef std::function<void(size_t p_thread_id, size_t p_exec_index)> ParallelFunction;
 
 
+// How the indices of a job are cut in tiles, the units of work handed out to the threads.
+struct TileSettings {
+  enum class Order {
+    SCANLINE,   // Row after row, from the first index
+    CENTER_OUT, // Closest tiles to the center of the image first
+  };
+
+  size_t row_length = 0; // The indices are the pixels of an image with rows of this length, 0 when they are not 2D
+  size_t tile_width = 16; // Jobs that are not 2D use tiles of tile_width * tile_height consecutive indices
+  size_t tile_height = 16;
+  Order order = Order::SCANLINE;
+};
+
+
+// Part of the range of a job, its indices are `begin_index + y * row_length + x` for x < width and y < height.
+struct Tile {
+  size_t begin_index;
+  uint32_t width, height;
+};
+
+
+// Cuts [p_begin_index, p_end_index) in tiles, in the order given by p_tile_settings.
+std::vector<Tile> build_tiles(const size_t p_begin_index, const size_t p_end_index, const TileSettings &p_tile_settings);
+
+
+// Calls p_function with every index of p_tile, the indices past p_end_index are skipped.
+template<typename F>
+inline void for_each_tile_index(const Tile &p_tile, const size_t p_row_length, const size_t p_end_index, F &&p_function) {
+  for (size_t y = 0; y < p_tile.height; y++) {
+    const size_t row_begin = p_tile.begin_index + y * p_row_length;
+    const size_t row_end = std::min<size_t>(row_begin + p_tile.width, p_end_index);
+    for (size_t exec_index = row_begin; exec_index < row_end; exec_index++) {
+      p_function(exec_index);
+    }
+  }
+}
+
+
+// Runs a function over a range of indices on the threads of a ThreadPool. The range is cut in tiles which are dealt
+// to the threads in contiguous blocks, a thread running out of tiles steals the last ones of another thread.
 class ThreadWorkGroup {
 public:
-  void execute(const ParallelFunction p_func, const size_t p_begin_index, const size_t p_end_index, const size_t progress_report_interval = 100);
+  // Calls `p_func(thread_id, index)` for every index, concurrently from several threads. p_func is inlined in the loop
+  // over the indices of a tile, only tiles go through an indirect call. Cancellation is checked between tiles.
+  template<typename F>
+  void execute(F p_func, const size_t p_begin_index, const size_t p_end_index, const TileSettings &p_tile_settings = TileSettings());
   void cancel();
   double get_progress() const;
-  inline size_t get_done_thread_count() const { return done_thread_count; }
-  inline bool is_work_done() const { return group_state != GroupState::WORKING || done_thread_count == get_thread_count(); }
+  inline size_t get_done_thread_count() const { return graph.get_done_task_count(); }
+  inline bool is_work_done() const { return group_state != GroupState::WORKING || graph.is_done(); }
 
   void join();
-  inline size_t get_thread_count() const { return workers.size(); }
+  inline size_t get_thread_count() const { return pool->get_thread_count(); }
 
-  ThreadWorkGroup(const size_t p_size);
+  ThreadWorkGroup(ThreadPool *p_pool = ThreadPool::get_singleton());
   ~ThreadWorkGroup();
 
 private:
   enum GroupState {
     IDLE,
     WORKING,
-    EXIT,
   };
 
+  // Tiles left to a thread, as a [front, back) range of `tiles` packed in one atomic so that the owner (taking from
+  // the front) and thieves (taking from the back) never need a lock.
+  struct alignas(64) TileQueue {
+    std::atomic<uint64_t> range;
+  };
+
+  typedef std::function<void(size_t p_thread_id, const Tile &p_tile)> TileFunction;
+
 private:
+  void _execute(TileFunction p_tile_func, const size_t p_begin_index, const size_t p_end_index, const TileSettings &p_tile_settings);
+  bool _pop_tile(const size_t p_queue_index, uint32_t &r_tile_index);
+  bool _steal_tile(const size_t p_queue_index, uint32_t &r_tile_index);
+  void _run_tile(const size_t p_thread_id, const Tile &p_tile);
 
   void _reset();
   
 private:
-  std::vector<std::thread> workers;
-  std::barrier<> sync;
+  ThreadPool *pool;
+  TaskGraph graph; // One task per thread of the pool, running tiles until there are none left
 
-  ParallelFunction func;
+  TileFunction tile_func;
   size_t begin_index;
-  size_t index_stride;
   size_t end_index;
+  size_t row_length;
 
-  size_t progress_report;
+  std::vector<Tile> tiles;
+  std::vector<TileQueue> tile_queues; // One per thread
 
   std::atomic<size_t> progress;
-  std::atomic<size_t> done_thread_count;
 
   std::atomic<GroupState> group_state = GroupState::IDLE;
 };
+
+
+template<typename F>
+void ThreadWorkGroup::execute(F p_func, const size_t p_begin_index, const size_t p_end_index, const TileSettings &p_tile_settings) {
+  const size_t tile_row_length = p_tile_settings.row_length;
+  _execute([p_func = std::move(p_func), tile_row_length, p_end_index](const size_t p_thread_id, const Tile &p_tile) {
+    for_each_tile_index(p_tile, tile_row_length, p_end_index, [&](const size_t p_exec_index) {
+      p_func(p_thread_id, p_exec_index);
+    });
+  }, p_begin_index, p_end_index, p_tile_settings);
+}
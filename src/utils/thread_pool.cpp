@@ -0,0 +1,269 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+#include "thread_pool.hpp"
+#include "tp_utils/src/debug.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <thread>
+
+
+// =============
+// = TaskGraph =
+// =============
+
+
+TaskID TaskGraph::add_task(Task p_task, std::span<const TaskID> p_dependencies) {
+  const TaskID task_id = static_cast<TaskID>(tasks.size());
+  Node &node = tasks.emplace_back();
+  node.task = std::move(p_task);
+
+  for (const TaskID dependency : p_dependencies) {
+    assert(dependency < task_id);
+    tasks[dependency].dependents.push_back(task_id);
+    node.dependency_count += 1;
+  }
+
+  return task_id;
+}
+
+
+void TaskGraph::clear() {
+  tasks.clear();
+  done_task_count = 0;
+  cancelled = false;
+}
+
+
+double TaskGraph::get_progress() const {
+  return (tasks.empty())? 1.0 : double(done_task_count) / double(tasks.size());
+}
+
+
+// ==============
+// = ThreadPool =
+// ==============
+
+
+void ThreadPool::submit(TaskGraph &p_graph) {
+  std::vector<TaskID> ready_tasks;
+  for (size_t i = 0; i < p_graph.tasks.size(); i++) {
+    TaskGraph::Node &node = p_graph.tasks[i];
+    node.remaining_dependencies = node.dependency_count;
+    if (node.dependency_count == 0) {
+      ready_tasks.push_back(static_cast<TaskID>(i));
+    }
+  }
+  p_graph.done_task_count = 0;
+
+  // Deal the ready tasks in contiguous blocks, so that each thread starts with neighbouring tasks
+  const size_t thread_count = get_thread_count();
+  const size_t tasks_per_thread = (ready_tasks.size() + thread_count - 1) / thread_count;
+  for (size_t i = 0; i < ready_tasks.size(); i++) {
+    _push(i / tasks_per_thread, QueuedTask{&p_graph, ready_tasks[i]}, false);
+  }
+}
+
+
+void ThreadPool::wait(const TaskGraph &p_graph) {
+  if (current_pool != this) {
+    std::unique_lock lock(sleep_mutex);
+    done_condition.wait(lock, [&]() { return p_graph.is_done(); });
+    return;
+  }
+
+  // Blocking a worker could deadlock, the tasks of p_graph may be queued on this very thread
+  while (!p_graph.is_done()) {
+    QueuedTask task;
+    if (_pop(current_thread_id, task) || _steal(current_thread_id, task)) {
+      _run(current_thread_id, task);
+      continue;
+    }
+
+    std::unique_lock lock(sleep_mutex);
+    wake_condition.wait(lock, [&]() { return p_graph.is_done() || queued_task_count > 0; });
+  }
+}
+
+
+void ThreadPool::_push(const size_t p_thread_id, const QueuedTask &p_task, const bool p_front) {
+  {
+    WorkerQueue &queue = queues[p_thread_id];
+    std::lock_guard lock(queue.mutex);
+    if (p_front) {
+      queue.tasks.push_front(p_task);
+    } else {
+      queue.tasks.push_back(p_task);
+    }
+    queued_task_count += 1;
+  }
+
+  // Taking the lock makes sure that a thread going to sleep sees the new task
+  { std::lock_guard lock(sleep_mutex); }
+  wake_condition.notify_one();
+}
+
+
+bool ThreadPool::_pop(const size_t p_thread_id, QueuedTask &r_task) {
+  WorkerQueue &queue = queues[p_thread_id];
+  std::lock_guard lock(queue.mutex);
+  if (queue.tasks.empty()) {
+    return false;
+  }
+
+  r_task = queue.tasks.front();
+  queue.tasks.pop_front();
+  queued_task_count -= 1;
+  return true;
+}
+
+
+bool ThreadPool::_steal(const size_t p_thread_id, QueuedTask &r_task) {
+  const size_t thread_count = get_thread_count();
+
+  for (size_t i = 1; i < thread_count; i++) {
+    WorkerQueue &queue = queues[(p_thread_id + i) % thread_count];
+    std::lock_guard lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      continue;
+    }
+
+    // Take from the other end than the owner, the tasks it will need last
+    r_task = queue.tasks.back();
+    queue.tasks.pop_back();
+    queued_task_count -= 1;
+    return true;
+  }
+
+  return false;
+}
+
+
+void ThreadPool::_run(const size_t p_thread_id, const QueuedTask &p_task) {
+  TaskGraph &graph = *p_task.graph;
+  TaskGraph::Node &node = graph.tasks[p_task.task];
+
+  if (!graph.cancelled) {
+    node.task(p_thread_id);
+  }
+
+  // Released tasks run next on this thread, while the data of this task is still in its cache
+  for (const TaskID dependent : node.dependents) {
+    if (graph.tasks[dependent].remaining_dependencies.fetch_sub(1) == 1) {
+      _push(p_thread_id, QueuedTask{&graph, dependent}, true);
+    }
+  }
+
+  // The graph can be destroyed as soon as its last task is counted, it must not be accessed after that
+  const size_t task_count = graph.tasks.size();
+  if (graph.done_task_count.fetch_add(1) + 1 == task_count) {
+    std::lock_guard lock(sleep_mutex);
+    done_condition.notify_all();
+    wake_condition.notify_all(); // Workers waiting for a graph sleep with the idle ones
+  }
+}
+
+
+size_t ThreadPool::singleton_thread_count = 0;
+std::atomic<bool> ThreadPool::singleton_created = false;
+thread_local ThreadPool *ThreadPool::current_pool = nullptr;
+thread_local size_t ThreadPool::current_thread_id = 0;
+
+
+ThreadPool *ThreadPool::get_singleton() {
+  static ThreadPool pool([]() -> size_t {
+    singleton_created = true;
+    if (singleton_thread_count) return singleton_thread_count;
+    const size_t available_thread_count = std::thread::hardware_concurrency();
+    return (available_thread_count)? available_thread_count : 8;
+  }());
+  return &pool;
+}
+
+
+void ThreadPool::set_singleton_thread_count(const size_t p_thread_count) {
+  if (singleton_created) {
+    LOG_WARNING("The thread pool already exists with " << get_singleton()->get_thread_count() << " threads, setting its thread count to " << p_thread_count << " has no effect");
+    assert(false && "set_singleton_thread_count called after the first call to get_singleton");
+    return;
+  }
+  singleton_thread_count = p_thread_count;
+}
+
+
+ThreadPool::ThreadPool(const size_t p_size)
+  : workers(p_size),
+  queues(p_size)
+{
+  for (size_t i = 0; i < p_size; i++) {
+    workers[i] = std::thread([&, i]() {
+      const size_t thread_id = i;
+      current_pool = this;
+      current_thread_id = thread_id;
+
+      while (true) {
+        QueuedTask task;
+        if (_pop(thread_id, task) || _steal(thread_id, task)) {
+          _run(thread_id, task);
+          continue;
+        }
+
+        // Nothing to do, wait for new tasks
+        std::unique_lock lock(sleep_mutex);
+        wake_condition.wait(lock, [&]() { return exit || queued_task_count > 0; });
+        if (exit && queued_task_count == 0) {
+          break;
+        }
+      }
+    });
+  }
+}
+
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(sleep_mutex);
+    exit = true;
+  }
+  wake_condition.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
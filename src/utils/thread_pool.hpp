@@ -0,0 +1,205 @@
+/* ------------------------------------------------------------------------------------------------------------------ *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                /\                    ^__                                            *
+*                                               /#*\  /\              /##@>                                           *
+*                                              <#* *> \/         _^_  \\    _^_                                       *
+*                                               \##/            /###\ \è\  /###\                                      *
+*                                                \/ /\         /#####n/xx\n#####\                                     *
+*                   Ferdinand                       \/         \###^##xXXx##^###/                                     *
+*                        Souchet                                \#/ V¨\xx/¨V \#/                                      *
+*                     (aka. @Khusheete)                          V     \c\    V                                       *
+*                                                                       //                                            *
+*                                                                     \o/                                             *
+*             ferdinand.souchet@etu.umontpellier.fr                    v                                              *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+*                                                                                                                     *
+* Copyright 2025 Ferdinand Souchet (aka. @Khusheete)                                                                  *
+*                                                                                                                     *
+* Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated        *
+* documentation files (the “Software”), to deal in the Software without restriction, including without limitation the *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to     *
+* permit persons to whom the Software is furnished to do so, subject to the following conditions:                     *
+*                                                                                                                     *
+* The above copyright notice and this permission notice shall be included in all copies or substantial portions of    *
+* the Software.                                                                                                       *
+*                                                                                                                     *
+* THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO    *
+* THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE      *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, *
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE      *
+* SOFTWARE.                                                                                                           *
+*                                                                                                                     *
+* ------------------------------------------------------------------------------------------------------------------ */
+
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+
+typedef uint32_t TaskID;
+
+
+// Tasks and the dependencies between them, executed by a ThreadPool. A task starts as soon as every task it depends
+// on is done, so there is no barrier between tasks that do not depend on each other.
+class TaskGraph {
+public:
+  // p_thread_id is the index of the thread of the pool running the task
+  typedef std::function<void(size_t p_thread_id)> Task;
+
+public:
+  // The dependencies must already be in the graph. Tasks cannot be added once the graph is submitted.
+  TaskID add_task(Task p_task, std::span<const TaskID> p_dependencies = {});
+  inline TaskID add_task(Task p_task, std::initializer_list<TaskID> p_dependencies) {
+    return add_task(std::move(p_task), std::span<const TaskID>(p_dependencies.begin(), p_dependencies.size()));
+  }
+
+  // The tasks that did not start yet are skipped
+  inline void cancel() { cancelled = true; }
+  inline bool is_cancelled() const { return cancelled; }
+
+  inline size_t get_task_count() const { return tasks.size(); }
+  inline size_t get_done_task_count() const { return done_task_count; }
+  inline bool is_done() const { return done_task_count == tasks.size(); }
+  double get_progress() const;
+
+  // Removes every task, the graph must not be running
+  void clear();
+
+  TaskGraph() = default;
+  TaskGraph(const TaskGraph&) = delete;
+  TaskGraph &operator=(const TaskGraph&) = delete;
+
+private:
+  struct Node {
+    Task task;
+    std::vector<TaskID> dependents;
+    uint32_t dependency_count = 0;
+    std::atomic<uint32_t> remaining_dependencies = 0;
+  };
+
+private:
+  friend class ThreadPool;
+
+  std::deque<Node> tasks;
+  std::atomic<size_t> done_task_count = 0;
+  std::atomic<bool> cancelled = false;
+};
+
+
+// Process-wide set of threads running task graphs. Every thread has its own queue of ready tasks: it runs the tasks of
+// its queue first, then steals from the other queues.
+class ThreadPool {
+public:
+  // Starts the tasks of p_graph, which must not be modified nor destroyed until `wait` returned.
+  void submit(TaskGraph &p_graph);
+  // Returns once every task of p_graph is done. Called from a task of the pool, the thread runs queued tasks (of any
+  // graph, with its own thread id) in the meantime instead of blocking, so that tasks can submit and wait for graphs.
+  void wait(const TaskGraph &p_graph);
+
+  inline size_t get_thread_count() const { return workers.size(); }
+
+  // The pool is created on first use, with one thread per hardware thread unless set_singleton_thread_count was called.
+  static ThreadPool *get_singleton();
+  // Must be called before the first call to get_singleton (which warns and asserts otherwise), 0 means one thread per
+  // hardware thread.
+  static void set_singleton_thread_count(const size_t p_thread_count);
+
+  ThreadPool(const size_t p_size);
+  ~ThreadPool();
+
+private:
+  struct QueuedTask {
+    TaskGraph *graph;
+    TaskID task;
+  };
+
+  struct alignas(64) WorkerQueue {
+    std::mutex mutex;
+    std::deque<QueuedTask> tasks;
+  };
+
+private:
+  void _push(const size_t p_thread_id, const QueuedTask &p_task, const bool p_front);
+  bool _pop(const size_t p_thread_id, QueuedTask &r_task);
+  bool _steal(const size_t p_thread_id, QueuedTask &r_task);
+  void _run(const size_t p_thread_id, const QueuedTask &p_task);
+
+private:
+  std::vector<std::thread> workers;
+  std::vector<WorkerQueue> queues; // One per thread
+
+  std::mutex sleep_mutex;
+  std::condition_variable wake_condition; // Signaled when tasks are queued
+  std::condition_variable done_condition; // Signaled when a graph is done
+  std::atomic<size_t> queued_task_count = 0;
+  bool exit = false;
+
+private:
+  static size_t singleton_thread_count;
+  static std::atomic<bool> singleton_created;
+
+  // Pool and thread id of the worker running on this thread, if any
+  static thread_local ThreadPool *current_pool;
+  static thread_local size_t current_thread_id;
+};
+
+
+// Adds to r_graph one task per chunk of p_chunk_size indices of [p_begin_index, p_end_index), depending on
+// p_dependencies. Each task calls `p_function(thread_id, index)` for the indices of its chunk in a loop p_function can
+// be inlined in, so that progress and cancellation are only handled per chunk. Returns the tasks of the chunks.
+template<typename F>
+std::vector<TaskID> add_parallel_for(TaskGraph &r_graph, const size_t p_begin_index, const size_t p_end_index, const size_t p_chunk_size, F p_function, std::span<const TaskID> p_dependencies = {}) {
+  // Shared by the tasks of every chunk, which may outlive the caller
+  const std::shared_ptr<const F> function = std::make_shared<const F>(std::move(p_function));
+  const size_t chunk_size = std::max<size_t>(p_chunk_size, 1);
+
+  std::vector<TaskID> chunk_tasks;
+  for (size_t chunk_begin = p_begin_index; chunk_begin < p_end_index; chunk_begin += chunk_size) {
+    const size_t chunk_end = std::min(chunk_begin + chunk_size, p_end_index);
+    chunk_tasks.push_back(r_graph.add_task([function, chunk_begin, chunk_end](const size_t p_thread_id) {
+      const F &chunk_function = *function;
+      for (size_t i = chunk_begin; i < chunk_end; i++) {
+        chunk_function(p_thread_id, i);
+      }
+    }, p_dependencies));
+  }
+
+  return chunk_tasks;
+}
+
+
+// Calls `p_function(thread_id, index)` for every index of [p_begin_index, p_end_index) on the threads of p_pool, and
+// returns once they are all done. A chunk size of 0 cuts the range in a few chunks per thread.
+template<typename F>
+void parallel_for(const size_t p_begin_index, const size_t p_end_index, F p_function, const size_t p_chunk_size = 0, ThreadPool *p_pool = ThreadPool::get_singleton()) {
+  if (p_end_index <= p_begin_index) {
+    return;
+  }
+
+  // Several chunks per thread so that the threads finishing early can steal some
+  constexpr size_t CHUNKS_PER_THREAD = 8;
+  const size_t chunk_count = p_pool->get_thread_count() * CHUNKS_PER_THREAD;
+  const size_t chunk_size = (p_chunk_size)? p_chunk_size : (p_end_index - p_begin_index + chunk_count - 1) / chunk_count;
+
+  TaskGraph graph;
+  add_parallel_for(graph, p_begin_index, p_end_index, chunk_size, std::move(p_function));
+  p_pool->submit(graph);
+  p_pool->wait(graph);
+}
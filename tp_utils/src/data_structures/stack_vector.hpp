@@ -151,6 +151,16 @@ namespace tputils {
       element_count -= 1;
     }
 
+    inline constexpr reference back()
+    {
+      return elements[element_count - 1];
+    }
+
+    inline constexpr const_reference back() const
+    {
+      return elements[element_count - 1];
+    }
+
     inline constexpr bool contains(const value_type &p_element) {
       for (value_type &e : elements) {
         if (e == p_element) return true;
@@ -194,7 +204,7 @@ namespace tputils {
       std::copy(p_other.begin(), p_other.end(), begin());
     }
 
-    // TODO: implement `insert`, `emplace`, `emplace_back`, `erase`, `at`, `back`, `front`
+    // TODO: implement `insert`, `emplace`, `emplace_back`, `erase`, `at`, `front`
 
   private:
     value_type elements[MAX_SIZE];
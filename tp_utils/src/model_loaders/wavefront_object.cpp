@@ -37,11 +37,16 @@
 
 #include "wavefront_object.hpp"
 #include "debug.hpp"
+#include "utils.hpp"
 
 #include "thirdparty/kmath/vector.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <fstream>
 #include <string>
+#include <string_view>
 
 
 namespace tputils {
@@ -66,92 +71,329 @@ namespace tputils {
   }
 
 
-  template<class e, class t>
-  std::basic_istream<e,t>& operator>>(std::basic_istream<e,t>& in, const e& cliteral) { // FIXME: don't use that
-      e buffer(0);
-      in >> buffer;
-      if (buffer != cliteral)
-        in.setstate(std::ios::failbit); // Fail if the literal is not correct
-      return in;
+  // ===========================
+  // = Wavefront mesh chunking =
+  // ===========================
+
+
+  // Number of elements of each kind in a part of the file, or index of its first element of each kind in the mesh
+  struct _WavefrontCounts {
+    size_t positions = 0;
+    size_t uvs = 0;
+    size_t normals = 0;
+    size_t triangles = 0;
+  };
+
+
+  // Statement that does not add elements to the mesh, applied in the order of the file once every chunk is parsed
+  struct _WavefrontStatement {
+    enum class Kind {
+      OBJECT,
+      MATERIAL,
+      MATERIAL_LIBRARY,
+    };
+
+    Kind kind;
+    size_t triangle_index; // Index of the first triangle following the statement
+    std::string name;
+  };
+
+
+  // Lines of the file parsed by a single thread
+  struct _WavefrontChunk {
+    const char *begin;
+    const char *end;
+
+    _WavefrontCounts counts;
+    _WavefrontCounts offsets;
+    std::vector<_WavefrontStatement> statements;
+    std::string error; // Empty if the chunk is valid
+  };
+
+
+  static inline const char *_skip_spaces(const char *p_begin, const char *p_end) {
+    while (p_begin < p_end && (*p_begin == ' ' || *p_begin == '\t' || *p_begin == '\r')) {
+      p_begin++;
+    }
+    return p_begin;
   }
 
 
-  WavefrontMesh WavefrontMesh::load(const std::filesystem::path &p_path) {
-    WavefrontMesh mesh{};
-    
-    std::ifstream file(p_path);
-    WavefrontObject *current_object = nullptr;
-    std::string token;
+  static inline const char *_skip_token(const char *p_begin, const char *p_end) {
+    while (p_begin < p_end && *p_begin != ' ' && *p_begin != '\t' && *p_begin != '\r') {
+      p_begin++;
+    }
+    return p_begin;
+  }
 
-    while (file.good()) {
-      token.clear();
-      file >> token;
-      
-      if (token == "v") { // Vertex position
-        if (!current_object) {
-          LOG_WARNING("Could not load mesh at `" << p_path << "` missing object");
-          return WavefrontMesh{};
+
+  static inline const char *_find_line_end(const char *p_begin, const char *p_end) {
+    const void *line_end = std::memchr(p_begin, '\n', p_end - p_begin);
+    return (line_end)? static_cast<const char*>(line_end) : p_end;
+  }
+
+
+  // Reads the next token of the line, r_cursor is moved after it. Returns an empty token at the end of the line.
+  static inline std::string_view _next_token(const char *&r_cursor, const char *p_line_end) {
+    const char *begin = _skip_spaces(r_cursor, p_line_end);
+    r_cursor = _skip_token(begin, p_line_end);
+    return std::string_view(begin, r_cursor - begin);
+  }
+
+
+  template<typename T>
+  static inline bool _parse_number(const char *&r_cursor, const char *p_line_end, T &r_value) {
+    const char *begin = _skip_spaces(r_cursor, p_line_end);
+    const std::from_chars_result result = std::from_chars(begin, p_line_end, r_value);
+    r_cursor = result.ptr;
+    return result.ec == std::errc();
+  }
+
+
+  // Turns a one-based (or negative, relative to the elements defined so far) index into a zero-based index.
+  // Indices past the p_total_count elements of the file are rejected.
+  static inline bool _resolve_index(const int64_t p_index, const size_t p_defined_count, const size_t p_total_count, uint32_t &r_index) {
+    if (p_index > 0 && static_cast<size_t>(p_index) <= p_total_count) {
+      r_index = static_cast<uint32_t>(p_index - 1);
+      return true;
+    }
+    if (p_index < 0 && static_cast<size_t>(-p_index) <= p_defined_count) {
+      r_index = static_cast<uint32_t>(p_defined_count + p_index);
+      return true;
+    }
+    return false;
+  }
+
+
+  // First pass over a chunk, counting its elements so that the arrays of the mesh can be allocated once
+  static void _count_chunk(_WavefrontChunk &r_chunk) {
+    const char *line = r_chunk.begin;
+    while (line < r_chunk.end) {
+      const char *line_end = _find_line_end(line, r_chunk.end);
+      const char *cursor = line;
+      const std::string_view keyword = _next_token(cursor, line_end);
+
+      if (keyword == "v") {
+        r_chunk.counts.positions++;
+      } else if (keyword == "vt") {
+        r_chunk.counts.uvs++;
+      } else if (keyword == "vn") {
+        r_chunk.counts.normals++;
+      } else if (keyword == "f") {
+        // Polygons are split in a fan of triangles
+        size_t vertex_count = 0;
+        while (!_next_token(cursor, line_end).empty()) {
+          vertex_count++;
         }
-        float x, y, z;
-        file >> x >> y >> z;
-        mesh.positions.push_back(kmath::Vec3(x, y, z));
-      } else if (token == "vn") { // Vertex normal
-        if (!current_object) {
-          LOG_WARNING("Could not load mesh at `" << p_path << "` missing object");
-          return WavefrontMesh{};
+        if (vertex_count >= 3) {
+          r_chunk.counts.triangles += vertex_count - 2;
         }
-        float x, y, z;
-        file >> x >> y >> z;
-        mesh.normals.push_back(kmath::Vec3(x, y, z));
-      } else if (token == "vt") { // Vertex texture
-        if (!current_object) {
-          LOG_WARNING("Could not load mesh at `" << p_path << "` missing object");
-          return WavefrontMesh{};
+      }
+
+      line = line_end + 1;
+    }
+  }
+
+
+  // Second pass over a chunk, writing its elements at its offsets in the arrays of the mesh
+  static void _parse_chunk(_WavefrontChunk &r_chunk, WavefrontMesh &r_mesh, std::vector<uint32_t> &r_position_indices, std::vector<uint32_t> &r_uv_indices, std::vector<uint32_t> &r_normal_indices) {
+    _WavefrontCounts next = r_chunk.offsets;
+    std::vector<uint32_t> polygon; // Position, uv and normal index of each vertex of the current face
+
+    auto fail = [&](const char *p_line, const char *p_line_end, const char *p_error) -> void {
+      r_chunk.error = std::string(p_error) + " in line `" + std::string(p_line, p_line_end) + "`";
+    };
+
+    const char *line = r_chunk.begin;
+    while (line < r_chunk.end) {
+      const char *line_end = _find_line_end(line, r_chunk.end);
+      const char *cursor = line;
+      const std::string_view keyword = _next_token(cursor, line_end);
+
+      if (keyword == "v") { // Vertex position
+        kmath::Vec3 &position = r_mesh.positions[next.positions++];
+        if (!_parse_number(cursor, line_end, position.x) || !_parse_number(cursor, line_end, position.y) || !_parse_number(cursor, line_end, position.z)) {
+          return fail(line, line_end, "Invalid vertex position");
         }
-        float u, v;
-        file >> u >> v;
-        mesh.uvs.push_back(kmath::Vec2(u, v));
-      } else if (token == "f") {
-        if (!current_object) {
-          LOG_WARNING("Could not load mesh at `" << p_path << "` missing object");
-          return WavefrontMesh{};
+      } else if (keyword == "vt") { // Vertex texture
+        kmath::Vec2 &uv = r_mesh.uvs[next.uvs++];
+        if (!_parse_number(cursor, line_end, uv.x) || !_parse_number(cursor, line_end, uv.y)) {
+          return fail(line, line_end, "Invalid vertex texture");
         }
-        uint32_t pos0, uv0, norm0, pos1, uv1, norm1, pos2, uv2, norm2;
-        file >> pos0 >> '/' >> uv0 >> '/' >> norm0;
-        file >> pos1 >> '/' >> uv1 >> '/' >> norm1;
-        file >> pos2 >> '/' >> uv2 >> '/' >> norm2;
-
-        current_object->position_indices.push_back(pos0 - 1);
-        current_object->position_indices.push_back(pos1 - 1);
-        current_object->position_indices.push_back(pos2 - 1);
-
-        current_object->uv_indices.push_back(uv0 - 1);
-        current_object->uv_indices.push_back(uv1 - 1);
-        current_object->uv_indices.push_back(uv2 - 1);
-
-        current_object->normal_indices.push_back(norm0 - 1);
-        current_object->normal_indices.push_back(norm1 - 1);
-        current_object->normal_indices.push_back(norm2 - 1);
-      } else if (token == "o") { // Change the current object
-        // Setup the new object
-        file >> token;
-        mesh.objects[token] = WavefrontObject{};
-        current_object = &mesh.objects[token];
-      } else if  (token == "mtllib") {
-        std::filesystem::path material_path;
-        file >> material_path;
-        material_path = p_path.parent_path() / material_path;
-        mesh._include_materials(material_path);
-      } else if (token == "usemtl") {
+      } else if (keyword == "vn") { // Vertex normal
+        kmath::Vec3 &normal = r_mesh.normals[next.normals++];
+        if (!_parse_number(cursor, line_end, normal.x) || !_parse_number(cursor, line_end, normal.y) || !_parse_number(cursor, line_end, normal.z)) {
+          return fail(line, line_end, "Invalid vertex normal");
+        }
+      } else if (keyword == "f") { // Face, as position/uv/normal indices
+        polygon.clear();
+        while (true) {
+          cursor = _skip_spaces(cursor, line_end);
+          if (cursor == line_end) break;
+
+          int64_t position_index, uv_index, normal_index;
+          uint32_t resolved_position, resolved_uv, resolved_normal;
+          const bool valid = _parse_number(cursor, line_end, position_index)
+            && cursor < line_end && *(cursor++) == '/'
+            && _parse_number(cursor, line_end, uv_index)
+            && cursor < line_end && *(cursor++) == '/'
+            && _parse_number(cursor, line_end, normal_index)
+            && _resolve_index(position_index, next.positions, r_mesh.positions.size(), resolved_position)
+            && _resolve_index(uv_index, next.uvs, r_mesh.uvs.size(), resolved_uv)
+            && _resolve_index(normal_index, next.normals, r_mesh.normals.size(), resolved_normal);
+          if (!valid) {
+            return fail(line, line_end, "Invalid face, expected position/uv/normal indices");
+          }
+
+          polygon.push_back(resolved_position);
+          polygon.push_back(resolved_uv);
+          polygon.push_back(resolved_normal);
+        }
+
+        const size_t vertex_count = polygon.size() / 3;
+        for (size_t i = 2; i < vertex_count; i++) {
+          const size_t triangle = next.triangles++;
+          const size_t vertices[3] = {0, i - 1, i};
+          for (size_t v = 0; v < 3; v++) {
+            r_position_indices[3 * triangle + v] = polygon[3 * vertices[v] + 0];
+            r_uv_indices[3 * triangle + v] = polygon[3 * vertices[v] + 1];
+            r_normal_indices[3 * triangle + v] = polygon[3 * vertices[v] + 2];
+          }
+        }
+      } else if (keyword == "o") { // Change the current object
+        r_chunk.statements.push_back({_WavefrontStatement::Kind::OBJECT, next.triangles, std::string(_next_token(cursor, line_end))});
+      } else if (keyword == "usemtl") {
+        r_chunk.statements.push_back({_WavefrontStatement::Kind::MATERIAL, next.triangles, std::string(_next_token(cursor, line_end))});
+      } else if (keyword == "mtllib") {
+        r_chunk.statements.push_back({_WavefrontStatement::Kind::MATERIAL_LIBRARY, next.triangles, std::string(_next_token(cursor, line_end))});
+      } // Other statements (comments, groups, smoothing...) are ignored
+
+      line = line_end + 1;
+    }
+  }
+
+
+  // Runs p_function on every chunk, with p_for_each if there are several
+  template<typename F>
+  static void _for_each_chunk(std::vector<_WavefrontChunk> &r_chunks, const WavefrontMesh::ForEach &p_for_each, F p_function) {
+    if (r_chunks.size() == 1 || !p_for_each) {
+      for (_WavefrontChunk &chunk : r_chunks) {
+        p_function(chunk);
+      }
+      return;
+    }
+
+    p_for_each(r_chunks.size(), [&](const size_t p_index) { p_function(r_chunks[p_index]); });
+  }
+
+
+  // ==================
+  // = Wavefront mesh =
+  // ==================
+
+
+  WavefrontMesh WavefrontMesh::load(const std::filesystem::path &p_path, const size_t p_max_chunk_count, const ForEach &p_for_each_chunk) {
+    WavefrontMesh mesh{};
+
+    const MappedFile file(p_path, MappedFile::Access::SEQUENTIAL);
+    if (!file.is_valid()) {
+      LOG_WARNING("Could not open mesh at `" << p_path << "`");
+      return WavefrontMesh{};
+    }
+
+    // Cut the file in chunks of whole lines, as many as allowed for large files
+    constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+    const size_t chunk_count = std::clamp<size_t>(file.size() / MIN_CHUNK_SIZE, 1, std::max<size_t>(p_max_chunk_count, 1));
+
+    std::vector<_WavefrontChunk> chunks(chunk_count);
+    const char *file_end = file.data() + file.size();
+    const char *chunk_begin = file.data();
+    for (size_t i = 0; i < chunk_count; i++) {
+      const char *chunk_end = (i + 1 == chunk_count)? file_end : file.data() + (i + 1) * (file.size() / chunk_count);
+      chunk_end = std::max(chunk_end, chunk_begin);
+      chunk_end = (chunk_end < file_end)? _find_line_end(chunk_end, file_end) + 1 : file_end;
+      chunk_end = std::min(chunk_end, file_end);
+      chunks[i].begin = chunk_begin;
+      chunks[i].end = chunk_end;
+      chunk_begin = chunk_end;
+    }
+
+    // Count the elements of every chunk, to allocate the arrays of the mesh and know where each chunk writes
+    _for_each_chunk(chunks, p_for_each_chunk, &_count_chunk);
+
+    _WavefrontCounts total;
+    for (_WavefrontChunk &chunk : chunks) {
+      chunk.offsets = total;
+      total.positions += chunk.counts.positions;
+      total.uvs += chunk.counts.uvs;
+      total.normals += chunk.counts.normals;
+      total.triangles += chunk.counts.triangles;
+    }
+
+    mesh.positions.resize(total.positions);
+    mesh.uvs.resize(total.uvs);
+    mesh.normals.resize(total.normals);
+    std::vector<uint32_t> position_indices(3 * total.triangles);
+    std::vector<uint32_t> uv_indices(3 * total.triangles);
+    std::vector<uint32_t> normal_indices(3 * total.triangles);
+
+    _for_each_chunk(chunks, p_for_each_chunk, [&](_WavefrontChunk &r_chunk) {
+      _parse_chunk(r_chunk, mesh, position_indices, uv_indices, normal_indices);
+    });
+
+    for (const _WavefrontChunk &chunk : chunks) {
+      if (!chunk.error.empty()) {
+        LOG_WARNING("Could not load mesh at `" << p_path << "`: " << chunk.error);
+        return WavefrontMesh{};
+      }
+    }
+
+    // Hand the triangles out to their objects. Triangles before the first object go to an unnamed object.
+    WavefrontObject *current_object = nullptr;
+    size_t object_begin = 0;
+
+    auto add_triangles = [&](const size_t p_end) -> void {
+      if (p_end > object_begin) {
         if (!current_object) {
-          LOG_WARNING("Could not load mesh at `" << p_path << "` missing object");
-          return WavefrontMesh{};
+          current_object = &mesh.objects[""];
+        }
+
+        if (object_begin == 0 && p_end == total.triangles && current_object->position_indices.empty()) {
+          // The whole mesh is a single object
+          current_object->position_indices = std::move(position_indices);
+          current_object->uv_indices = std::move(uv_indices);
+          current_object->normal_indices = std::move(normal_indices);
+        } else {
+          current_object->position_indices.insert(current_object->position_indices.end(), position_indices.begin() + 3 * object_begin, position_indices.begin() + 3 * p_end);
+          current_object->uv_indices.insert(current_object->uv_indices.end(), uv_indices.begin() + 3 * object_begin, uv_indices.begin() + 3 * p_end);
+          current_object->normal_indices.insert(current_object->normal_indices.end(), normal_indices.begin() + 3 * object_begin, normal_indices.begin() + 3 * p_end);
+        }
+      }
+      object_begin = p_end;
+    };
+
+    for (const _WavefrontChunk &chunk : chunks) {
+      for (const _WavefrontStatement &statement : chunk.statements) {
+        add_triangles(statement.triangle_index);
+
+        switch (statement.kind) {
+        case _WavefrontStatement::Kind::OBJECT:
+          mesh.objects[statement.name] = WavefrontObject{};
+          current_object = &mesh.objects[statement.name];
+          break;
+        case _WavefrontStatement::Kind::MATERIAL:
+          if (!current_object) {
+            current_object = &mesh.objects[""];
+          }
+          current_object->material = statement.name;
+          break;
+        case _WavefrontStatement::Kind::MATERIAL_LIBRARY:
+          mesh._include_materials(p_path.parent_path() / statement.name);
+          break;
         }
-        file >> current_object->material;
-      } else if (token == "s" || token == "#") {
-        std::getline(file, token); // Ignore tokens
       }
     }
+    add_triangles(total.triangles);
 
     return mesh;
   }
@@ -40,7 +40,9 @@
 
 #include "thirdparty/kmath/vector.hpp"
 
+#include <cstddef>
 #include <filesystem>
+#include <functional>
 #include <map>
 #include <string>
 #include <vector>
@@ -111,7 +113,11 @@ namespace tputils {
     std::map<std::string, WavefrontObject> objects;
     std::map<std::string, WavefrontMaterial> materials;
 
-    static WavefrontMesh load(const std::filesystem::path &p_path);
+    // Calls p_function(index) for every index of [0, p_count), possibly in parallel, and returns once they are all done
+    typedef std::function<void(const size_t p_count, const std::function<void(size_t p_index)> &p_function)> ForEach;
+
+    // Large files are cut in up to p_max_chunk_count chunks, parsed by p_for_each_chunk (sequentially if it is empty)
+    static WavefrontMesh load(const std::filesystem::path &p_path, const size_t p_max_chunk_count = 1, const ForEach &p_for_each_chunk = ForEach());
   
   private:
     void _include_materials(const std::filesystem::path &p_path);
@@ -37,9 +37,17 @@
 
 #include "utils.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace tputils {
   std::string read_file(const std::filesystem::path &p_path) {
     std::ifstream ifs(p_path, std::ios::binary | std::ios::ate);
@@ -56,4 +64,106 @@ namespace tputils {
 
     return std::string(result.begin(), result.end());
   }
+
+
+  uint64_t hash_bytes(const void *p_data, const size_t p_size, const uint64_t p_seed) {
+    constexpr uint64_t MULTIPLIER = 0x9e3779b97f4a7c15;
+    auto mix = [](uint64_t p_hash) -> uint64_t {
+      p_hash ^= p_hash >> 32;
+      p_hash *= 0xd6e8feb86659fd93;
+      p_hash ^= p_hash >> 32;
+      return p_hash;
+    };
+
+    const char *bytes = static_cast<const char*>(p_data);
+    uint64_t hash = p_seed ^ (p_size * MULTIPLIER);
+
+    // Four independent lanes of 8 bytes, so that the multiplications do not wait on each other
+    uint64_t lanes[4] = {hash, hash + 1, hash + 2, hash + 3};
+    size_t offset = 0;
+    for (; offset + sizeof(lanes) <= p_size; offset += sizeof(lanes)) {
+      uint64_t words[4];
+      std::memcpy(words, bytes + offset, sizeof(words));
+      for (size_t i = 0; i < 4; i++) {
+        lanes[i] = (lanes[i] ^ words[i]) * MULTIPLIER;
+        lanes[i] ^= lanes[i] >> 29;
+      }
+    }
+    for (size_t i = 0; i < 4; i++) {
+      hash = mix(hash ^ lanes[i]) * MULTIPLIER;
+    }
+
+    // Remaining bytes, zero padded
+    for (; offset < p_size; offset += sizeof(uint64_t)) {
+      uint64_t word = 0;
+      std::memcpy(&word, bytes + offset, std::min(sizeof(uint64_t), p_size - offset));
+      hash = mix(hash ^ word) * MULTIPLIER;
+    }
+
+    return mix(hash);
+  }
+
+
+  MappedFile::MappedFile(const std::filesystem::path &p_path, const Access p_access) {
+    const int file = open(p_path.c_str(), O_RDONLY);
+    if (file < 0) return;
+
+    struct stat file_stat;
+    if (fstat(file, &file_stat) == 0) {
+      mapping_size = file_stat.st_size;
+
+      if (mapping_size == 0) { // Empty files cannot be mapped
+        valid = true;
+      } else {
+        void *address = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (address != MAP_FAILED) {
+          switch (p_access) {
+          case Access::NORMAL: break;
+          case Access::SEQUENTIAL: madvise(address, mapping_size, MADV_SEQUENTIAL); break;
+          case Access::RANDOM: madvise(address, mapping_size, MADV_RANDOM); break;
+          }
+          mapping = static_cast<const char*>(address);
+          valid = true;
+        } else {
+          mapping_size = 0;
+        }
+      }
+    }
+
+    // The mapping stays valid once the file is closed
+    close(file);
+  }
+
+
+  MappedFile::MappedFile(MappedFile &&p_other)
+    : mapping(std::exchange(p_other.mapping, nullptr)),
+    mapping_size(std::exchange(p_other.mapping_size, 0)),
+    valid(std::exchange(p_other.valid, false))
+  {}
+
+
+  MappedFile &MappedFile::operator=(MappedFile &&p_other) {
+    if (this != &p_other) {
+      _unmap();
+      mapping = std::exchange(p_other.mapping, nullptr);
+      mapping_size = std::exchange(p_other.mapping_size, 0);
+      valid = std::exchange(p_other.valid, false);
+    }
+    return *this;
+  }
+
+
+  MappedFile::~MappedFile() {
+    _unmap();
+  }
+
+
+  void MappedFile::_unmap() {
+    if (mapping) {
+      munmap(const_cast<char*>(mapping), mapping_size);
+    }
+    mapping = nullptr;
+    mapping_size = 0;
+    valid = false;
+  }
 }
@@ -38,10 +38,50 @@
 #pragma once
 
 
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <string>
+#include <string_view>
 
 
 namespace tputils {
   std::string read_file(const std::filesystem::path &p_path);
+
+  // Fast non-cryptographic 64 bit hash, to detect changes in large buffers
+  uint64_t hash_bytes(const void *p_data, const size_t p_size, const uint64_t p_seed = 0);
+
+
+  // Read-only view of a whole file mapped in memory, the pages are only read from the disk when they are accessed
+  class MappedFile {
+  public:
+    // Hint given to the kernel on how the pages will be read
+    enum class Access {
+      NORMAL,     // No hint
+      SEQUENTIAL, // Read once from the start to the end, the pages can be dropped soon after they are read
+      RANDOM,     // Read in any order, no read-ahead
+    };
+
+  public:
+    inline const char *data() const { return mapping; }
+    inline size_t size() const { return mapping_size; }
+    inline std::string_view view() const { return std::string_view(mapping, mapping_size); }
+    inline bool is_valid() const { return valid; }
+
+    MappedFile() = default;
+    MappedFile(const std::filesystem::path &p_path, const Access p_access = Access::NORMAL);
+    MappedFile(MappedFile &&p_other);
+    MappedFile &operator=(MappedFile &&p_other);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+  private:
+    void _unmap();
+
+  private:
+    const char *mapping = nullptr;
+    size_t mapping_size = 0;
+    bool valid = false;
+  };
 }